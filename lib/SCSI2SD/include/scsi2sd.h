@@ -130,8 +130,9 @@ typedef struct __attribute__((packed))
 	int16_t mediumType;
 	uint8_t tapeDensity;
 	uint8_t tapeBufferedMode;
+	uint8_t tapeCompression;
 
-	uint8_t reserved[56]; // Pad out to 128 bytes for main section.
+	uint8_t reserved[55]; // Pad out to 128 bytes for main section.
 } S2S_TargetCfg;
 
 typedef struct __attribute__((packed))
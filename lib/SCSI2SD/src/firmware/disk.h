@@ -57,4 +57,10 @@ int scsiDiskCommand(void);
 void scsiDiskReportLUNs(void);
 int doTestUnitReady();
 
+// Logical block provisioning is reported when UNMAP can erase blocks of
+// the current target. scsiDiskProvisioningVPD() fills VPD page 0xB0 or
+// 0xB2 and returns its length.
+int scsiDiskHasProvisioning(void);
+uint32_t scsiDiskProvisioningVPD(uint8_t pageCode, uint8_t *buf);
+
 #endif
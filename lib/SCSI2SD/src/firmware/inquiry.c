@@ -26,6 +26,7 @@
 #include "scsi.h"
 #include "config.h"
 #include "inquiry.h"
+#include "disk.h"
 #include <ZuluSCSI_config.h>
 #include <custom_vendor_inquiry.h>
 #include <string.h>
@@ -190,6 +191,13 @@ void s2s_scsiInquiry()
 		{
 			memcpy(scsiDev.data, SupportedVitalPages, sizeof(SupportedVitalPages));
 			scsiDev.dataLen = sizeof(SupportedVitalPages);
+			if (scsiDiskHasProvisioning())
+			{
+				// Block Limits and Logical Block Provisioning pages
+				scsiDev.data[scsiDev.dataLen++] = 0xB0;
+				scsiDev.data[scsiDev.dataLen++] = 0xB2;
+				scsiDev.data[3] += 2;
+			}
 			scsiDev.phase = DATA_IN;
 		}
 		else if (pageCode == 0x80)
@@ -218,6 +226,11 @@ void s2s_scsiInquiry()
 			scsiDev.dataLen = sizeof(AscImpOperatingDefinition);
 			scsiDev.phase = DATA_IN;
 		}
+		else if ((pageCode == 0xB0 || pageCode == 0xB2) && scsiDiskHasProvisioning())
+		{
+			scsiDev.dataLen = scsiDiskProvisioningVPD(pageCode, scsiDev.data);
+			scsiDev.phase = DATA_IN;
+		}
 		else
 		{
 			// error.
@@ -679,6 +679,8 @@ static void doModeSense(int sixByteCmd, int dbd, int pc, int pageCode, int alloc
 		idx += sizeof(SequentialDeviceConfigPage);
 	}
 
+	idx += modeSenseTapeCompressionPage(pc, idx, pageCode, &pageFound);
+
 	idx += modeSenseCDCapabilitiesPage(pc, idx, pageCode, &pageFound);
 
 	if ((scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_APPLE) &&
@@ -878,6 +880,11 @@ static void doModeSelect(void)
 				if (!modeSelectCDAudioControlPage(pageLen, idx)) goto bad;
 			}
 			break;
+			case 0x0F: // Data compression page
+			{
+				if (!modeSelectTapeCompressionPage(pageLen, idx)) goto bad;
+			}
+			break;
 			//default:
 
 				// Easiest to just ignore for now. We'll get here when changing
@@ -26,6 +26,9 @@
 
 extern int platform_network_send(uint8_t *buf, size_t len);
 
+// Spacing of transmit frame buffers in scsiDev.data, word aligned for DMA
+#define NETWORK_FRAME_BUFFER_SIZE ((NETWORK_PACKET_MAX_SIZE + 3) & ~3)
+
 bool scsiNetworkEnabled = false;
 struct scsiNetworkPacketQueue scsiNetworkInboundQueue;
 
@@ -285,7 +288,16 @@ int scsiNetworkCommand()
 		break;
 
 	case 0x0a:
+	{
 		// write(6)
+		// Frames are received alternately into two halves of the buffer.
+		// Each frame is handed to the network driver while the next one is
+		// being received from the SCSI bus.
+		uint8_t *frame = scsiDev.data;
+		uint8_t *pending = NULL;
+		long pending_len = 0;
+		uint8_t *preamble = scsiDev.data + 2 * NETWORK_FRAME_BUFFER_SIZE;
+
 		scsiEnterPhase(DATA_OUT);
 
 		for (;;)
@@ -300,13 +312,13 @@ int scsiNetworkCommand()
 			else
 			{
 				// read size of this packet
-				scsiRead(scsiDev.data, 4, &parityError);
+				scsiRead(preamble, 4, &parityError);
 				if (parityError)
 				{
 					DBGMSG_F("%s: read of size from host had parity error %d", __func__, parityError);
 				}
 
-				len = (scsiDev.data[0] << 8) + scsiDev.data[1];
+				len = (preamble[0] << 8) + preamble[1];
 				if (len == 0)
 				{
 					// final packet was read in previous iteration
@@ -320,13 +332,23 @@ int scsiNetworkCommand()
 				len = NETWORK_PACKET_MAX_SIZE;
 			}
 
-			scsiRead(scsiDev.data, len, &parityError);
+			parityError = 0;
+			scsiStartRead(frame, len, &parityError);
+
+			if (pending)
+			{
+				platform_network_send(pending, pending_len);
+			}
+
+			scsiFinishRead(frame, len, &parityError);
 			if (parityError)
 			{
 				DBGMSG_F("%s: read from host of size %zu had parity error %d", __func__, size, parityError);
 			}
 
-			platform_network_send(scsiDev.data, len);      
+			pending = frame;
+			pending_len = len;
+			frame = (frame == scsiDev.data) ? scsiDev.data + NETWORK_FRAME_BUFFER_SIZE : scsiDev.data;
 
 			if (scsiDev.cdb[5] == 0x0)
 			{
@@ -335,9 +357,19 @@ int scsiNetworkCommand()
 			}
 		}
 
+		// Wait for any remaining read DMA to finish. The last frame is
+		// sent before STATUS phase, so the host waits for it.
+		scsiFinishRead(NULL, 0, &parityError);
+
+		if (pending)
+		{
+			platform_network_send(pending, pending_len);
+		}
+
 		scsiDev.status = GOOD;
 		scsiDev.phase = STATUS;
 		break;
+	}
 
 	case 0x0c:
 		// set interface mode (ignored)
@@ -195,7 +195,7 @@ void process_Status()
 		message = MSG_COMMAND_COMPLETE;
 	}
 
-	if (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
+	if (scsiDev.target && scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
 	{
 		// More non-standardness. Expects 2 status bytes (really status + msg)
 		// 00 d 000 err 0
@@ -415,7 +415,7 @@ static void process_Command()
 		// REQUEST SENSE
 		uint32_t allocLength = scsiDev.cdb[4];
 
-		if (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
+		if (scsiDev.target && scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
 		{
 			// Completely non-standard
 			allocLength = 4;
@@ -917,7 +917,7 @@ static void process_SelectionPhase()
 	// The Mac Plus boot-time (ie. rom code) selection abort time
 	// is < 1ms and must have no delay (standard suggests 250ms abort time)
 	// Most newer SCSI2 hosts don't care either way.
-	if (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
+	if (scsiDev.target && scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_XEBEC)
 	{
 		s2s_delay_ms(1); // Simply won't work if set to 0.
 	}
@@ -1452,6 +1452,7 @@ void scsiInit()
 			scsiDev.targets[i].liveCfg.bytesPerSector = cfg->bytesPerSector;
 			scsiDev.targets[i].liveCfg.tapeDensity = cfg->tapeDensity;
 			scsiDev.targets[i].liveCfg.tapeBufferedMode = cfg->tapeBufferedMode;
+			scsiDev.targets[i].liveCfg.tapeCompression = cfg->tapeCompression;
 		}
 		else
 		{
@@ -1462,7 +1463,7 @@ void scsiInit()
 		scsiDev.targets[i].reserverId = -1;
 		if (firstInit)
 		{
-			if ((cfg->deviceType == S2S_CFG_MO) && (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_EWSD))
+			if (cfg && (cfg->deviceType == S2S_CFG_MO) && scsiDev.target && (scsiDev.target->cfg->quirks == S2S_CFG_QUIRKS_EWSD))
 			{
 				scsiDev.targets[i].unitAttention = POWER_ON_RESET_OR_BUS_DEVICE_RESET_OCCURRED;
 			} else
@@ -1498,8 +1499,8 @@ void scsiInit()
 		else
 #endif
 		{
-			scsiDev.target->sense.code = NO_SENSE;
-			scsiDev.target->sense.asc = NO_ADDITIONAL_SENSE_INFORMATION;
+			scsiDev.targets[i].sense.code = NO_SENSE;
+			scsiDev.targets[i].sense.asc = NO_ADDITIONAL_SENSE_INFORMATION;
 			// Always "start" the device. Many systems (eg. Apple System 7)
 			// won't respond properly to
 			// LOGICAL_UNIT_NOT_READY_INITIALIZING_COMMAND_REQUIRED sense
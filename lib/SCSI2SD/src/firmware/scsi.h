@@ -97,6 +97,7 @@ typedef struct
 	uint16_t bytesPerSector;
 	uint8_t tapeDensity;
 	uint8_t tapeBufferedMode; // Buffered mode field from MODE SELECT byte 2
+	uint8_t tapeCompression; // DCE bit from Data Compression mode page
 } LiveCfg;
 
 typedef struct {
@@ -31,10 +31,12 @@ namespace zipparser
     Parser::Parser()
     {
         filename_len = 0;
+        match_any = false;
         Reset();
     }
     Parser::Parser(char const *filename, const size_t length, const size_t target_total_length)
     {
+        match_any = false;
         Reset();
         SetMatchingFilename(filename, length, target_total_length);
     }
@@ -45,6 +47,8 @@ namespace zipparser
         position = 0;
         filename_match = false;
         crc = 0;
+        compressed = false;
+        zip64_compressed_data_size = 0;
     }
 
     void Parser::SetMatchingFilename(char const *filename, const size_t length, const size_t target_total_length)
@@ -59,10 +63,34 @@ namespace zipparser
         }
     }
 
+    void Parser::SetMatchAnyFilename()
+    {
+        match_any = true;
+    }
+
+    // Picks the compressed size from ZIP64 extended information record.
+    // In local file header it contains uncompressed size followed by compressed size.
+    void Parser::ParseExtraField(uint8_t byte)
+    {
+        if (extra_position < 2)
+            extra_id |= byte << (8 * extra_position);
+        else if (extra_position < 4)
+            extra_size |= byte << (8 * (extra_position - 2));
+        else if (extra_id == 0x0001 && extra_position >= 12 && extra_position < 20)
+            zip64_compressed_data_size |= (uint64_t)byte << (8 * (extra_position - 12));
+
+        if (++extra_position >= 4 && extra_position == 4 + (size_t)extra_size)
+        {
+            extra_id = 0;
+            extra_size = 0;
+            extra_position = 0;
+        }
+    }
+
 
     int32_t Parser::Parse(uint8_t const *buf, const size_t size)
     {
-        if (filename_len == 0)
+        if (filename_len == 0 && !match_any)
             return PARSE_ERROR;
 
         static bool matching = true;
@@ -120,21 +148,20 @@ namespace zipparser
                 case parsing_target::method:
                     if (++position == 1)
                     {
-                        // Currently only uncompresseed files in the zip package are supported
-                        if (!buf[idx] == ZIP_PARSER_METHOD_UNCOMPRESSED_BYTE)
-                        {
-                            return PARSE_UNSUPPORTED_COMPRESSION;
-                        }
+                        compressed = (buf[idx] != ZIP_PARSER_METHOD_UNCOMPRESSED_BYTE);
                     }
                     if (position == 2)
                     {
-                        if (buf[idx] == 0)
-                        {
-                            position = 0;
-                            target = parsing_target::modify_time;
-                        }
-                        else
+                        if (buf[idx] != 0)
+                            compressed = true;
+
+                        // Currently only uncompresseed files in the zip package are supported.
+                        // When matching any file, compressed files are parsed so they can be skipped.
+                        if (compressed && !match_any)
                             return PARSE_UNSUPPORTED_COMPRESSION;
+
+                        position = 0;
+                        target = parsing_target::modify_time;
                     }
                 break;
                 case parsing_target::modify_time:
@@ -196,18 +223,30 @@ namespace zipparser
                         position = 0;
                         filename_match = false;
                         matching = true;
+                        extra_id = 0;
+                        extra_size = 0;
+                        extra_position = 0;
                     }
                 break;
                 case parsing_target::filename:
                     if (position <= current_zip_filename_len - 1)
                     {
-                        // make sure zipped filename is the correct length
-                        if (current_zip_filename_len != target_zip_filename_len)
-                            matching = false; 
-                        if (matching && position < filename_len && tolower(filename[position]) != tolower(buf[idx]))
-                            matching = false;
-                        if (position == filename_len - 1 && matching)
-                            filename_match = true;
+                        if (match_any)
+                        {
+                            // directory entries end with a slash
+                            if (position == current_zip_filename_len - 1)
+                                filename_match = (buf[idx] != '/');
+                        }
+                        else
+                        {
+                            // make sure zipped filename is the correct length
+                            if (current_zip_filename_len != target_zip_filename_len)
+                                matching = false; 
+                            if (matching && position < filename_len && tolower(filename[position]) != tolower(buf[idx]))
+                                matching = false;
+                            if (position == filename_len - 1 && matching)
+                                filename_match = true;
+                        }
                         if (position == current_zip_filename_len -1)
                         {
                             target = parsing_target::extra_field;
@@ -223,6 +262,7 @@ namespace zipparser
                     }
                 break;
                 case parsing_target::extra_field:
+                    ParseExtraField(buf[idx]);
                     // extra_field_len should be at least 1 by this time
                     if (++position == extra_field_len)
                     {
@@ -239,7 +279,7 @@ namespace zipparser
     }
     bool Parser::FoundMatch()
     {
-        return filename_match;
+        return filename_match && !compressed;
     }
 }
 
@@ -35,6 +35,8 @@ namespace zipparser
             Parser();
             Parser(char const *filename, const size_t length, const size_t target_total_length);
             void SetMatchingFilename(char const *filename, const size_t length, const size_t target_total_length);
+            // Match any file entry, only directory entries are not matched
+            void SetMatchAnyFilename();
             void Reset();
             static const int32_t PARSE_ERROR = -1;
             static const int32_t PARSE_CENTRAL_DIR = -2;
@@ -45,7 +47,11 @@ namespace zipparser
             // \returns the number of bytes processed or -1 if an error ocurred
             int32_t Parse(uint8_t const *buf, const size_t size);
             bool FoundMatch();
+            // Was the last parsed file stored with compression
+            inline bool IsCompressed() {return compressed;}
             inline uint32_t GetCompressedSize() {return compressed_data_size;}
+            // Size including ZIP64 extension for files larger than 4 GB
+            inline uint64_t GetCompressedSize64() {return compressed_data_size == 0xFFFFFFFF ? zip64_compressed_data_size : compressed_data_size;}
 
         protected:
             bool filename_match;
@@ -59,6 +65,14 @@ namespace zipparser
             parsing_target target;
             size_t position;
             uint32_t crc;
+            bool match_any;
+            bool compressed;
+            uint16_t extra_id;
+            uint16_t extra_size;
+            size_t extra_position;
+            uint64_t zip64_compressed_data_size;
+
+            void ParseExtraField(uint8_t byte);
 
     };
 }
\ No newline at end of file
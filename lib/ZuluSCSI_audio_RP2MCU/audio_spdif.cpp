@@ -35,27 +35,6 @@
 #endif
 extern SdFs SD;
 
-// Table with the number of '1' bits for each index.
-// Used for S/PDIF parity calculations.
-// Placed in SRAM5 for the second core to use with reduced contention.
-const uint8_t snd_parity[256] __attribute__((aligned(256), section(".scratch_y.snd_parity"))) = {
-    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 
-    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 
-    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 
-    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 
-    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 
-    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 
-    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 
-    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 
-    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 
-    4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8, };
-
 /*
  * Precomputed biphase-mark patterns for data. For an 8-bit value this has
  * 16-bits in MSB-first order for the correct high/low transitions to
@@ -107,6 +86,18 @@ const uint16_t biphase[256] __attribute__((aligned(512), section(".scratch_y.bip
  * errors used to detect (sub)frame start conditions. See above table
  * for details.
  */
+/*
+ * Last biphase pattern of a sub-frame: 4 audio bits, V, U and C bits as '0'
+ * and the P bit that gives the sub-frame even parity. Index is the 4 audio
+ * bits, plus 16 if the previous pattern ended in '1'. Inversion and parity
+ * are already applied, so each value ends in '0'.
+ */
+const uint16_t biphase_tail[32] __attribute__((aligned(64), section(".scratch_y.biphase_tail"))) = {
+    0xCCCC, 0xB332, 0xD332, 0xACCC, 0xCB32, 0xB4CC, 0xD4CC, 0xAB32,
+    0xCD32, 0xB2CC, 0xD2CC, 0xAD32, 0xCACC, 0xB532, 0xD532, 0xAACC,
+    0x3332, 0x4CCC, 0x2CCC, 0x5332, 0x34CC, 0x4B32, 0x2B32, 0x54CC,
+    0x32CC, 0x4D32, 0x2D32, 0x52CC, 0x3532, 0x4ACC, 0x2ACC, 0x5532 };
+
 const uint16_t x_preamble = 0xE2CC;
 const uint16_t y_preamble = 0xE4CC;
 const uint16_t z_preamble = 0xE8CC;
@@ -189,15 +180,34 @@ static volatile uint16_t channels[MAX_AUDIO_TARGETS] = {
 // mechanism for cleanly stopping DMA units
 static volatile bool audio_stopping = false;
 
-// trackers for the below function call
+// tracker for the below function call
 static uint16_t sfcnt = 0; // sub-frame count; 2 per frame, 192 frames/block
-static uint8_t invert = 0; // biphase encode help: set if last wire bit was '1'
+
+/*
+ * Encodes one sub-frame as four biphase wire patterns, written as two 32-bit
+ * words. The value is the scaled sample, of which 20 bits are used.
+ *
+ * Each sub-frame has even parity and every preamble ends in a '0', so the
+ * line state is the same at the start of every sub-frame and the preambles
+ * never need inversion. Inside the sub-frame, the last bit of a biphase
+ * pattern tells whether the following pattern has to be inverted.
+ */
+static inline void snd_encode_subframe(uint32_t* wire, uint32_t preamble, int32_t value) {
+    uint32_t sample = ((uint32_t)value) & 0xFFFFF0;
+    uint32_t w1 = biphase[(sample >> 4) & 0xFF];
+    uint32_t inv = (w1 & 1) ? 0xFFFF : 0;
+    uint32_t w2 = biphase[(sample >> 12) & 0xFF] ^ inv;
+    uint32_t w3 = biphase_tail[((w2 & 1) << 4) | (sample >> 20)];
+    wire[0] = preamble | (w1 << 16);
+    wire[1] = w2 | (w3 << 16);
+}
 
 /*
  * Translates 16-bit stereo sound samples to biphase wire patterns for the
  * SPI peripheral. Produces 8 patterns (128 bits, or 1 S/PDIF frame) per pair
  * of input samples. Provided length is the total number of sample bytes present,
- * _twice_ the number of samples (little-endian order assumed)
+ * _twice_ the number of samples (little-endian order assumed). Length must be
+ * a multiple of 4 and samples must be 4-byte aligned.
  * 
  * This function operates with side-effects and is not safe to call from both
  * cores. It must also be called in the same order data is intended to be
@@ -217,69 +227,28 @@ static void snd_encode(uint8_t* samples, uint16_t* wire_patterns, uint16_t len,
     if (!(chn >> 8)) rvol = 0;
     if (!(chn & 0xFF)) lvol = 0;
 
-    uint16_t widx = 0;
-    for (uint16_t i = 0; i < len; i += 2) {
-        uint32_t sample = 0;
-        uint8_t parity = 0;
-        if (samples != NULL) {
-            int32_t rsamp;
+    uint32_t* wire = (uint32_t*)wire_patterns;
+    const uint32_t* pairs = (const uint32_t*)samples;
+    for (uint16_t i = 0; i < len; i += 4) {
+        int32_t lsamp = 0;
+        int32_t rsamp = 0;
+        if (pairs != NULL) {
+            uint32_t pair = *pairs++;
             if (swap) {
-                rsamp = (int16_t)(samples[i + 1] + (samples[i] << 8));
-            } else {
-                rsamp = (int16_t)(samples[i] + (samples[i + 1] << 8));
+                pair = ((pair & 0x00FF00FF) << 8) | ((pair >> 8) & 0x00FF00FF);
             }
             // linear scale to requested audio value
-            if (i & 2) {
-                rsamp *= rvol;
-            } else {
-                rsamp *= lvol;
-            }
-            // use 20 bits of value only, which allows ignoring the lowest 8
-            // bits during biphase conversion (after including sample shift)
-            sample = ((uint32_t)rsamp) & 0xFFFFF0;
-
-            // determine parity, simplified to one lookup via XOR
-            parity = ((sample >> 16) ^ (sample >> 8)) ^ sample;
-            parity = snd_parity[parity];
-
-            // shift sample into the correct bit positions of the sub-frame.
-            sample = sample << 4;
+            lsamp = (int16_t)(pair & 0xFFFF) * lvol;
+            rsamp = (int16_t)(pair >> 16) * rvol;
         }
 
-        // if needed, establish even parity with P bit
-        if (parity % 2) sample |= 0x80000000;
-
-        // translate sample into biphase encoding
-        // first is low 8 bits: preamble and 4 least-significant bits of 
-        // 24-bit audio, pre-encoded as all '0' due to 16-bit samples
-        uint16_t wp;
-        if (sfcnt == 0) {
-            wp = z_preamble; // left channel, block start
-        } else if (sfcnt % 2) {
-            wp = y_preamble; // right channel
-        } else {
-            wp = x_preamble; // left channel, not block start
-        }
-        if (invert) wp = ~wp;
-        invert = wp & 1;
-        wire_patterns[widx++] = wp;
-        // next 8 bits
-        wp = biphase[(uint8_t) (sample >> 8)];
-        if (invert) wp = ~wp;
-        invert = wp & 1;
-        wire_patterns[widx++] = wp;
-        // next 8 again, all audio data
-        wp = biphase[(uint8_t) (sample >> 16)];
-        if (invert) wp = ~wp;
-        invert = wp & 1;
-        wire_patterns[widx++] = wp;
-        // final 8, low 4 audio data and high 4 control bits
-        wp = biphase[(uint8_t) (sample >> 24)];
-        if (invert) wp = ~wp;
-        invert = wp & 1;
-        wire_patterns[widx++] = wp;
+        // left channel uses Z preamble at block start, X otherwise
+        snd_encode_subframe(wire, (sfcnt == 0) ? z_preamble : x_preamble, lsamp);
+        snd_encode_subframe(wire + 2, y_preamble, rsamp);
+        wire += 4;
+
         // increment subframe counter for next pass
-        sfcnt++;
+        sfcnt += 2;
         if (sfcnt == 384) sfcnt = 0; // if true, block complete
     }
 }
@@ -595,7 +564,6 @@ bool audio_play(uint8_t owner, image_config_t* img, uint64_t start, uint64_t end
         wire_buf_b[i] = 0;
     }
     sfcnt = 0;
-    invert = 0;
     audio_start_dma();
     return true;
 }
@@ -766,7 +734,6 @@ bool audio_play_wav(const char *filename)
         wire_buf_b[i] = 0;
     }
     sfcnt = 0;
-    invert = 0;
 
     audio_start_dma();
     return true;
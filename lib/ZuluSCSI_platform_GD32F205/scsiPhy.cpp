@@ -529,10 +529,9 @@ extern "C" uint8_t scsiReadByte(void)
     return r;
 }
 
-extern "C" void scsiRead(uint8_t* data, uint32_t count, int* parityError)
+// Blocking receive using PIO, GreenPAK or synchronous mode
+static void scsiReadBlocking(uint8_t* data, uint32_t count, int* parityError)
 {
-    *parityError = 0;
-
     uint32_t count_words = count / 4;
     bool use_greenpak = (g_scsi_phy_mode == PHY_MODE_GREENPAK_DMA || g_scsi_phy_mode == PHY_MODE_GREENPAK_PIO);
 
@@ -563,10 +562,66 @@ extern "C" void scsiRead(uint8_t* data, uint32_t count, int* parityError)
             data[i] = scsiReadOneByte();
         }
     }
+}
 
+extern "C" void scsiRead(uint8_t* data, uint32_t count, int* parityError)
+{
+    *parityError = 0;
+    scsiStartRead(data, count, parityError);
+    scsiFinishRead(NULL, 0, parityError);
     scsiLogDataOut(data, count);
 }
 
+// Timer DMA is used for asynchronous data out phase.
+// Command and message bytes are short, so PIO is fine for them.
+static bool useDMARead()
+{
+    return g_scsi_phy_mode == PHY_MODE_DMA_TIMER
+        && g_scsi_phase == DATA_OUT
+        && scsiDev.target->syncOffset == 0;
+}
+
+extern "C" void scsiStartRead(uint8_t* data, uint32_t count, int *parityError)
+{
+    if (useDMARead())
+    {
+        scsi_accel_dma_startRead(data, count, &scsiDev.resetFlag);
+    }
+    else
+    {
+        if (g_scsi_phy_mode == PHY_MODE_DMA_TIMER)
+        {
+            // Complete any background transfer before switching to PIO
+            scsi_accel_dma_finishRead(NULL, 0, &scsiDev.resetFlag);
+        }
+
+        scsiReadBlocking(data, count, parityError);
+    }
+}
+
+extern "C" void scsiFinishRead(uint8_t* data, uint32_t count, int *parityError)
+{
+    if (g_scsi_phy_mode == PHY_MODE_DMA_TIMER)
+    {
+        scsi_accel_dma_finishRead(data, count, &scsiDev.resetFlag);
+    }
+
+    if (data != NULL)
+        scsiLogDataOut(data, count);
+}
+
+extern "C" bool scsiIsReadFinished(const uint8_t *data)
+{
+    if (g_scsi_phy_mode == PHY_MODE_DMA_TIMER)
+    {
+        return scsi_accel_dma_isReadFinished(data);
+    }
+    else
+    {
+        return true;
+    }
+}
+
 /**********************/
 /* Interrupt handlers */
 /**********************/
@@ -82,22 +82,23 @@ void scsiFinishWrite();
 // If data is NULL, checks if all writes have completed.
 bool scsiIsWriteFinished(const uint8_t *data);
 
-// For platforms that do not have non-blocking read from SCSI bus
-inline void scsiStartRead(uint8_t* data, uint32_t count, int *parityError)
-{
-    scsiRead(data, count, parityError);
-}
-
-inline void scsiFinishRead(uint8_t* data, uint32_t count, int *parityError)
-{
-
-}
-
-// Always returns true as reads are blocking
-inline bool scsiIsReadFinished(const uint8_t *data)
-{
-    return true;
-}
+// Non-blocking read from SCSI bus.
+// In timer DMA PHY mode the transfer runs in the background, in other modes
+// scsiStartRead() blocks until the data has been received.
+// After final read, call scsiFinishRead() with data = NULL.
+void scsiStartRead(uint8_t* data, uint32_t count, int *parityError);
+void scsiFinishRead(uint8_t* data, uint32_t count, int *parityError);
+
+// Query whether the data at pointer has already been written, i.e. can be processed.
+// If data is NULL, checks if all reads have completed.
+bool scsiIsReadFinished(const uint8_t *data);
+
+#define PLATFORM_SCSIPHY_HAS_NONBLOCKING_READ 1
+
+// Successive reads are queued behind the running DMA transfer, so small
+// blocks don't cost bus time but let SD writes start sooner.
+// PIO modes block for the whole read, so they need the small blocks too.
+#define PLATFORM_OPTIMAL_SCSI_READ_BLOCK_SIZE 8192
 
 #define s2s_getScsiRateKBs() 0
 
@@ -36,6 +36,9 @@ void scsi_accel_dma_startWrite(const uint8_t* data, uint32_t count, volatile int
 void scsi_accel_dma_stopWrite() {}
 void scsi_accel_dma_finishWrite(volatile int *resetFlag) {}
 bool scsi_accel_dma_isWriteFinished(const uint8_t* data) { return true; }
+void scsi_accel_dma_startRead(uint8_t* data, uint32_t count, volatile int *resetFlag) {}
+void scsi_accel_dma_finishRead(uint8_t* data, uint32_t count, volatile int *resetFlag) {}
+bool scsi_accel_dma_isReadFinished(const uint8_t* data) { return true; }
 
 
 #else
@@ -61,9 +64,14 @@ static struct {
 
     uint8_t *next_app_buf; // Next buffer from application after current one finishes
     uint32_t next_app_bytes; // Bytes in next buffer
+
+    // For reads dma_idx counts the samples copied out of DMA buffer
+    uint32_t rx_requested; // Total bytes requested by application, including next buffer
+    uint32_t rx_scheduled; // Total bytes that timer DMA has been allowed to request
+    volatile bool rx_timeout; // Final ACK did not arrive, data in application buffer is incomplete
 } g_scsi_dma;
 
-enum scsidma_state_t { SCSIDMA_IDLE = 0, SCSIDMA_WRITE };
+enum scsidma_state_t { SCSIDMA_IDLE = 0, SCSIDMA_WRITE, SCSIDMA_READ };
 static volatile scsidma_state_t g_scsi_dma_state;
 static bool g_scsi_dma_use_greenpak;
 
@@ -244,6 +252,8 @@ static void start_dma()
     // Set new buffer address and size
     // CHA / Data channel is in circular mode and always has DMA_BUF_SIZE buffer size.
     // CHB / Update channel limits the number of data.
+    DMA_CHPADDR(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) = (uint32_t)&GPIO_BOP(SCSI_OUT_PORT);
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) |= DMA_CHXCTL_DIR;
     DMA_CHMADDR(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) = (uint32_t)g_scsi_dma.dma_buf;
     DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) = DMA_BUF_SIZE;
     uint32_t dma_to_schedule = g_scsi_dma.bytes_app - g_scsi_dma.scheduled_dma;
@@ -307,6 +317,164 @@ static void check_dma_next_buffer()
     }
 }
 
+/*************************************/
+/* Receive from host using timer DMA */
+/*************************************/
+
+// For reads, the timer runs the same handshake as for writes.
+// When ACK goes low, CHA copies the GPIO input register to the circular
+// DMA buffer and REQ is set high. CHA has ultra high priority so the sample
+// is taken well before the host can react to REQ and change the data bus.
+// CHB restarts timer to request next byte.
+// CHB transfer count is the number of bytes we allow the host to send. It is
+// kept below one DMA buffer ahead of the samples already copied out, so the
+// host is paused by REQ instead of overrunning the buffer.
+
+// Number of samples DMA has written to buffer so far
+static uint32_t read_dma_captured()
+{
+    uint32_t pos = (DMA_BUF_SIZE - DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA)) & DMA_BUF_MASK;
+    return g_scsi_dma.dma_idx + ((pos - g_scsi_dma.dma_idx) & DMA_BUF_MASK);
+}
+
+// Convert received samples from DMA buffer to application buffer
+static void read_dma_drain()
+{
+    uint32_t captured = read_dma_captured();
+    const uint32_t *src = g_scsi_dma.dma_buf;
+
+    while (g_scsi_dma.dma_idx < captured)
+    {
+        if (g_scsi_dma.bytes_dma == g_scsi_dma.bytes_app)
+        {
+            if (!g_scsi_dma.next_app_buf) break;
+
+            // Switch to next buffer
+            g_scsi_dma.app_buf = g_scsi_dma.next_app_buf;
+            g_scsi_dma.bytes_app = g_scsi_dma.next_app_bytes;
+            g_scsi_dma.bytes_dma = 0;
+            g_scsi_dma.next_app_buf = NULL;
+            g_scsi_dma.next_app_bytes = 0;
+        }
+
+        uint32_t count = captured - g_scsi_dma.dma_idx;
+        uint32_t max = g_scsi_dma.bytes_app - g_scsi_dma.bytes_dma;
+        if (count > max) count = max;
+
+        uint8_t *dst = g_scsi_dma.app_buf + g_scsi_dma.bytes_dma;
+        uint32_t pos = g_scsi_dma.dma_idx;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            dst[i] = (uint8_t)(~src[(pos++) & DMA_BUF_MASK] >> SCSI_IN_SHIFT);
+        }
+
+        g_scsi_dma.dma_idx += count;
+        g_scsi_dma.bytes_dma += count;
+    }
+}
+
+// Allow host to send more bytes, limited by free space in DMA buffer
+static void read_dma_schedule()
+{
+    uint32_t target = g_scsi_dma.rx_requested;
+    uint32_t limit = g_scsi_dma.dma_idx + DMA_BUF_SIZE - 1;
+    if (target > limit) target = limit;
+    if (target <= g_scsi_dma.rx_scheduled) return;
+
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB) &= ~DMA_CHXCTL_CHEN;
+    uint32_t remain = DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB);
+    DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB) = remain + (target - g_scsi_dma.rx_scheduled);
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB) |= DMA_CHXCTL_CHEN;
+    g_scsi_dma.rx_scheduled = target;
+}
+
+static void start_read_dma()
+{
+    // Disable channels while configuring
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) &= ~DMA_CHXCTL_CHEN;
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB) &= ~DMA_CHXCTL_CHEN;
+    TIMER_CTL0(SCSI_TIMER) = 0;
+
+    // CHA copies from GPIO input register to circular buffer
+    DMA_CHPADDR(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) = (uint32_t)&GPIO_ISTAT(SCSI_IN_PORT);
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) &= ~DMA_CHXCTL_DIR;
+    DMA_CHMADDR(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) = (uint32_t)g_scsi_dma.dma_buf;
+    DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) = DMA_BUF_SIZE;
+
+    uint32_t dma_to_schedule = g_scsi_dma.rx_requested;
+    if (dma_to_schedule > DMA_BUF_SIZE - 1) dma_to_schedule = DMA_BUF_SIZE - 1;
+    DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB) = dma_to_schedule;
+    g_scsi_dma.rx_scheduled = dma_to_schedule;
+
+    // Clear pending DMA events
+    TIMER_DMAINTEN(SCSI_TIMER) = 0;
+    TIMER_DMAINTEN(SCSI_TIMER) = TIMER_DMAINTEN_CH1DEN | TIMER_DMAINTEN_CH3DEN;
+
+    // Clear and enable interrupt
+    DMA_INTC(SCSI_TIMER_DMA) = DMA_FLAG_ADD(DMA_FLAG_HTF | DMA_FLAG_FTF | DMA_FLAG_ERR, SCSI_TIMER_DMACHA);
+    DMA_INTC(SCSI_TIMER_DMA) = DMA_FLAG_ADD(DMA_FLAG_HTF | DMA_FLAG_FTF | DMA_FLAG_ERR, SCSI_TIMER_DMACHB);
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) |= DMA_CHXCTL_FTFIE | DMA_CHXCTL_HTFIE;
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB) |= DMA_CHXCTL_FTFIE;
+
+    // Enable channels
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA) |= DMA_CHXCTL_CHEN;
+    DMA_CHCTL(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB) |= DMA_CHXCTL_CHEN;
+
+    // Make sure REQ is initially high
+    TIMER_CNT(SCSI_TIMER) = 16;
+    TIMER_CHCTL1(SCSI_TIMER) = 0x6050;
+    TIMER_CHCTL1(SCSI_TIMER) = 0x6074;
+
+    // Enable timer
+    TIMER_CTL0(SCSI_TIMER) |= TIMER_CTL0_CEN;
+
+    // Generate first update event to assert REQ.
+    // Unlike writes, there is no initial data copy.
+    TIMER_SWEVG(SCSI_TIMER) = TIMER_SWEVG_CH3G;
+}
+
+// Buffer half or full, copy data out to make room for more
+static void read_dma_irq_a()
+{
+    DMA_INTC(SCSI_TIMER_DMA) = DMA_FLAG_ADD(DMA_FLAG_HTF | DMA_FLAG_FTF, SCSI_TIMER_DMACHA);
+    read_dma_drain();
+    read_dma_schedule();
+}
+
+// All scheduled bytes have been requested from host
+static void read_dma_irq_b()
+{
+    __disable_irq();
+    read_dma_drain();
+    read_dma_schedule();
+    bool done = (g_scsi_dma.rx_scheduled == g_scsi_dma.rx_requested &&
+                 DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB) == 0);
+    __enable_irq();
+
+    if (!done) return;
+
+    // Wait for final byte to arrive, shouldn't take long.
+    uint32_t start = millis();
+    while (read_dma_captured() < g_scsi_dma.rx_scheduled)
+    {
+        if ((uint32_t)(millis() - start) > 500)
+        {
+            logmsg("SCSI_TIMER_DMACHB_IRQ: timeout waiting for final ACK on read");
+            g_scsi_dma.rx_timeout = true;
+            break;
+        }
+    }
+
+    __disable_irq();
+    read_dma_drain();
+    __enable_irq();
+
+    // Return REQ to GPIO control, the next phase may start
+    // before application calls scsi_accel_dma_finishRead().
+    stop_dma();
+    scsi_dma_gpio_config(false);
+}
+
 // Convert new data from application buffer to DMA buffer
 extern "C" void SCSI_TIMER_DMACHA_IRQ()
 {
@@ -314,6 +482,12 @@ extern "C" void SCSI_TIMER_DMACHA_IRQ()
     //             DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB), " ",
     //             TIMER_CNT(SCSI_TIMER));
 
+    if (g_scsi_dma_state == SCSIDMA_READ)
+    {
+        read_dma_irq_a();
+        return;
+    }
+
     uint32_t intf = DMA_INTF(SCSI_TIMER_DMA);
     const uint32_t half_flag = DMA_FLAG_ADD(DMA_FLAG_HTF, SCSI_TIMER_DMACHA);
     const uint32_t full_flag = DMA_FLAG_ADD(DMA_FLAG_FTF, SCSI_TIMER_DMACHA);
@@ -356,6 +530,12 @@ extern "C" void SCSI_TIMER_DMACHB_IRQ()
     {
         DMA_INTC(SCSI_TIMER_DMA) = DMA_FLAG_ADD(DMA_FLAG_FTF, SCSI_TIMER_DMACHB);
 
+        if (g_scsi_dma_state == SCSIDMA_READ)
+        {
+            read_dma_irq_b();
+            return;
+        }
+
         if (g_scsi_dma.bytes_app > g_scsi_dma.scheduled_dma)
         {
             if (g_scsi_dma.dma_idx < g_scsi_dma.dma_fillto)
@@ -512,6 +692,144 @@ void scsi_accel_dma_finishWrite(volatile int *resetFlag)
     scsi_accel_dma_stopWrite();
 }
 
+void scsi_accel_dma_startRead(uint8_t* data, uint32_t count, volatile int *resetFlag)
+{
+    __disable_irq();
+    if (g_scsi_dma_state == SCSIDMA_READ)
+    {
+        if (!g_scsi_dma.next_app_buf && data == g_scsi_dma.app_buf + g_scsi_dma.bytes_app)
+        {
+            // Combine with currently running request
+            g_scsi_dma.bytes_app += count;
+        }
+        else if (g_scsi_dma.next_app_buf && data == g_scsi_dma.next_app_buf + g_scsi_dma.next_app_bytes)
+        {
+            // Combine with queued request
+            g_scsi_dma.next_app_bytes += count;
+        }
+        else if (!g_scsi_dma.next_app_buf)
+        {
+            // Add as queued request
+            g_scsi_dma.next_app_buf = data;
+            g_scsi_dma.next_app_bytes = count;
+        }
+        else
+        {
+            // Queue is full
+            __enable_irq();
+            scsi_accel_dma_finishRead(NULL, 0, resetFlag);
+            __disable_irq();
+        }
+
+        if (g_scsi_dma_state == SCSIDMA_READ)
+        {
+            g_scsi_dma.rx_requested += count;
+            read_dma_schedule();
+            count = 0;
+        }
+    }
+    __enable_irq();
+
+    // Check if the request was combined
+    if (count == 0) return;
+
+    if (g_scsi_dma_state != SCSIDMA_IDLE)
+    {
+        // Wait for previous request to finish
+        scsi_accel_dma_finishWrite(resetFlag);
+        if (*resetFlag)
+        {
+            return;
+        }
+    }
+
+    // dbgmsg("Starting DMA read of ", (int)count, " bytes");
+    scsi_dma_gpio_config(true);
+    g_scsi_dma_state = SCSIDMA_READ;
+    g_scsi_dma.app_buf = data;
+    g_scsi_dma.dma_idx = 0;
+    g_scsi_dma.bytes_app = count;
+    g_scsi_dma.bytes_dma = 0;
+    g_scsi_dma.next_app_buf = NULL;
+    g_scsi_dma.next_app_bytes = 0;
+    g_scsi_dma.rx_requested = count;
+    g_scsi_dma.rx_scheduled = 0;
+    g_scsi_dma.rx_timeout = false;
+    start_read_dma();
+}
+
+bool scsi_accel_dma_isReadFinished(const uint8_t* data)
+{
+    // Check if everything has completed
+    if (g_scsi_dma_state != SCSIDMA_READ)
+    {
+        return true;
+    }
+
+    if (!data)
+        return false;
+
+    // Copy out any samples received since last interrupt
+    // and check if this data item is still in queue.
+    __disable_irq();
+    read_dma_drain();
+    read_dma_schedule();
+
+    bool finished = true;
+    if (data >= g_scsi_dma.app_buf + g_scsi_dma.bytes_dma &&
+        data < g_scsi_dma.app_buf + g_scsi_dma.bytes_app)
+    {
+        finished = false; // In current transfer
+    }
+    else if (data >= g_scsi_dma.next_app_buf &&
+             data < g_scsi_dma.next_app_buf + g_scsi_dma.next_app_bytes)
+    {
+        finished = false; // In queued transfer
+    }
+    __enable_irq();
+
+    return finished;
+}
+
+void scsi_accel_dma_finishRead(uint8_t* data, uint32_t count, volatile int *resetFlag)
+{
+    if (g_scsi_dma.rx_timeout)
+    {
+        // Interrupt handler gave up waiting for the last bytes,
+        // abort the command instead of using the partial data.
+        g_scsi_dma.rx_timeout = false;
+        *resetFlag = 1;
+    }
+
+    if (g_scsi_dma_state != SCSIDMA_READ)
+    {
+        return;
+    }
+
+    const uint8_t *last = (data && count > 0) ? data + count - 1 : NULL;
+    if (data && !last) return;
+
+    uint32_t start = millis();
+    while (!scsi_accel_dma_isReadFinished(last) && !*resetFlag)
+    {
+        if ((uint32_t)(millis() - start) > 5000)
+        {
+            logmsg("scsi_accel_dma_finishRead() timeout, DMA counts ",
+                DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHA), " ",
+                DMA_CHCNT(SCSI_TIMER_DMA, SCSI_TIMER_DMACHB), " ",
+                TIMER_CNT(SCSI_TIMER));
+            *resetFlag = 1;
+            break;
+        }
+    }
+
+    if (!data || *resetFlag)
+    {
+        stop_dma();
+        scsi_dma_gpio_config(false);
+    }
+}
+
 /************************************************/
 /* Functions using external GreenPAK logic chip */
 /************************************************/
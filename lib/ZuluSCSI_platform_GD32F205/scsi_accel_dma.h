@@ -45,4 +45,14 @@ void scsi_accel_dma_finishWrite(volatile int *resetFlag);
 // If data is NULL, checks if all writes have completed.
 bool scsi_accel_dma_isWriteFinished(const uint8_t* data);
 
+// Receive data from SCSI bus using timer DMA.
+// Consecutive calls are combined with the running transfer.
+// Not available in GreenPAK mode.
+void scsi_accel_dma_startRead(uint8_t* data, uint32_t count, volatile int *resetFlag);
 
+// Wait for data to be received. If data is NULL, waits for all reads to complete.
+void scsi_accel_dma_finishRead(uint8_t* data, uint32_t count, volatile int *resetFlag);
+
+// Query whether the data at pointer has already been received.
+// If data is NULL, checks if all reads have completed.
+bool scsi_accel_dma_isReadFinished(const uint8_t* data);
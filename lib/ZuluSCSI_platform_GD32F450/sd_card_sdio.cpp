@@ -232,7 +232,7 @@ bool SdioCard::writeStop()
 
 bool SdioCard::erase(uint32_t firstSector, uint32_t lastSector)
 {
-    return checkReturnOk(sd_erase(firstSector * 512, lastSector * 512));
+    return checkReturnOk(sd_erase((uint64_t)firstSector * 512, (uint64_t)lastSector * 512));
 }
 
 bool SdioCard::cardCMD6(uint32_t arg, uint8_t* status) {
@@ -36,6 +36,7 @@
 #include <hardware/adc.h>
 #include <hardware/pwm.h>
 #include <hardware/flash.h>
+#include <hardware/dma.h>
 #include <hardware/structs/xip_ctrl.h>
 #include <hardware/structs/usb.h>
 #include <hardware/sync.h>
@@ -346,6 +347,18 @@ static void core1_handler() {
     }
 }
 
+void platform_core1_dispatch(void (*func)())
+{
+    multicore_fifo_push_blocking((uintptr_t) func);
+}
+
+bool platform_core1_try_dispatch(void (*func)())
+{
+    if (!multicore_fifo_wready()) return false;
+    multicore_fifo_push_blocking((uintptr_t) func);
+    return true;
+}
+
 #ifdef ZULUSCSI_MCU_RP23XX
 static void __no_inline_not_in_flash_func(set_flash_clock)()
 {
@@ -1601,6 +1614,29 @@ uint32_t platform_get_romdrive_maxsize()
     }
 }
 
+// Callback used by SCSI code for simultaneous processing,
+// same as platform_set_sd_callback() for SD card reads.
+static sd_callback_t g_romdrive_stream_callback;
+static const uint8_t *g_romdrive_stream_buffer;
+static uint32_t g_romdrive_stream_count;
+static int g_romdrive_dma_ch = -1;
+
+void platform_set_romdrive_callback(sd_callback_t func, const uint8_t *buffer)
+{
+    g_romdrive_stream_callback = func;
+    g_romdrive_stream_buffer = buffer;
+    g_romdrive_stream_count = 0;
+}
+
+void platform_romdrive_stream_filled(const uint8_t *dest, uint32_t count)
+{
+    if (g_romdrive_stream_callback && dest == g_romdrive_stream_buffer + g_romdrive_stream_count)
+    {
+        g_romdrive_stream_count += count;
+        g_romdrive_stream_callback(g_romdrive_stream_count);
+    }
+}
+
 bool platform_read_romdrive(uint8_t *dest, uint32_t start, uint32_t count)
 {
     xip_ctrl_hw->stream_ctr = 0;
@@ -1618,39 +1654,132 @@ bool platform_read_romdrive(uint8_t *dest, uint32_t start, uint32_t count)
     assert((count & 3) == 0);
     assert((((uint32_t)dest) & 3) == 0);
 
-    uint32_t *dest32 = (uint32_t*)dest;
-    uint32_t words_remain = count / 4;
-    while (words_remain > 0)
+    // Report progress to SCSI code if this read continues the stream.
+    // Other reads, such as compressed data, only let SCSI code keep
+    // sending what is already in the stream buffer.
+    sd_callback_t callback = g_romdrive_stream_callback;
+    uint32_t stream_start = g_romdrive_stream_count;
+    uint32_t stream_count = 0;
+    if (callback && dest == g_romdrive_stream_buffer + g_romdrive_stream_count)
     {
-        if (!(xip_ctrl_hw->stat & XIP_STAT_FIFO_EMPTY))
+        stream_count = count;
+        g_romdrive_stream_count += count;
+    }
+
+    if (g_romdrive_dma_ch == -1)
+    {
+        // Channel is claimed on first use, fall back to CPU copy if none is free
+        g_romdrive_dma_ch = dma_claim_unused_channel(false);
+        if (g_romdrive_dma_ch < 0)
+        {
+            logmsg("No free DMA channel for ROM drive, using CPU copy");
+            g_romdrive_dma_ch = -2;
+        }
+    }
+
+    if (g_romdrive_dma_ch >= 0)
+    {
+        // Stream from XIP FIFO to RAM in background, while the already
+        // fetched part is handed over to SCSI DMA through the callback.
+        dma_channel_config cfg = dma_channel_get_default_config(g_romdrive_dma_ch);
+        channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+        channel_config_set_read_increment(&cfg, false);
+        channel_config_set_write_increment(&cfg, true);
+        channel_config_set_dreq(&cfg, DREQ_XIP_STREAM);
+        dma_channel_configure(g_romdrive_dma_ch, &cfg, dest, (const void*)XIP_AUX_BASE, count / 4, true);
+
+        while (dma_channel_is_busy(g_romdrive_dma_ch))
+        {
+            if (callback)
+            {
+                uint32_t bytes_done = dma_hw->ch[g_romdrive_dma_ch].write_addr - (uint32_t)dest;
+                callback(stream_start + (stream_count ? bytes_done : 0));
+            }
+        }
+    }
+    else
+    {
+        uint32_t *dest32 = (uint32_t*)dest;
+        uint32_t words_remain = count / 4;
+        while (words_remain > 0)
         {
-            *dest32++ = xip_ctrl_hw->stream_fifo;
-            words_remain--;
+            if (!(xip_ctrl_hw->stat & XIP_STAT_FIFO_EMPTY))
+            {
+                *dest32++ = xip_ctrl_hw->stream_fifo;
+                words_remain--;
+
+                if (callback && (words_remain & 127) == 0)
+                {
+                    callback(stream_start + (stream_count ? count - words_remain * 4 : 0));
+                }
+            }
         }
     }
 
     return true;
 }
 
+#ifdef ZULUSCSI_MCU_RP23XX
+#define ROMDRIVE_XIP_NOCACHE_BASE XIP_NOCACHE_NOALLOC_BASE
+#else
+#define ROMDRIVE_XIP_NOCACHE_BASE XIP_NOCACHE_BASE
+#endif
+
 bool platform_write_romdrive(const uint8_t *data, uint32_t start, uint32_t count)
 {
     assert(start < platform_get_romdrive_maxsize());
     assert((count % PLATFORM_ROMDRIVE_PAGE_SIZE) == 0);
 
-    // XIP is disabled during flashing so interrupts and
-    // core1 handlers must be blocked.
-    mutex_enter_blocking(&g_core1_mutex);
-    uint32_t saved_irq = save_and_disable_interrupts();
+    // Handle one erase sector at a time, so that unchanged sectors
+    // can be skipped and interrupts are only blocked for sectors
+    // that actually get written.
+    for (uint32_t pos = 0; pos < count; pos += PLATFORM_ROMDRIVE_PAGE_SIZE)
+    {
+        uint32_t flash_offset = start + pos + ROMDRIVE_OFFSET;
+        const uint8_t *sector = data + pos;
+        const volatile uint32_t *flash32 = (const volatile uint32_t*)(ROMDRIVE_XIP_NOCACHE_BASE + flash_offset);
+        const uint32_t *data32 = (const uint32_t*)sector;
+
+        // Erase is only needed if some bit must change from 0 to 1
+        bool changed = false;
+        bool need_erase = false;
+        for (uint32_t i = 0; i < PLATFORM_ROMDRIVE_PAGE_SIZE / 4; i++)
+        {
+            uint32_t old = flash32[i];
+            if (old != data32[i]) changed = true;
+            if ((old & data32[i]) != data32[i]) { need_erase = true; break; }
+        }
 
-    flash_range_erase(start + ROMDRIVE_OFFSET, count);
-    flash_range_program(start + ROMDRIVE_OFFSET, data, count);
+        if (!changed) continue;
+
+        // XIP is disabled during flashing so interrupts and
+        // core1 handlers must be blocked.
+        mutex_enter_blocking(&g_core1_mutex);
+        uint32_t saved_irq = save_and_disable_interrupts();
+
+        if (need_erase)
+        {
+            flash_range_erase(flash_offset, PLATFORM_ROMDRIVE_PAGE_SIZE);
+        }
+        flash_range_program(flash_offset, sector, PLATFORM_ROMDRIVE_PAGE_SIZE);
 
 #ifdef ZULUSCSI_MCU_RP23XX
-    set_flash_clock();
+        set_flash_clock();
 #endif
 
-    restore_interrupts(saved_irq);
-    mutex_exit(&g_core1_mutex);
+        restore_interrupts(saved_irq);
+        mutex_exit(&g_core1_mutex);
+
+        for (uint32_t i = 0; i < PLATFORM_ROMDRIVE_PAGE_SIZE / 4; i++)
+        {
+            if (flash32[i] != data32[i])
+            {
+                logmsg("ROM drive flash verify failed at offset ", (int)(start + pos + i * 4));
+                return false;
+            }
+        }
+    }
+
     return true;
 }
 
@@ -2138,6 +2267,25 @@ bool platform_stop_msc()
 #endif // PLATFORM_MASS_STORAGE
 
 
+void *platform_ramdisk_alloc(uint32_t size)
+{
+#ifdef RP2350_PSRAM_CS
+    void *ptr = pmalloc(size);
+    if (ptr)
+    {
+        return ptr;
+    }
+    logmsg("PSRAM allocation of ", (int)size, " bytes failed, trying internal RAM");
+#endif
+    return malloc(size);
+}
+
+void platform_ramdisk_free(void *ptr)
+{
+    // The core's free() handles both PSRAM and SRAM heap pointers
+    free(ptr);
+}
+
 #ifdef SD_USE_SDIO
 // These functions are not used for SDIO mode but are needed to avoid build error.
 void sdCsInit(SdCsPin_t pin) {}
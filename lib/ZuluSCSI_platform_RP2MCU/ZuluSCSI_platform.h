@@ -173,11 +173,32 @@ void platform_sniffer_poll();
 // Returns true if reboot was for mass storage
 mass_storage_mode platform_rebooted_into_mass_storage();
 
+// Run a function on the second core.
+// The call returns immediately, function is executed with g_core1_mutex held.
+#define PLATFORM_HAS_CORE1_DISPATCH 1
+void platform_core1_dispatch(void (*func)());
+
+// Same as above, but returns false instead of waiting if the queue is full.
+bool platform_core1_try_dispatch(void (*func)());
+
 // Set callback that will be called during data transfer to/from SD card.
 // This can be used to implement simultaneous transfer to SCSI bus.
 typedef void (*sd_callback_t)(uint32_t bytes_complete);
 void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer);
 
+#if defined(SD_USE_SDIO) && !defined(SD_USE_RP2350_SDIO)
+// Total time spent waiting for SD card to finish programming written data,
+// in microseconds. The counter wraps around, use differences only.
+#define PLATFORM_HAS_SD_WRITE_STALL_COUNTER 1
+uint32_t platform_sd_write_stall_us();
+#endif
+
+// Allocate and release memory for RAM disk images.
+// Uses external PSRAM when the board has it, otherwise internal SRAM.
+#define PLATFORM_HAS_RAMDISK_ALLOC 1
+void *platform_ramdisk_alloc(uint32_t size);
+void platform_ramdisk_free(void *ptr);
+
 // Check if there is a serial interface connected
 bool platform_serial_connected();
 
@@ -202,6 +223,15 @@ uint32_t platform_get_romdrive_maxsize();
 // Read ROM drive area
 bool platform_read_romdrive(uint8_t *dest, uint32_t start, uint32_t count);
 
+// Set callback that will be called during ROM drive reads,
+// works like platform_set_sd_callback().
+#define PLATFORM_HAS_ROMDRIVE_CALLBACK 1
+void platform_set_romdrive_callback(sd_callback_t func, const uint8_t *buffer);
+
+// Report data placed in the stream buffer by other means than
+// platform_read_romdrive(), such as decompression.
+void platform_romdrive_stream_filled(const uint8_t *dest, uint32_t count);
+
 // Reprogram ROM drive area
 #define PLATFORM_ROMDRIVE_PAGE_SIZE 4096
 bool platform_write_romdrive(const uint8_t *data, uint32_t start, uint32_t count);
@@ -90,6 +90,16 @@
 #define PLATFORM_OPTIMAL_MIN_SD_WRITE_SIZE 32768
 #define PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE 65536
 #define PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE 8192
+
+// PRE-FETCH cache only on RP2350, RP2040 does not have the RAM to spare
+#if defined(ZULUSCSI_MCU_RP23XX) && !defined(HOST_CACHE_SIZE)
+#define HOST_CACHE_SIZE 16384
+#endif
+
+// .TAP write staging also only on RP2350
+#if defined(ZULUSCSI_MCU_RP23XX) && !defined(TAPE_WRITE_BUFFER_SIZE)
+#define TAPE_WRITE_BUFFER_SIZE 8192
+#endif
 #define SD_USE_SDIO 1
 #define PLATFORM_HAS_PARITY_CHECK 1
 
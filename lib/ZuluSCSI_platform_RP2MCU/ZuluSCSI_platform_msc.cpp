@@ -37,6 +37,7 @@
 #include <class/msc/msc_device.h>
 #include <USB.h>
 #include <pico/mutex.h>
+#include <scsi.h>
 
 #if CFG_TUD_MSC_EP_BUFSIZE < SD_SECTOR_SIZE
   #error "CFG_TUD_MSC_EP_BUFSIZE is too small! It needs to be at least 512 (SD_SECTOR_SIZE)"
@@ -69,6 +70,168 @@ static struct {
 
 } g_MSC;
 
+/* Image mode read-ahead.
+ * SCSI buffer is not used while in card reader mode, so it is split into two
+ * read-ahead slots. When sequential reads are detected, the next chunk is read
+ * from SD card in platform_poll_msc() while USB is transferring the current one.
+ * Writes go directly to the image, so that a failed write is reported in the
+ * status of the WRITE10 command that carried the data.
+ */
+#define MSC_CACHE_SLOTS 2
+#define MSC_CACHE_SLOT_SIZE (sizeof(scsiDev.data) / MSC_CACHE_SLOTS)
+
+static struct {
+  // Read-ahead slots
+  bool slot_valid[MSC_CACHE_SLOTS];
+  uint8_t slot_lun[MSC_CACHE_SLOTS];
+  uint64_t slot_start[MSC_CACHE_SLOTS];
+  uint32_t slot_len[MSC_CACHE_SLOTS];
+
+  // Sequential access detection
+  uint8_t seq_lun;
+  uint64_t seq_next;
+
+  // Read-ahead requested from main loop
+  volatile bool prefetch_pending;
+  uint8_t prefetch_lun;
+  uint8_t prefetch_slot;
+  uint64_t prefetch_pos;
+} g_msc_cache;
+
+static void msc_cache_invalidate()
+{
+  g_msc_cache.prefetch_pending = false;
+  for (int i = 0; i < MSC_CACHE_SLOTS; i++)
+  {
+    g_msc_cache.slot_valid[i] = false;
+  }
+}
+
+// Read a chunk of image into read-ahead slot
+static bool msc_cache_fill(uint8_t slot, uint8_t lun, uint64_t pos)
+{
+  uint8_t *buf = scsiDev.data + slot * MSC_CACHE_SLOT_SIZE;
+  ImageBackingStore &file = g_MSC.lun_config[lun]->file;
+  g_msc_cache.slot_valid[slot] = false;
+
+  if (!file.seek(pos))
+    return false;
+
+  ssize_t len = file.read(buf, MSC_CACHE_SLOT_SIZE);
+  if (len <= 0)
+    return false;
+
+  g_msc_cache.slot_lun[slot] = lun;
+  g_msc_cache.slot_start[slot] = pos;
+  g_msc_cache.slot_len[slot] = len;
+  g_msc_cache.slot_valid[slot] = true;
+  return true;
+}
+
+static int msc_cache_find(uint8_t lun, uint64_t pos)
+{
+  for (int i = 0; i < MSC_CACHE_SLOTS; i++)
+  {
+    if (g_msc_cache.slot_valid[i] && g_msc_cache.slot_lun[i] == lun &&
+        pos >= g_msc_cache.slot_start[i] && pos < g_msc_cache.slot_start[i] + g_msc_cache.slot_len[i])
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Select slot to replace on cache miss
+static int msc_cache_oldest()
+{
+  int oldest = 0;
+  for (int i = 0; i < MSC_CACHE_SLOTS; i++)
+  {
+    if (!g_msc_cache.slot_valid[i])
+      return i;
+
+    if (g_msc_cache.slot_start[i] < g_msc_cache.slot_start[oldest])
+      oldest = i;
+  }
+  return oldest;
+}
+
+// Request next chunk to be read in background after slot has been used
+static void msc_cache_request_prefetch(int slot)
+{
+  if (g_msc_cache.slot_len[slot] != MSC_CACHE_SLOT_SIZE)
+    return; // End of image
+
+  uint8_t lun = g_msc_cache.slot_lun[slot];
+  uint64_t next = g_msc_cache.slot_start[slot] + g_msc_cache.slot_len[slot];
+  if (msc_cache_find(lun, next) >= 0)
+    return; // Already loaded
+
+  g_msc_cache.prefetch_lun = lun;
+  g_msc_cache.prefetch_pos = next;
+  g_msc_cache.prefetch_slot = (slot + 1) % MSC_CACHE_SLOTS;
+  g_msc_cache.prefetch_pending = true;
+}
+
+// Serve image read from read-ahead slots.
+// Returns false if the access is not sequential and should be done directly.
+static bool msc_cache_read(uint8_t lun, uint64_t pos, uint8_t *buffer, uint32_t len)
+{
+  bool sequential = (lun == g_msc_cache.seq_lun && pos == g_msc_cache.seq_next);
+  g_msc_cache.seq_lun = lun;
+  g_msc_cache.seq_next = pos + len;
+
+  if (len > MSC_CACHE_SLOT_SIZE)
+    return false;
+
+  if (msc_cache_find(lun, pos) < 0 && !sequential)
+    return false;
+
+  while (len > 0)
+  {
+    int slot = msc_cache_find(lun, pos);
+    if (slot < 0)
+    {
+      // Background read-ahead did not keep up, read synchronously
+      slot = g_msc_cache.prefetch_pending ? g_msc_cache.prefetch_slot : msc_cache_oldest();
+      g_msc_cache.prefetch_pending = false;
+      if (!msc_cache_fill(slot, lun, pos))
+        return false;
+    }
+
+    uint32_t offset = pos - g_msc_cache.slot_start[slot];
+    uint32_t count = g_msc_cache.slot_len[slot] - offset;
+    if (count > len) count = len;
+    memcpy(buffer, scsiDev.data + slot * MSC_CACHE_SLOT_SIZE + offset, count);
+    buffer += count;
+    pos += count;
+    len -= count;
+
+    if (len > 0 && g_msc_cache.slot_len[slot] != MSC_CACHE_SLOT_SIZE)
+      return false; // Read past end of image
+
+    msc_cache_request_prefetch(slot);
+  }
+
+  return true;
+}
+
+// Write to image and drop read-ahead data that may be stale.
+// Returns false on write error.
+static bool msc_cache_write(uint8_t lun, uint64_t pos, const uint8_t *buffer, uint32_t len)
+{
+  msc_cache_invalidate();
+
+  ImageBackingStore &file = g_MSC.lun_config[lun]->file;
+  if (!file.seek(pos) || file.write(buffer, len) != (ssize_t)len)
+  {
+    logmsg("USB MSC write of ", (int)len, " bytes to LUN ", (int)lun, " failed");
+    return false;
+  }
+
+  return true;
+}
+
 void platform_msc_lock_set(bool block)
 {
   if (block)
@@ -155,6 +318,19 @@ bool platform_run_msc() {
   return g_MSC.unitReady;
 }
 
+/* perform background tasks, called often while in card reader mode */
+void platform_poll_msc() {
+  if (g_msc_cache.prefetch_pending && !g_msc_lock)
+  {
+    MSCScopedLock lock;
+    if (g_msc_cache.prefetch_pending)
+    {
+      g_msc_cache.prefetch_pending = false;
+      msc_cache_fill(g_msc_cache.prefetch_slot, g_msc_cache.prefetch_lun, g_msc_cache.prefetch_pos);
+    }
+  }
+}
+
 /* load the setting if we present images or not */
 void platform_set_msc_image_mode(bool image_mode) {
   g_MSC.SDMode = !image_mode;
@@ -183,6 +359,8 @@ bool msc_image_eligble(uint8_t t) {
 void platform_enter_msc() {
   dbgmsg("USB MSC buffer size: ", CFG_TUD_MSC_EP_BUFSIZE);
   g_MSC.lun_count = 0;
+  msc_cache_invalidate();
+  g_msc_cache.seq_next = UINT64_MAX;
     
   if (!g_MSC.SDMode) {
     logmsg("Presenting configured images as USB storage devices");
@@ -242,6 +420,12 @@ void platform_enter_msc() {
 
 /* perform any cleanup tasks for the MSC-specific functionality */
 void platform_exit_msc() {
+  if (!g_MSC.SDMode)
+  {
+    MSCScopedLock lock;
+    msc_cache_invalidate();
+  }
+
   g_MSC.unitReady = 0;
   if (g_MSC.usbRegistered)
   {
@@ -324,6 +508,11 @@ extern "C" bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool
       // load disk storage
       // do nothing as we started "loaded"
     } else {
+      if (!g_MSC.SDMode)
+      {
+        msc_cache_invalidate();
+      }
+
       g_MSC.lun_unitReady[lun] = false;
 
       if (g_MSC.unitReady) // no more active LUNs -> global not ready flag
@@ -412,8 +601,16 @@ extern "C" int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
     rc = SD.card()->readSectors(lba, (uint8_t*) buffer, bufsize/SD_SECTOR_SIZE);
   } else {
     if (g_MSC.lun_unitReady[lun]) {
-      g_MSC.lun_config[lun]->file.seek(lba * g_MSC.lun_config[lun]->bytesPerSector);
-      rc = g_MSC.lun_config[lun]->file.read(buffer, bufsize);
+      uint64_t pos = (uint64_t)lba * g_MSC.lun_config[lun]->bytesPerSector + offset;
+      if (msc_cache_read(lun, pos, (uint8_t*)buffer, bufsize))
+      {
+        rc = true;
+      }
+      else
+      {
+        g_MSC.lun_config[lun]->file.seek(pos);
+        rc = g_MSC.lun_config[lun]->file.read(buffer, bufsize);
+      }
     } else {
       logmsg("Attempted read to non-ready LUN ",lun);
     }
@@ -440,8 +637,8 @@ extern "C" int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset
     rc = SD.card()->writeSectors(lba, buffer, bufsize/SD_SECTOR_SIZE); 
   } else {
     if (g_MSC.lun_unitReady[lun]) {
-      g_MSC.lun_config[lun]->file.seek(lba * g_MSC.lun_config[lun]->bytesPerSector);
-      rc = g_MSC.lun_config[lun]->file.write(buffer, bufsize);
+      uint64_t pos = (uint64_t)lba * g_MSC.lun_config[lun]->bytesPerSector + offset;
+      rc = msc_cache_write(lun, pos, buffer, bufsize);
     } else {
       logmsg("Attempted write to non-ready LUN ",lun);
     }
@@ -37,6 +37,9 @@ void platform_set_msc_image_mode(bool image_mode);
 /* return true if we should remain in card reader mode. called in a loop. */
 bool platform_run_msc();
 
+/* perform background tasks such as read-ahead. called often while in card reader mode. */
+void platform_poll_msc();
+
 /* return true if a request to stop is issued */
 bool platform_stop_msc();
 
@@ -79,10 +79,37 @@ bool platform_rewrite_flash_page(uint32_t offset, uint8_t buffer[PLATFORM_FLASH_
     }
 #endif
 
-    dbgmsg("Writing flash at offset ", offset, " data ", bytearray(buffer, 4));
     assert(offset % PLATFORM_FLASH_PAGE_SIZE == 0);
     assert(offset >= PLATFORM_BOOTLOADER_SIZE);
 
+#ifdef ZULUSCSI_MCU_RP23XX
+    const volatile uint32_t *flash32 = (const volatile uint32_t*)(XIP_NOCACHE_NOALLOC_BASE + offset);
+#else
+    const volatile uint32_t *flash32 = (const volatile uint32_t*)(XIP_NOCACHE_BASE + offset);
+#endif
+    uint32_t *buf32 = (uint32_t*)buffer;
+    uint32_t num_words = PLATFORM_FLASH_PAGE_SIZE / 4;
+
+    // Compare against current flash contents.
+    // Unchanged pages are skipped entirely, and erase is only needed
+    // if some bit has to change from 0 to 1.
+    bool changed = false;
+    bool need_erase = false;
+    for (int i = 0; i < num_words; i++)
+    {
+        uint32_t old = flash32[i];
+        if (old != buf32[i]) changed = true;
+        if ((old & buf32[i]) != buf32[i]) { need_erase = true; break; }
+    }
+
+    if (!changed)
+    {
+        dbgmsg("Flash page at offset ", offset, " unchanged, skipping");
+        return true;
+    }
+
+    dbgmsg("Writing flash at offset ", offset, " data ", bytearray(buffer, 4), need_erase ? "" : " (no erase)");
+
     // Avoid any mbed timer interrupts triggering during the flashing.
     uint32_t saved_irq = save_and_disable_interrupts();
 
@@ -96,19 +123,16 @@ bool platform_rewrite_flash_page(uint32_t offset, uint8_t buffer[PLATFORM_FLASH_
     xip_ctrl_hw->ctrl = 0;
 #endif
 
-    flash_range_erase(offset, PLATFORM_FLASH_PAGE_SIZE);
+    if (need_erase)
+    {
+        flash_range_erase(offset, PLATFORM_FLASH_PAGE_SIZE);
+    }
     flash_range_program(offset, buffer, PLATFORM_FLASH_PAGE_SIZE);
 
-    uint32_t *buf32 = (uint32_t*)buffer;
-    uint32_t num_words = PLATFORM_FLASH_PAGE_SIZE / 4;
     for (int i = 0; i < num_words; i++)
     {
         uint32_t expected = buf32[i];
-#ifdef ZULUSCSI_MCU_RP23XX
-        uint32_t actual = *(volatile uint32_t*)(XIP_NOCACHE_NOALLOC_BASE + offset + i * 4);
-#else
-        uint32_t actual = *(volatile uint32_t*)(XIP_NOCACHE_BASE + offset + i * 4);
-#endif
+        uint32_t actual = flash32[i];
         if (actual != expected)
         {
             logmsg("Flash verify failed at offset ", offset + i * 4, " got ", actual, " expected ", expected);
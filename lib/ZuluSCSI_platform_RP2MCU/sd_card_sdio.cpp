@@ -41,6 +41,10 @@
 #define SDIO_FALLBACK_CLK_DIV 2
 #endif
 
+#ifndef SDIO_ERASE_TIMEOUT_MS
+#define SDIO_ERASE_TIMEOUT_MS 60000
+#endif
+
 static uint32_t g_sdio_ocr; // Operating condition register from card
 static uint32_t g_sdio_rca; // Relative card address
 static cid_t g_sdio_cid;
@@ -52,6 +56,7 @@ static uint32_t g_sdio_dma_buf[128];
 static uint32_t g_sdio_sector_count;
 static uint32_t g_sdio_crc_failure_count;
 static int g_sdio_clk_divider = 1;
+static uint32_t g_sdio_write_stall_us; // Time spent waiting for card to program written data
 
 #define checkReturnOk(call) ((g_sdio_error = (call)) == SDIO_OK ? true : logSDError(__LINE__))
 static bool logSDError(int line)
@@ -371,8 +376,31 @@ bool SdioCard::writeStop()
 
 bool SdioCard::erase(uint32_t firstSector, uint32_t lastSector)
 {
-    logmsg("SdioCard::erase() not implemented");
-    return false;
+    // Cards up to 2GB use byte addressing, SDHC cards use sector addressing
+    uint32_t first = (type() == SD_CARD_TYPE_SDHC) ? firstSector : (firstSector * 512);
+    uint32_t last = (type() == SD_CARD_TYPE_SDHC) ? lastSector : (lastSector * 512);
+
+    uint32_t reply;
+    if (!checkReturnOk(rp2040_sdio_command_R1(CMD32, first, &reply)) || // ERASE_WR_BLK_START
+        !checkReturnOk(rp2040_sdio_command_R1(CMD33, last, &reply)) || // ERASE_WR_BLK_END
+        !checkReturnOk(rp2040_sdio_command_R1(CMD38, 0, &reply))) // ERASE
+    {
+        return false;
+    }
+
+    // Erase duration depends on card and area size, card signals busy until it is done
+    uint32_t start = millis();
+    while (isBusy())
+    {
+        if ((uint32_t)(millis() - start) > SDIO_ERASE_TIMEOUT_MS)
+        {
+            logmsg("SdioCard::erase(", firstSector, ", ", lastSector, ") timeout");
+            return false;
+        }
+        platform_reset_watchdog();
+    }
+
+    return true;
 }
 
 bool SdioCard::cardCMD6(uint32_t arg, uint8_t* status) {
@@ -480,10 +508,18 @@ bool SdioCard::writeSectors(uint32_t sector, const uint8_t* src, size_t n)
     {
         // TODO: Instead of CMD12 stopTransmission command, according to SD spec we should send stopTran token.
         // stopTransmission seems to work in practice.
-        return stopTransmission(true);
+        uint32_t start = micros();
+        bool status = stopTransmission(true);
+        g_sdio_write_stall_us += micros() - start;
+        return status;
     }
 }
 
+uint32_t platform_sd_write_stall_us()
+{
+    return g_sdio_write_stall_us;
+}
+
 bool SdioCard::readSector(uint32_t sector, uint8_t* dst)
 {
     uint8_t *real_dst = dst;
@@ -38,6 +38,7 @@
 #include <hardware/dma.h>
 #include <hardware/gpio.h>
 #include <hardware/structs/scb.h>
+#include <hardware/sync.h>
 #include <ZuluSCSI_log.h>
 #include "timings_RP2MCU.h"
 
@@ -74,11 +75,18 @@ static struct {
     uint32_t *data_buf;
     uint32_t blocks_done; // Number of blocks transferred so far
     uint32_t total_blocks; // Total number of blocks to transfer
-    uint32_t blocks_checksumed; // Number of blocks that have had CRC calculated
     uint32_t checksum_errors; // Number of checksum errors detected
 
+    // Checksums are calculated by core0 and by a helper job on core1.
+    // Blocks are claimed in order under g_sdio_spinlock, and results are
+    // discarded if a new transfer has started in the meantime.
+    uint32_t transfer_id;
+    uint32_t blocks_checksumed; // Number of blocks claimed for CRC calculation
+    volatile bool core1_job_pending;
+    volatile uint8_t checksum_ready[SDIO_MAX_BLOCKS];
+    uint64_t block_checksums[SDIO_MAX_BLOCKS];
+
     // Variables for block writes
-    uint64_t next_wr_block_checksum;
     uint32_t end_token_buf[3]; // CRC and end token for write block
     sdio_status_t wr_status;
     uint32_t card_response;
@@ -95,6 +103,8 @@ static struct {
     } received_checksums[SDIO_MAX_BLOCKS];
 } g_sdio;
 
+static spin_lock_t *g_sdio_spinlock;
+
 void rp2040_sdio_dma_irq();
 
 /*******************************************************
@@ -164,6 +174,91 @@ uint64_t sdio_crc16_4bit_checksum(uint32_t *data, uint32_t num_words)
     return crc;
 }
 
+/*******************************************************
+ * Checksum calculation shared between cores
+ *******************************************************/
+
+// Reset checksum state for a new transfer
+static void sdio_checksum_reset()
+{
+    uint32_t saved_irq = spin_lock_blocking(g_sdio_spinlock);
+    g_sdio.transfer_id++;
+    g_sdio.blocks_checksumed = 0;
+    memset((void*)g_sdio.checksum_ready, 0, sizeof(g_sdio.checksum_ready));
+    spin_unlock(g_sdio_spinlock, saved_irq);
+}
+
+// Claim the next block below 'available' and calculate its checksum.
+// Returns false if there was no block to claim.
+static bool sdio_checksum_next_block(uint32_t available)
+{
+    uint32_t saved_irq = spin_lock_blocking(g_sdio_spinlock);
+    uint32_t id = g_sdio.transfer_id;
+    uint32_t *data_buf = g_sdio.data_buf;
+    int blockidx = -1;
+    if (g_sdio.blocks_checksumed < available)
+    {
+        blockidx = g_sdio.blocks_checksumed++;
+    }
+    spin_unlock(g_sdio_spinlock, saved_irq);
+
+    if (blockidx < 0) return false;
+
+    uint64_t checksum = sdio_crc16_4bit_checksum(data_buf + blockidx * SDIO_WORDS_PER_BLOCK,
+                                                 SDIO_WORDS_PER_BLOCK);
+
+    saved_irq = spin_lock_blocking(g_sdio_spinlock);
+    if (id == g_sdio.transfer_id)
+    {
+        g_sdio.block_checksums[blockidx] = checksum;
+        __dmb();
+        g_sdio.checksum_ready[blockidx] = 1;
+    }
+    spin_unlock(g_sdio_spinlock, saved_irq);
+    return true;
+}
+
+// Make sure checksum of given block is available, calculating it if needed
+static void sdio_checksum_wait(uint32_t blockidx)
+{
+    while (!g_sdio.checksum_ready[blockidx])
+    {
+        // If the block is already being calculated on core1,
+        // this just spins until it is done.
+        sdio_checksum_next_block(g_sdio.total_blocks);
+    }
+    __dmb();
+}
+
+// Runs on core1 while a multi-block transfer is in progress,
+// calculating checksums ahead of core0.
+// Returns when there is no block available, so that other core1 jobs
+// can run. During reception core0 dispatches it again as blocks arrive.
+static void sdio_checksum_core1_job()
+{
+    uint32_t id = g_sdio.transfer_id;
+    while (g_sdio.transfer_id == id && g_sdio.transfer_state != SDIO_IDLE)
+    {
+        // Received blocks are checked as soon as they arrive,
+        // transmitted blocks can be calculated immediately.
+        uint32_t available = (g_sdio.transfer_state == SDIO_RX) ? g_sdio.blocks_done : g_sdio.total_blocks;
+        if (!sdio_checksum_next_block(available)) break;
+    }
+    g_sdio.core1_job_pending = false;
+}
+
+static void sdio_checksum_start_core1()
+{
+    if (g_sdio.total_blocks > 1 && !g_sdio.core1_job_pending)
+    {
+        g_sdio.core1_job_pending = true;
+        if (!platform_core1_try_dispatch(&sdio_checksum_core1_job))
+        {
+            g_sdio.core1_job_pending = false;
+        }
+    }
+}
+
 /*******************************************************
  * Status Register Receiver
  *******************************************************/
@@ -422,8 +517,8 @@ sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks, uint32_
     g_sdio.data_buf = (uint32_t*)buffer;
     g_sdio.blocks_done = 0;
     g_sdio.total_blocks = num_blocks;
-    g_sdio.blocks_checksumed = 0;
     g_sdio.checksum_errors = 0;
+    sdio_checksum_reset();
 
     // Create DMA block descriptors to store each block of block_size bytes of data to buffer
     // and then 8 bytes to g_sdio.received_checksums.
@@ -473,18 +568,22 @@ sdio_status_t rp2040_sdio_rx_start(uint8_t *buffer, uint32_t num_blocks, uint32_
     dma_channel_start(SDIO_DMA_CHB);
     pio_sm_set_enabled(SDIO_PIO, SDIO_DATA_SM, true);
 
+    // Let core1 check checksums while blocks arrive
+    sdio_checksum_start_core1();
+
     return SDIO_OK;
 }
 
-// Check checksums for received blocks
-static void sdio_verify_rx_checksums(uint32_t maxcount)
+// Compare calculated checksums against received ones after all blocks are done
+static void sdio_verify_rx_checksums()
 {
-    while (g_sdio.blocks_checksumed < g_sdio.blocks_done && maxcount-- > 0)
+    // Calculate any remaining checksums not done by core1
+    while (sdio_checksum_next_block(g_sdio.total_blocks));
+
+    for (uint32_t blockidx = 0; blockidx < g_sdio.total_blocks; blockidx++)
     {
-        // Calculate checksum from received data
-        int blockidx = g_sdio.blocks_checksumed++;
-        uint64_t checksum = sdio_crc16_4bit_checksum(g_sdio.data_buf + blockidx * SDIO_WORDS_PER_BLOCK,
-                                                     SDIO_WORDS_PER_BLOCK);
+        sdio_checksum_wait(blockidx);
+        uint64_t checksum = g_sdio.block_checksums[blockidx];
 
         // Convert received checksum to little-endian format
         uint32_t top = __builtin_bswap32(g_sdio.received_checksums[blockidx].top);
@@ -513,7 +612,7 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
     else
     {
         // Use the idle time to calculate checksums
-        sdio_verify_rx_checksums(4);
+        for (int i = 0; i < 4 && sdio_checksum_next_block(g_sdio.blocks_done); i++);
 
         // Check how many DMA control blocks have been consumed
         uint32_t dma_ctrl_block_count = (dma_hw->ch[SDIO_DMA_CHB].read_addr - (uint32_t)&g_sdio.dma_blocks);
@@ -523,6 +622,12 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
         // When transfer ends, dma_ctrl_block_count == g_sdio.total_blocks * 2 + 1
         g_sdio.blocks_done = (dma_ctrl_block_count - 1) / 2;
 
+        // Give newly arrived blocks to core1 if its job has run out of work
+        if (g_sdio.blocks_checksumed < g_sdio.blocks_done)
+        {
+            sdio_checksum_start_core1();
+        }
+
         // NOTE: When all blocks are done, rx_poll() still returns SDIO_BUSY once.
         // This provides a chance to start the SCSI transfer before the last checksums
         // are computed. Any checksum failures can be indicated in SCSI status after
@@ -537,7 +642,7 @@ sdio_status_t rp2040_sdio_rx_poll(uint32_t *bytes_complete)
     if (g_sdio.transfer_state == SDIO_IDLE)
     {
         // Verify all remaining checksums.
-        sdio_verify_rx_checksums(g_sdio.total_blocks);
+        sdio_verify_rx_checksums();
 
         if (g_sdio.checksum_errors == 0)
             return SDIO_OK;
@@ -581,7 +686,8 @@ static void sdio_start_next_block_tx()
         SDIO_WORDS_PER_BLOCK, false);
 
     // Prepare second DMA channel to send the CRC and block end marker
-    uint64_t crc = g_sdio.next_wr_block_checksum;
+    sdio_checksum_wait(g_sdio.blocks_done);
+    uint64_t crc = g_sdio.block_checksums[g_sdio.blocks_done];
     g_sdio.end_token_buf[0] = (uint32_t)(crc >> 32);
     g_sdio.end_token_buf[1] = (uint32_t)(crc >>  0);
     g_sdio.end_token_buf[2] = 0xFFFFFFFF;
@@ -611,14 +717,6 @@ static void sdio_start_next_block_tx()
     pio_sm_set_enabled(SDIO_PIO, SDIO_DATA_SM, true);
 }
 
-static void sdio_compute_next_tx_checksum()
-{
-    assert (g_sdio.blocks_done < g_sdio.total_blocks && g_sdio.blocks_checksumed < g_sdio.total_blocks);
-    int blockidx = g_sdio.blocks_checksumed++;
-    g_sdio.next_wr_block_checksum = sdio_crc16_4bit_checksum(g_sdio.data_buf + blockidx * SDIO_WORDS_PER_BLOCK,
-                                                             SDIO_WORDS_PER_BLOCK);
-}
-
 // Start transferring data from memory to SD card
 sdio_status_t rp2040_sdio_tx_start(const uint8_t *buffer, uint32_t num_blocks)
 {
@@ -630,20 +728,20 @@ sdio_status_t rp2040_sdio_tx_start(const uint8_t *buffer, uint32_t num_blocks)
     g_sdio.data_buf = (uint32_t*)buffer;
     g_sdio.blocks_done = 0;
     g_sdio.total_blocks = num_blocks;
-    g_sdio.blocks_checksumed = 0;
     g_sdio.checksum_errors = 0;
+    sdio_checksum_reset();
 
-    // Compute first block checksum
-    sdio_compute_next_tx_checksum();
+    // Calculate the first two checksums before the transfer starts.
+    // The IRQ handler waits for the checksum of the next block, and it must
+    // never wait for a block that was claimed by the code it interrupted.
+    sdio_checksum_next_block(g_sdio.total_blocks);
+    sdio_checksum_next_block(g_sdio.total_blocks);
 
     // Start first DMA transfer and PIO
     sdio_start_next_block_tx();
 
-    if (g_sdio.blocks_checksumed < g_sdio.total_blocks)
-    {
-        // Precompute second block checksum
-        sdio_compute_next_tx_checksum();
-    }
+    // Let core1 calculate checksums for the following blocks
+    sdio_checksum_start_core1();
 
     return SDIO_OK;
 }
@@ -732,12 +830,9 @@ static void rp2040_sdio_tx_irq()
                 sdio_start_next_block_tx();
                 g_sdio.transfer_state = SDIO_TX;
 
-                if (g_sdio.blocks_checksumed < g_sdio.total_blocks)
-                {
-                    // Precompute the CRC for next block so that it is ready when
-                    // we want to send it.
-                    sdio_compute_next_tx_checksum();
-                }
+                // Precompute the CRC for next block so that it is ready when
+                // we want to send it, unless core1 is already ahead.
+                sdio_checksum_next_block(g_sdio.total_blocks);
             }
             else
             {
@@ -807,6 +902,7 @@ void rp2040_sdio_init(int clock_divider)
         pio_sm_claim(SDIO_PIO, SDIO_DATA_SM);
         dma_channel_claim(SDIO_DMA_CH);
         dma_channel_claim(SDIO_DMA_CHB);
+        g_sdio_spinlock = spin_lock_init(spin_lock_claim_unused(true));
         resources_claimed = true;
     }
 
@@ -0,0 +1,73 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Minimal Arduino API for the host native build.
+//
+// All timing functions run on a simulated clock so that benchmark results
+// are deterministic and independent of the host machine speed.
+// Delays advance the clock, and each clock read advances it by a small
+// amount so that busy-wait loops in the firmware terminate.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+// Older glibc versions lack these BSD functions that newlib provides
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+#ifdef __cplusplus
+extern "C" {
+#endif
+size_t strlcpy(char *dst, const char *src, size_t size);
+size_t strlcat(char *dst, const char *src, size_t size);
+#ifdef __cplusplus
+}
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Simulated time in nanoseconds since start of the program
+extern uint64_t g_sim_time_ns;
+
+// Advance simulated time
+static inline void sim_advance_ns(uint64_t ns)
+{
+    g_sim_time_ns += ns;
+}
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+static inline void yield(void) {}
+
+#ifdef __cplusplus
+}
+#endif
+
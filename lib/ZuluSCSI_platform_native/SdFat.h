@@ -0,0 +1,251 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Host implementation of the subset of SdFat API used by ZuluSCSI firmware.
+//
+// Files are stored in a normal directory on the host, which acts as the
+// root of the simulated SD card. SD card access latency and throughput
+// are simulated by advancing the simulated clock, see sim_sd_config_t.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+#define O_READ O_RDONLY
+#define O_WRITE O_WRONLY
+#define FILE_READ O_RDONLY
+#define FILE_WRITE (O_RDWR | O_CREAT | O_APPEND)
+typedef int oflag_t;
+
+#define FAT_TYPE_FAT16 16
+#define FAT_TYPE_FAT32 32
+#define FAT_TYPE_EXFAT 64
+
+#define FS_ATTRIB_READ_ONLY 0x01
+#define FS_ATTRIB_HIDDEN 0x02
+#define FS_ATTRIB_SYSTEM 0x04
+#define FS_ATTRIB_DIRECTORY 0x10
+#define FS_ATTRIB_ARCHIVE 0x20
+
+#define SD_SECTOR_SIZE 512
+#define SD_SCK_MHZ(x) (x)
+#define DEDICATED_SPI 1
+
+// Simulated SD card timing parameters
+typedef struct {
+    uint32_t access_ns;     // Fixed latency for each read or write call
+    uint32_t read_ns_per_kB;
+    uint32_t write_ns_per_kB;
+} sim_sd_config_t;
+
+extern sim_sd_config_t g_sim_sd_config;
+
+// Directory on the host that is used as root of the SD card
+extern const char *g_sim_sd_root;
+
+// Advance simulated clock for SD card transfer of given size.
+// Reports progress through the callback set by platform_set_sd_callback().
+void sim_sd_transfer(const void *buf, uint32_t bytes, bool is_write);
+
+struct cid_t {
+    uint8_t mid;
+    char oid[2];
+    char pnm[5];
+    uint8_t prv;
+    uint8_t psn8[4];
+    uint8_t mdt[2];
+    uint8_t crc;
+    uint32_t psn() const { return ((uint32_t)psn8[0] << 24) | ((uint32_t)psn8[1] << 16) | ((uint32_t)psn8[2] << 8) | psn8[3]; }
+    int mdtYear() const { return 2000 + ((mdt[0] & 0x0F) << 4) + (mdt[1] >> 4); }
+    int mdtMonth() const { return mdt[1] & 0x0F; }
+};
+
+struct sds_t {
+    uint8_t data[64];
+    uint8_t speedClass() const { return 10; }
+};
+
+class SdCard
+{
+public:
+    bool readSector(uint32_t sector, uint8_t *dst) { return readSectors(sector, dst, 1); }
+    bool writeSector(uint32_t sector, const uint8_t *src) { return writeSectors(sector, src, 1); }
+    bool readSectors(uint32_t sector, uint8_t *dst, size_t ns);
+    bool writeSectors(uint32_t sector, const uint8_t *src, size_t ns);
+    bool erase(uint32_t firstSector, uint32_t lastSector);
+    bool syncDevice() { return true; }
+    bool isBusy() { return false; }
+    uint32_t sectorCount();
+    uint8_t errorCode() const { return 0; }
+    uint32_t errorData() const { return 0; }
+    uint32_t status() { return 1; }
+    uint8_t type() const { return 3; }
+    bool readCID(cid_t *cid);
+    bool readOCR(uint32_t *ocr) { *ocr = 0xC0FF8000; return true; }
+    bool readSDS(sds_t *sds) { return true; }
+};
+
+class FsVolume;
+
+struct fspos_t {
+    uint64_t position;
+    uint32_t cluster;
+};
+
+class FsBaseFile
+{
+public:
+    FsBaseFile();
+    FsBaseFile(const FsBaseFile &other);
+    FsBaseFile &operator=(const FsBaseFile &other);
+    ~FsBaseFile();
+
+    bool open(const char *path, oflag_t oflag = O_RDONLY);
+    bool open(FsBaseFile *dir, const char *path, oflag_t oflag = O_RDONLY);
+    bool open(FsVolume *vol, const char *path, oflag_t oflag = O_RDONLY);
+    bool openNext(FsBaseFile *dir, oflag_t oflag = O_RDONLY);
+    bool close();
+
+    int read(void *buf, size_t count);
+    int read();
+    size_t write(const void *buf, size_t count);
+    size_t write(uint8_t b) { return write(&b, 1); }
+    size_t write(const char *str);
+    int fgets(char *str, int num, char *delim = NULL);
+    bool sync() { return flush(); }
+    bool flush();
+
+    bool seek(uint64_t pos) { return seekSet(pos); }
+    bool seekSet(uint64_t pos);
+    bool seekCur(int64_t offset) { return seekSet(curPosition() + offset); }
+    bool seekEnd(int64_t offset = 0) { return seekSet(size() + offset); }
+    void rewind() { seekSet(0); }
+    uint64_t position() { return curPosition(); }
+    uint64_t curPosition();
+    uint64_t size() { return fileSize(); }
+    uint64_t fileSize();
+    int available() { return (int)(fileSize() - curPosition()); }
+    void fgetpos(fspos_t *pos);
+    void fsetpos(const fspos_t *pos);
+
+    bool preAllocate(uint64_t length);
+    bool truncate(uint64_t length);
+    bool truncate() { return truncate(curPosition()); }
+    bool rename(const char *newPath);
+    bool remove();
+    bool remove(const char *path);
+    bool exists(const char *path);
+
+    bool isOpen() const { return m_file != NULL || m_dir != NULL; }
+    bool isDir() const { return m_dir != NULL; }
+    bool isDirectory() const { return isDir(); }
+    bool isFile() const { return m_file != NULL; }
+    bool isHidden() const { return m_name[0] == '.'; }
+    bool isReadOnly() const { return false; }
+    bool isWritable() const { return m_writable; }
+    bool isReadable() const { return m_file != NULL; }
+    bool isContiguous() { return false; }
+    bool contiguousRange(uint32_t *bgnSector, uint32_t *endSector) { return false; }
+    uint32_t firstSector() { return 0; }
+    uint32_t dirIndex() { return m_dirindex; }
+    uint8_t getError() const { return m_writeError ? 1 : 0; }
+    bool getWriteError() const { return m_writeError; }
+    void clearWriteError() { m_writeError = false; }
+    size_t getName(char *name, size_t len);
+    bool getCreateDateTime(uint16_t *pdate, uint16_t *ptime) { *pdate = 0; *ptime = 0; return true; }
+    bool getModifyDateTime(uint16_t *pdate, uint16_t *ptime) { *pdate = 0; *ptime = 0; return true; }
+    bool rewindDirectory();
+
+    operator bool() const { return isOpen(); }
+
+protected:
+    bool openPath(const char *hostpath, oflag_t oflag);
+
+    FILE *m_file;
+    DIR *m_dir;
+    bool m_writable;
+    bool m_writeError;
+    uint32_t m_dirindex;
+    char m_path[256];
+    char m_name[256];
+};
+
+class FsFile : public FsBaseFile
+{
+public:
+    FsFile openNextFile(oflag_t oflag = O_RDONLY)
+    {
+        FsFile f;
+        f.openNext(this, oflag);
+        return f;
+    }
+};
+
+typedef FsFile File;
+
+class FsVolume
+{
+public:
+    FsFile open(const char *path, oflag_t oflag = O_RDONLY);
+    bool begin(SdCard *card, bool setCwv = true, uint8_t part = 1) { return true; }
+    bool exists(const char *path);
+    bool remove(const char *path);
+    bool rename(const char *oldPath, const char *newPath);
+    bool mkdir(const char *path, bool pFlag = true);
+    bool rmdir(const char *path);
+    bool chdir(const char *path = "/") { return true; }
+    uint8_t attrib(const char *path);
+    bool attrib(const char *path, uint8_t bits) { return exists(path); }
+    uint32_t clusterCount() { return 1024 * 1024; }
+    uint32_t freeClusterCount() { return 512 * 1024; }
+    uint32_t bytesPerCluster() { return 32768; }
+    uint32_t sectorsPerCluster() { return 64; }
+    uint8_t fatType() { return FAT_TYPE_EXFAT; }
+};
+
+class SdSpiConfig
+{
+public:
+    SdSpiConfig(int csPin, int options, int maxSck) {}
+};
+
+class SdFs : public FsVolume
+{
+public:
+    bool begin(const SdSpiConfig &config);
+    bool end() { return true; }
+    SdCard *card() { return &m_card; }
+    FsVolume *vol() { return this; }
+    uint8_t sdErrorCode() { return 0; }
+    uint32_t sdErrorData() { return 0; }
+
+private:
+    SdCard m_card;
+};
+
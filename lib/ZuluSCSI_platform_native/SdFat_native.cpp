@@ -0,0 +1,407 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Host implementation of the SdFat API subset, see SdFat.h
+
+#include "SdFat.h"
+#include <Arduino.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+const char *g_sim_sd_root = ".";
+
+// Simulated card size reported for raw access, 32 GB
+#define SIM_SD_SECTOR_COUNT (64 * 1024 * 1024)
+
+// Convert firmware path to host path under the SD root directory
+static void host_path(char *dest, size_t destlen, const char *base, const char *path)
+{
+    while (*path == '/') path++;
+
+    if (base && base[0] && path[0])
+        snprintf(dest, destlen, "%s/%s", base, path);
+    else if (base && base[0])
+        snprintf(dest, destlen, "%s", base);
+    else
+        snprintf(dest, destlen, "%s/%s", g_sim_sd_root, path);
+}
+
+/*************************/
+/* File and directories  */
+/*************************/
+
+FsBaseFile::FsBaseFile():
+    m_file(NULL), m_dir(NULL), m_writable(false), m_writeError(false), m_dirindex(0)
+{
+    m_path[0] = 0;
+    m_name[0] = 0;
+}
+
+// SdFat file objects are cheap handles that can be copied.
+// Here the copy gets its own host file handle at the same position.
+FsBaseFile::FsBaseFile(const FsBaseFile &other): FsBaseFile()
+{
+    *this = other;
+}
+
+FsBaseFile &FsBaseFile::operator=(const FsBaseFile &other)
+{
+    if (this == &other) return *this;
+    close();
+
+    if (other.m_file)
+    {
+        fflush(other.m_file);
+        m_file = fopen(other.m_path, other.m_writable ? "r+b" : "rb");
+        if (m_file) fseeko(m_file, ftello(other.m_file), SEEK_SET);
+    }
+    else if (other.m_dir)
+    {
+        m_dir = opendir(other.m_path);
+        for (uint32_t i = 0; m_dir && i < other.m_dirindex; i++) readdir(m_dir);
+    }
+
+    m_writable = other.m_writable;
+    m_writeError = other.m_writeError;
+    m_dirindex = other.m_dirindex;
+    memcpy(m_path, other.m_path, sizeof(m_path));
+    memcpy(m_name, other.m_name, sizeof(m_name));
+    return *this;
+}
+
+FsBaseFile::~FsBaseFile()
+{
+    close();
+}
+
+bool FsBaseFile::openPath(const char *hostpath, oflag_t oflag)
+{
+    close();
+
+    struct stat st;
+    if (stat(hostpath, &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        m_dir = opendir(hostpath);
+    }
+    else
+    {
+        int fd = ::open(hostpath, oflag, 0644);
+        if (fd < 0) return false;
+
+        const char *mode = "rb";
+        if ((oflag & O_ACCMODE) == O_WRONLY) mode = (oflag & O_APPEND) ? "ab" : "wb";
+        if ((oflag & O_ACCMODE) == O_RDWR) mode = (oflag & O_APPEND) ? "a+b" : "r+b";
+        m_file = fdopen(fd, mode);
+        m_writable = (oflag & O_ACCMODE) != O_RDONLY;
+    }
+
+    if (!isOpen()) return false;
+
+    strncpy(m_path, hostpath, sizeof(m_path) - 1);
+    m_path[sizeof(m_path) - 1] = 0;
+    const char *name = strrchr(m_path, '/');
+    strncpy(m_name, name ? name + 1 : m_path, sizeof(m_name) - 1);
+    m_name[sizeof(m_name) - 1] = 0;
+    m_dirindex = 0;
+    m_writeError = false;
+    return true;
+}
+
+bool FsBaseFile::open(const char *path, oflag_t oflag)
+{
+    char hostpath[512];
+    host_path(hostpath, sizeof(hostpath), NULL, path);
+    return openPath(hostpath, oflag);
+}
+
+bool FsBaseFile::open(FsBaseFile *dir, const char *path, oflag_t oflag)
+{
+    char hostpath[512];
+    host_path(hostpath, sizeof(hostpath), dir->m_path, path);
+    return openPath(hostpath, oflag);
+}
+
+bool FsBaseFile::open(FsVolume *vol, const char *path, oflag_t oflag)
+{
+    return open(path, oflag);
+}
+
+bool FsBaseFile::openNext(FsBaseFile *dir, oflag_t oflag)
+{
+    if (!dir->m_dir) return false;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir->m_dir)) != NULL)
+    {
+        dir->m_dirindex++;
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+        {
+            char hostpath[512];
+            host_path(hostpath, sizeof(hostpath), dir->m_path, entry->d_name);
+            if (openPath(hostpath, oflag))
+            {
+                m_dirindex = dir->m_dirindex;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool FsBaseFile::rewindDirectory()
+{
+    if (!m_dir) return false;
+    rewinddir(m_dir);
+    m_dirindex = 0;
+    return true;
+}
+
+bool FsBaseFile::close()
+{
+    if (m_file) fclose(m_file);
+    if (m_dir) closedir(m_dir);
+    m_file = NULL;
+    m_dir = NULL;
+    return true;
+}
+
+int FsBaseFile::read(void *buf, size_t count)
+{
+    if (!m_file) return -1;
+    size_t len = fread(buf, 1, count, m_file);
+    sim_sd_transfer(buf, len, false);
+    return (int)len;
+}
+
+int FsBaseFile::read()
+{
+    uint8_t b;
+    return (read(&b, 1) == 1) ? b : -1;
+}
+
+size_t FsBaseFile::write(const void *buf, size_t count)
+{
+    if (!m_file || !m_writable) return 0;
+    size_t len = fwrite(buf, 1, count, m_file);
+    if (len != count) m_writeError = true;
+    sim_sd_transfer(buf, len, true);
+    return len;
+}
+
+size_t FsBaseFile::write(const char *str)
+{
+    return write(str, strlen(str));
+}
+
+int FsBaseFile::fgets(char *str, int num, char *delim)
+{
+    if (!m_file || !::fgets(str, num, m_file)) return 0;
+    sim_sd_transfer(str, strlen(str), false);
+    return (int)strlen(str);
+}
+
+bool FsBaseFile::flush()
+{
+    return m_file && fflush(m_file) == 0;
+}
+
+bool FsBaseFile::seekSet(uint64_t pos)
+{
+    return m_file && fseeko(m_file, (off_t)pos, SEEK_SET) == 0;
+}
+
+uint64_t FsBaseFile::curPosition()
+{
+    return m_file ? (uint64_t)ftello(m_file) : 0;
+}
+
+uint64_t FsBaseFile::fileSize()
+{
+    struct stat st;
+    if (!m_file) return 0;
+    fflush(m_file);
+    if (fstat(fileno(m_file), &st) != 0) return 0;
+    return st.st_size;
+}
+
+void FsBaseFile::fgetpos(fspos_t *pos)
+{
+    pos->position = curPosition();
+    pos->cluster = 0;
+}
+
+void FsBaseFile::fsetpos(const fspos_t *pos)
+{
+    seekSet(pos->position);
+}
+
+bool FsBaseFile::preAllocate(uint64_t length)
+{
+    return m_file && ftruncate(fileno(m_file), (off_t)length) == 0;
+}
+
+bool FsBaseFile::truncate(uint64_t length)
+{
+    if (!m_file) return false;
+    fflush(m_file);
+    return ftruncate(fileno(m_file), (off_t)length) == 0;
+}
+
+bool FsBaseFile::rename(const char *newPath)
+{
+    char hostpath[512];
+    host_path(hostpath, sizeof(hostpath), NULL, newPath);
+    if (::rename(m_path, hostpath) != 0) return false;
+    strncpy(m_path, hostpath, sizeof(m_path) - 1);
+    return true;
+}
+
+bool FsBaseFile::remove()
+{
+    char path[sizeof(m_path)];
+    memcpy(path, m_path, sizeof(path));
+    close();
+    return unlink(path) == 0;
+}
+
+bool FsBaseFile::remove(const char *path)
+{
+    char hostpath[512];
+    host_path(hostpath, sizeof(hostpath), m_path, path);
+    return unlink(hostpath) == 0;
+}
+
+bool FsBaseFile::exists(const char *path)
+{
+    char hostpath[512];
+    struct stat st;
+    host_path(hostpath, sizeof(hostpath), m_path, path);
+    return stat(hostpath, &st) == 0;
+}
+
+size_t FsBaseFile::getName(char *name, size_t len)
+{
+    if (len == 0) return 0;
+    strncpy(name, m_name, len - 1);
+    name[len - 1] = 0;
+    return strlen(name);
+}
+
+/*************************/
+/* Volume functions      */
+/*************************/
+
+FsFile FsVolume::open(const char *path, oflag_t oflag)
+{
+    FsFile file;
+    file.open(path, oflag);
+    return file;
+}
+
+bool FsVolume::exists(const char *path)
+{
+    char hostpath[512];
+    struct stat st;
+    host_path(hostpath, sizeof(hostpath), NULL, path);
+    return stat(hostpath, &st) == 0;
+}
+
+bool FsVolume::remove(const char *path)
+{
+    char hostpath[512];
+    host_path(hostpath, sizeof(hostpath), NULL, path);
+    return unlink(hostpath) == 0;
+}
+
+bool FsVolume::rename(const char *oldPath, const char *newPath)
+{
+    char oldhost[512], newhost[512];
+    host_path(oldhost, sizeof(oldhost), NULL, oldPath);
+    host_path(newhost, sizeof(newhost), NULL, newPath);
+    return ::rename(oldhost, newhost) == 0;
+}
+
+bool FsVolume::mkdir(const char *path, bool pFlag)
+{
+    char hostpath[512];
+    host_path(hostpath, sizeof(hostpath), NULL, path);
+    return ::mkdir(hostpath, 0755) == 0 || errno == EEXIST;
+}
+
+bool FsVolume::rmdir(const char *path)
+{
+    char hostpath[512];
+    host_path(hostpath, sizeof(hostpath), NULL, path);
+    return ::rmdir(hostpath) == 0;
+}
+
+uint8_t FsVolume::attrib(const char *path)
+{
+    char hostpath[512];
+    struct stat st;
+    host_path(hostpath, sizeof(hostpath), NULL, path);
+    if (stat(hostpath, &st) != 0) return 0;
+    return S_ISDIR(st.st_mode) ? FS_ATTRIB_DIRECTORY : FS_ATTRIB_ARCHIVE;
+}
+
+bool SdFs::begin(const SdSpiConfig &config)
+{
+    struct stat st;
+    return stat(g_sim_sd_root, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*************************/
+/* Raw card access       */
+/*************************/
+
+// Raw sector access is not backed by any storage, the host directory
+// only provides the filesystem view of the card.
+bool SdCard::readSectors(uint32_t sector, uint8_t *dst, size_t ns)
+{
+    return false;
+}
+
+bool SdCard::writeSectors(uint32_t sector, const uint8_t *src, size_t ns)
+{
+    return false;
+}
+
+bool SdCard::erase(uint32_t firstSector, uint32_t lastSector)
+{
+    return false;
+}
+
+uint32_t SdCard::sectorCount()
+{
+    return SIM_SD_SECTOR_COUNT;
+}
+
+bool SdCard::readCID(cid_t *cid)
+{
+    memset(cid, 0, sizeof(*cid));
+    memcpy(cid->oid, "ZS", 2);
+    memcpy(cid->pnm, "NATIV", 5);
+    cid->psn8[3] = 1;
+    return true;
+}
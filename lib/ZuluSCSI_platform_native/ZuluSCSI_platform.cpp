@@ -0,0 +1,185 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_platform.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_config.h"
+#include <SdFat.h>
+#include <scsi.h>
+
+uint64_t g_sim_time_ns;
+bool g_sim_verbose;
+
+// Default SD card timing is roughly that of a good SD card over 4-bit SDIO
+sim_sd_config_t g_sim_sd_config = {
+    100000, // access_ns
+    48000,  // read_ns_per_kB, about 21 MB/s
+    80000   // write_ns_per_kB, about 12 MB/s
+};
+
+extern "C" {
+
+const char *g_platform_name = PLATFORM_NAME;
+
+/*************************************/
+/* Simulated clock                   */
+/*************************************/
+
+// Reading the clock takes a bit of time, like on real hardware.
+// This makes busy-wait loops in the firmware terminate.
+unsigned long millis(void)
+{
+    g_sim_time_ns += 100;
+    return (unsigned long)(uint32_t)(g_sim_time_ns / 1000000);
+}
+
+unsigned long micros(void)
+{
+    g_sim_time_ns += 100;
+    return (unsigned long)(uint32_t)(g_sim_time_ns / 1000);
+}
+
+void delay(unsigned long ms)
+{
+    g_sim_time_ns += (uint64_t)ms * 1000000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    g_sim_time_ns += (uint64_t)us * 1000;
+}
+
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t len = strlen(src);
+    if (size > 0)
+    {
+        size_t n = (len < size - 1) ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return len;
+}
+
+size_t strlcat(char *dst, const char *src, size_t size)
+{
+    size_t dlen = strnlen(dst, size);
+    if (dlen == size) return size + strlen(src);
+    return dlen + strlcpy(dst + dlen, src, size - dlen);
+}
+#endif
+
+void platform_init()
+{
+}
+
+void platform_late_init()
+{
+}
+
+void platform_post_sd_card_init()
+{
+}
+
+void platform_disable_led(void)
+{
+}
+
+void platform_log(const char *s)
+{
+    if (g_sim_verbose)
+    {
+        fputs(s, stderr);
+    }
+}
+
+void platform_reset_watchdog()
+{
+}
+
+void platform_reset_mcu(uint32_t reset_in_ms)
+{
+    fprintf(stderr, "Firmware requested reset, exiting simulation\n");
+    exit(1);
+}
+
+const uint8_t* platform_get_8byte_mcu_id()
+{
+    static const uint8_t id[8] = {'Z', 'U', 'L', 'U', 'S', 'I', 'M', '1'};
+    return id;
+}
+
+void platform_poll()
+{
+}
+
+uint8_t platform_get_buttons()
+{
+    return 0;
+}
+
+} /* extern "C" */
+
+SdSpiConfig g_sd_spi_config(0, DEDICATED_SPI, SD_SCK_MHZ(25));
+
+/*****************************************/
+/* Simulated SD card transfer timing     */
+/*****************************************/
+
+// Callback used by SCSI code for simultaneous processing
+static sd_callback_t m_stream_callback;
+static const uint8_t *m_stream_buffer;
+static uint32_t m_stream_count;
+
+void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer)
+{
+    m_stream_callback = func;
+    m_stream_buffer = buffer;
+    m_stream_count = 0;
+}
+
+// The SD card transfer proceeds in background like a DMA transfer would.
+// The callback is called for every completed 512 byte block, and any time
+// the callback spends on SCSI transfers overlaps with the SD card transfer.
+void sim_sd_transfer(const void *buf, uint32_t bytes, bool is_write)
+{
+    uint32_t ns_per_kB = is_write ? g_sim_sd_config.write_ns_per_kB : g_sim_sd_config.read_ns_per_kB;
+    uint64_t start = g_sim_time_ns + g_sim_sd_config.access_ns;
+    uint64_t end = start + (uint64_t)bytes * ns_per_kB / 1024;
+
+    if (m_stream_callback && (const uint8_t*)buf == m_stream_buffer + m_stream_count)
+    {
+        uint32_t count_start = m_stream_count;
+        m_stream_count += bytes;
+
+        uint32_t done = 0;
+        while (done < bytes)
+        {
+            done = (bytes - done > SD_SECTOR_SIZE) ? done + SD_SECTOR_SIZE : bytes;
+            uint64_t block_end = start + (uint64_t)done * ns_per_kB / 1024;
+            if (g_sim_time_ns < block_end) g_sim_time_ns = block_end;
+            m_stream_callback(count_start + done);
+        }
+    }
+
+    if (g_sim_time_ns < end) g_sim_time_ns = end;
+}
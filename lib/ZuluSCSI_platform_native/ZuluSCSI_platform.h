@@ -0,0 +1,130 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Platform-specific definitions for ZuluSCSI.
+// This file is for the host native build, which runs the firmware on a
+// Linux PC against a simulated SCSI bus and SD card for benchmarking.
+
+#pragma once
+
+#include <stdint.h>
+#include <Arduino.h>
+#include <scsi2sd.h>
+#include <ZuluSCSI_config.h>
+#include <ZuluSCSI_settings.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const char *g_platform_name;
+
+// Debug logging function, prints to stderr when verbose output is enabled
+extern bool g_sim_verbose;
+void platform_log(const char *s);
+
+// Short delays advance the simulated clock
+static inline void delay_ns(unsigned long ns)
+{
+    sim_advance_ns(ns);
+}
+
+static inline void delay_us(unsigned long us)
+{
+    sim_advance_ns((uint64_t)us * 1000);
+}
+
+static inline void delay_100ns()
+{
+    sim_advance_ns(100);
+}
+
+// Initialize SD card and GPIO configuration
+void platform_init();
+
+// Initialization for main application, not used for bootloader
+void platform_late_init();
+
+// Initialization after the SD Card has been found
+void platform_post_sd_card_init();
+
+// Status LED is not present
+static inline void platform_write_led(bool state) {}
+#define LED_ON()  platform_write_led(true)
+#define LED_OFF() platform_write_led(false)
+static inline void platform_set_blink_status(bool status) {}
+static inline void platform_write_led_override(bool state) {}
+#define LED_ON_OVERRIDE()  platform_write_led_override(true)
+#define LED_OFF_OVERRIDE()  platform_write_led_override(false)
+void platform_disable_led(void);
+
+// SdFat error code that indicates missing SD card
+static inline uint8_t platform_no_sd_card_on_init_error_code() { return 0; }
+
+// Watchdog is not used in the simulation
+void platform_reset_watchdog();
+
+// Reset request terminates the simulation
+void platform_reset_mcu(uint32_t reset_in_ms);
+
+// Serial number used for AS/400 and SD card based identifiers
+const uint8_t* platform_get_8byte_mcu_id();
+
+// Poll function that is called every few milliseconds.
+void platform_poll();
+
+// There are no buttons in the simulation
+uint8_t platform_get_buttons();
+
+// Nominal system clock, used only in log output
+static inline uint32_t platform_sys_clock_in_hz() { return 150000000; }
+static inline bool platform_reclock_supported() { return false; }
+static inline mass_storage_mode platform_rebooted_into_mass_storage() { return MASS_STORAGE_MODE_NONE; }
+static inline bool platform_emergency_log_save() { return false; }
+
+// Set callback that will be called during data transfer to/from SD card.
+// The simulated SD card calls it while the transfer time elapses.
+typedef void (*sd_callback_t)(uint32_t bytes_complete);
+void platform_set_sd_callback(sd_callback_t func, const uint8_t *buffer);
+
+// Serial console is not simulated
+static inline bool platform_serial_connected() { return false; }
+static inline uint32_t platform_write_to_serial(uint8_t* data, uint32_t len) { return len; }
+
+// Buttons are not simulated
+#define EJECT_BTN_MAX  (2)
+#define EJECT_BTN_MASK ((1 << EJECT_BTN_MAX) - 1)
+#define USER_BTN_MASK  (0)
+static inline uint8_t platform_phy_eject_button() { return 0; }
+static inline void platform_set_eject_button(uint8_t eject_button) {}
+static inline void platform_set_cow_button(uint8_t cow_button) {}
+static inline uint8_t platform_get_cow_buttons_override() { return 0; }
+
+#ifdef __cplusplus
+}
+
+// SD card driver for SdFat
+class SdSpiConfig;
+extern SdSpiConfig g_sd_spi_config;
+#define SD_CONFIG g_sd_spi_config
+#define SD_CONFIG_CRASH g_sd_spi_config
+
+#endif
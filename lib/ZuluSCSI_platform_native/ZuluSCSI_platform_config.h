@@ -0,0 +1,50 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Configuration of the host native build. The SD card write sizes match
+// the hardware platforms using SDIO, so that the simulated workload
+// exercises the same code paths.
+
+#pragma once
+
+// The embedded toolchains make BSD types such as u_int64_t visible implicitly
+#include <sys/types.h>
+
+#define PLATFORM_NAME "ZuluSCSI Native"
+#define PLATFORM_REVISION "1.0"
+#define PLATFORM_MAX_SCSI_SPEED S2S_CFG_SPEED_SYNC_10
+#define PLATFORM_DEFAULT_SCSI_SPEED_SETTING 10
+#define PLATFORM_OPTIMAL_MIN_SD_WRITE_SIZE 4096
+#define PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE 65536
+#define PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE 8192
+
+// PRE-FETCH cache is enabled so that workloads can exercise it
+#ifndef HOST_CACHE_SIZE
+#define HOST_CACHE_SIZE 16384
+#endif
+
+#ifndef TAPE_WRITE_BUFFER_SIZE
+#define TAPE_WRITE_BUFFER_SIZE 8192
+#endif
+
+#ifndef PLATFORM_MAX_BUS_WIDTH
+#define PLATFORM_MAX_BUS_WIDTH 0
+#endif
@@ -0,0 +1,243 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Implements a simulated SCSI bus for the host native build.
+// The bus timing is modeled by advancing the simulated clock for every
+// byte transferred and for the phase change delays.
+
+#include "scsiPhy.h"
+#include "ZuluSCSI_platform.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_log_trace.h"
+#include "ZuluSCSI_config.h"
+
+#include <scsi2sd.h>
+extern "C" {
+#include <scsi.h>
+#include <scsi2sd_time.h>
+}
+
+sim_scsi_host_t g_sim_scsi_host;
+
+// Default is 10 MB/s, which is a typical synchronous SCSI-2 transfer rate
+uint32_t g_sim_scsi_ns_per_byte = 100;
+
+/***********************/
+/* SCSI status signals */
+/***********************/
+
+volatile uint8_t g_scsi_sts_selection;
+volatile uint8_t g_scsi_ctrl_bsy;
+
+static SCSI_PHASE g_scsi_phase;
+
+extern "C" bool scsiStatusATN()
+{
+    return g_sim_scsi_host.msg_out_pos < g_sim_scsi_host.msg_out_len;
+}
+
+extern "C" bool scsiStatusBSY()
+{
+    return false;
+}
+
+extern "C" bool scsiStatusSEL()
+{
+    // Simulated initiator releases SEL as soon as target asserts BSY
+    g_scsi_ctrl_bsy = 0;
+    return false;
+}
+
+extern "C" void sim_scsi_start_command(int target_id, int lun, const uint8_t *cdb, int cdb_len)
+{
+    memset(&g_sim_scsi_host, 0, sizeof(g_sim_scsi_host));
+    g_sim_scsi_host.msg_out[0] = 0x80 | (lun & 7); // IDENTIFY
+    g_sim_scsi_host.msg_out_len = 1;
+    memcpy(g_sim_scsi_host.cdb, cdb, cdb_len);
+    g_sim_scsi_host.cdb_len = cdb_len;
+
+    // Selection by initiator ID 7, with ATN asserted
+    g_scsi_sts_selection = SCSI_STS_SELECTION_SUCCEEDED | SCSI_STS_SELECTION_ATN | (7 << 3) | (target_id & 7);
+    scsiDev.selFlag = g_scsi_sts_selection;
+}
+
+extern "C" void scsiPhyReset(void)
+{
+    g_scsi_sts_selection = 0;
+    g_scsi_ctrl_bsy = 0;
+}
+
+/************************/
+/* SCSI bus phase logic */
+/************************/
+
+extern "C" void scsiEnterPhase(int phase)
+{
+    int delay = scsiEnterPhaseImmediate(phase);
+    if (delay > 0)
+    {
+        s2s_delay_ns(delay);
+    }
+}
+
+// Change state and return nanosecond delay to wait
+extern "C" uint32_t scsiEnterPhaseImmediate(int phase)
+{
+    if (phase != g_scsi_phase)
+    {
+        if (scsiDev.compatMode < COMPAT_SCSI2 && (phase == DATA_IN || phase == DATA_OUT))
+        {
+            s2s_delay_ns(400000);
+        }
+
+        int oldphase = g_scsi_phase;
+        g_scsi_phase = (SCSI_PHASE)phase;
+        scsiLogPhaseChange(phase);
+
+        if (phase < 0)
+        {
+            return 0;
+        }
+        else
+        {
+            int delayNs = 400; // Bus settle delay
+            if ((oldphase & __scsiphase_io) != (phase & __scsiphase_io))
+            {
+                delayNs += 400; // Data release delay
+            }
+
+            if (scsiDev.compatMode < COMPAT_SCSI2)
+            {
+                delayNs += 100000;
+            }
+
+            return delayNs;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+// Release all signals
+void scsiEnterBusFree(void)
+{
+    if (g_scsi_phase != BUS_FREE && g_sim_scsi_host.got_status)
+    {
+        g_sim_scsi_host.done = true;
+    }
+
+    g_scsi_phase = BUS_FREE;
+    g_scsi_sts_selection = 0;
+    g_scsi_ctrl_bsy = 0;
+    scsiDev.cdbLen = 0;
+}
+
+/********************/
+/* Transmit to host */
+/********************/
+
+static void sim_receive_bytes(const uint8_t *data, uint32_t count)
+{
+    sim_advance_ns((uint64_t)count * g_sim_scsi_ns_per_byte);
+
+    if (g_scsi_phase == DATA_IN)
+    {
+        g_sim_scsi_host.data_in_bytes += count;
+    }
+    else if (g_scsi_phase == STATUS && count > 0)
+    {
+        g_sim_scsi_host.status = data[0];
+        g_sim_scsi_host.got_status = true;
+    }
+}
+
+extern "C" void scsiWriteByte(uint8_t value)
+{
+    scsiLogDataIn(&value, 1);
+    sim_receive_bytes(&value, 1);
+}
+
+extern "C" void scsiWrite(const uint8_t* data, uint32_t count)
+{
+    scsiLogDataIn(data, count);
+    sim_receive_bytes(data, count);
+}
+
+extern "C" void scsiStartWrite(const uint8_t* data, uint32_t count)
+{
+    scsiWrite(data, count);
+}
+
+extern "C" bool scsiIsWriteFinished(const uint8_t *data)
+{
+    return true;
+}
+
+extern "C" void scsiFinishWrite()
+{
+}
+
+/*********************/
+/* Receive from host */
+/*********************/
+
+static uint8_t sim_send_byte(void)
+{
+    sim_scsi_host_t *host = &g_sim_scsi_host;
+    sim_advance_ns(g_sim_scsi_ns_per_byte);
+
+    if (g_scsi_phase == MESSAGE_OUT && host->msg_out_pos < host->msg_out_len)
+    {
+        return host->msg_out[host->msg_out_pos++];
+    }
+    else if (g_scsi_phase == COMMAND && host->cdb_pos < host->cdb_len)
+    {
+        return host->cdb[host->cdb_pos++];
+    }
+    else if (g_scsi_phase == DATA_OUT)
+    {
+        // Deterministic test pattern for written data
+        return (uint8_t)(host->data_out_bytes++ * 7 + 0x5A);
+    }
+
+    return 0;
+}
+
+extern "C" uint8_t scsiReadByte(void)
+{
+    uint8_t r = sim_send_byte();
+    scsiLogDataOut(&r, 1);
+    return r;
+}
+
+extern "C" void scsiRead(uint8_t* data, uint32_t count, int* parityError)
+{
+    *parityError = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        data[i] = sim_send_byte();
+    }
+
+    scsiLogDataOut(data, count);
+}
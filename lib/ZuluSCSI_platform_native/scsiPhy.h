@@ -0,0 +1,120 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Interface to simulated SCSI physical interface.
+// The target side API is the same as on hardware platforms, the simulated
+// initiator side is driven by the workload replay in sim_replay.cpp.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Read SCSI status signals
+bool scsiStatusATN();
+bool scsiStatusBSY();
+bool scsiStatusSEL();
+
+// Parity is not simulated
+#define scsiParityError() 0
+
+// Get SCSI selection status.
+// Lowest 3 bits are the selected target id.
+// Highest bits are status information.
+#define SCSI_STS_SELECTION_SUCCEEDED 0x40
+#define SCSI_STS_SELECTION_ATN 0x80
+extern volatile uint8_t g_scsi_sts_selection;
+#define SCSI_STS_SELECTED (&g_scsi_sts_selection)
+extern volatile uint8_t g_scsi_ctrl_bsy;
+#define SCSI_CTRL_BSY (&g_scsi_ctrl_bsy)
+
+// Called when SCSI RST signal has been asserted, should release bus.
+void scsiPhyReset(void);
+
+// Change MSG / CD / IO signal states and wait for necessary transition time.
+// Phase argument is one of SCSI_PHASE enum values.
+void scsiEnterPhase(int phase);
+
+// Change state and return nanosecond delay to wait
+uint32_t scsiEnterPhaseImmediate(int phase);
+
+// Release all signals
+void scsiEnterBusFree(void);
+
+// Blocking data transfer
+void scsiWrite(const uint8_t* data, uint32_t count);
+void scsiRead(uint8_t* data, uint32_t count, int* parityError);
+void scsiWriteByte(uint8_t value);
+uint8_t scsiReadByte(void);
+
+// Non-blocking data transfer, simulated as blocking transfers
+void scsiStartWrite(const uint8_t* data, uint32_t count);
+void scsiFinishWrite();
+bool scsiIsWriteFinished(const uint8_t *data);
+
+// Reads from simulated bus are blocking
+inline void scsiStartRead(uint8_t* data, uint32_t count, int *parityError)
+{
+    scsiRead(data, count, parityError);
+}
+
+inline void scsiFinishRead(uint8_t* data, uint32_t count, int *parityError)
+{
+}
+
+inline bool scsiIsReadFinished(const uint8_t *data)
+{
+    return true;
+}
+
+#define s2s_getScsiRateKBs() 0
+
+// Simulated initiator state for one command
+typedef struct {
+    uint8_t msg_out[4];
+    uint8_t msg_out_len;
+    uint8_t msg_out_pos;
+    uint8_t cdb[16];
+    uint8_t cdb_len;
+    uint8_t cdb_pos;
+    uint8_t status;
+    bool got_status;
+    bool done;
+    uint32_t data_in_bytes;
+    uint32_t data_out_bytes;
+} sim_scsi_host_t;
+
+extern sim_scsi_host_t g_sim_scsi_host;
+
+// Time taken by one byte transfer on the SCSI bus
+extern uint32_t g_sim_scsi_ns_per_byte;
+
+// Select target with ATN and IDENTIFY message, then send the command.
+// Completion is indicated by g_sim_scsi_host.done.
+void sim_scsi_start_command(int target_id, int lun, const uint8_t *cdb, int cdb_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,299 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Workload replay benchmark for the host native build.
+//
+// Runs the firmware main loop against a simulated initiator that issues
+// commands from a workload file, and reports per-opcode latency statistics
+// measured on the simulated clock. Because the clock is simulated, results
+// are repeatable and can be compared between firmware revisions.
+//
+// Workload file format, one command per line:
+//   <id> <cdb bytes in hex>      e.g. "0 28 00 00 00 10 00 00 00 80 00"
+//   read <id> <lba> <blocks>     READ(10)
+//   write <id> <lba> <blocks>    WRITE(10)
+//   # comment
+
+#include "ZuluSCSI_platform.h"
+#include "scsiPhy.h"
+#include <SdFat.h>
+#include <scsi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+extern "C" void zuluscsi_setup(void);
+extern "C" void zuluscsi_main_loop(void);
+
+// Commands that take longer than this are reported as timed out
+#define SIM_COMMAND_TIMEOUT_NS (10ULL * 1000000000ULL)
+
+struct sim_command_t {
+    int target_id;
+    uint8_t cdb[16];
+    int cdb_len;
+};
+
+struct sim_opcode_stats_t {
+    std::vector<uint64_t> latency_ns;
+    uint64_t bytes;
+    uint32_t errors;
+};
+
+static int cdb_length(uint8_t opcode)
+{
+    switch (opcode >> 5)
+    {
+        case 0: return 6;
+        case 1: case 2: return 10;
+        case 4: return 16;
+        case 5: return 12;
+        default: return 10;
+    }
+}
+
+static bool parse_line(char *line, sim_command_t *cmd)
+{
+    char *p = strchr(line, '#');
+    if (p) *p = 0;
+
+    char *tokens[20];
+    int count = 0;
+    for (char *tok = strtok(line, " \t\r\n"); tok && count < 20; tok = strtok(NULL, " \t\r\n"))
+    {
+        tokens[count++] = tok;
+    }
+
+    if (count == 0) return false;
+
+    memset(cmd, 0, sizeof(*cmd));
+    if ((strcmp(tokens[0], "read") == 0 || strcmp(tokens[0], "write") == 0) && count == 4)
+    {
+        uint32_t lba = strtoul(tokens[2], NULL, 0);
+        uint32_t blocks = strtoul(tokens[3], NULL, 0);
+        cmd->target_id = atoi(tokens[1]);
+        cmd->cdb[0] = (tokens[0][0] == 'r') ? 0x28 : 0x2A;
+        cmd->cdb[2] = lba >> 24;
+        cmd->cdb[3] = lba >> 16;
+        cmd->cdb[4] = lba >> 8;
+        cmd->cdb[5] = lba;
+        cmd->cdb[7] = blocks >> 8;
+        cmd->cdb[8] = blocks;
+        cmd->cdb_len = 10;
+        return true;
+    }
+
+    cmd->target_id = atoi(tokens[0]);
+    for (int i = 1; i < count && cmd->cdb_len < 16; i++)
+    {
+        cmd->cdb[cmd->cdb_len++] = strtoul(tokens[i], NULL, 16);
+    }
+
+    if (cmd->cdb_len == 0)
+    {
+        fprintf(stderr, "Invalid workload line: %s\n", tokens[0]);
+        return false;
+    }
+
+    if (cmd->cdb_len < cdb_length(cmd->cdb[0]))
+    {
+        cmd->cdb_len = cdb_length(cmd->cdb[0]);
+    }
+
+    return true;
+}
+
+// Run main loop until the command completes.
+// Returns false on timeout.
+static bool run_command(const sim_command_t *cmd)
+{
+    uint64_t start = g_sim_time_ns;
+    sim_scsi_start_command(cmd->target_id, 0, cmd->cdb, cmd->cdb_len);
+
+    while (!g_sim_scsi_host.done)
+    {
+        zuluscsi_main_loop();
+
+        if (g_sim_time_ns - start > SIM_COMMAND_TIMEOUT_NS)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Clear unit attention condition left by the reset on startup
+static void clear_unit_attention(int target_id)
+{
+    sim_command_t tur = {target_id, {0x00}, 6};
+    sim_command_t sense = {target_id, {0x03, 0, 0, 0, 18, 0}, 6};
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (!run_command(&tur) || g_sim_scsi_host.status == 0) break;
+        run_command(&sense);
+    }
+}
+
+static void print_usage()
+{
+    fprintf(stderr,
+        "Usage: zuluscsi_native [options] workload.txt\n"
+        "  --sd-root DIR        Directory used as SD card contents (default .)\n"
+        "  --sd-access-us N     SD card access latency per transfer\n"
+        "  --sd-read-kBps N     SD card read throughput\n"
+        "  --sd-write-kBps N    SD card write throughput\n"
+        "  --scsi-kBps N        SCSI bus transfer rate\n"
+        "  --repeat N           Replay workload N times\n"
+        "  --verbose            Print firmware log to stderr\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *workload_path = NULL;
+    int repeat = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : "0";
+
+        if (strcmp(arg, "--sd-root") == 0) { g_sim_sd_root = val; i++; }
+        else if (strcmp(arg, "--sd-access-us") == 0) { g_sim_sd_config.access_ns = atoi(val) * 1000; i++; }
+        else if (strcmp(arg, "--sd-read-kBps") == 0) { g_sim_sd_config.read_ns_per_kB = 1000000000ULL / std::max(atoi(val), 1); i++; }
+        else if (strcmp(arg, "--sd-write-kBps") == 0) { g_sim_sd_config.write_ns_per_kB = 1000000000ULL / std::max(atoi(val), 1); i++; }
+        else if (strcmp(arg, "--scsi-kBps") == 0) { g_sim_scsi_ns_per_byte = 1000000ULL / std::max(atoi(val), 1); i++; }
+        else if (strcmp(arg, "--repeat") == 0) { repeat = std::max(atoi(val), 1); i++; }
+        else if (strcmp(arg, "--verbose") == 0) { g_sim_verbose = true; }
+        else if (arg[0] != '-' && !workload_path) { workload_path = arg; }
+        else { print_usage(); return 1; }
+    }
+
+    if (!workload_path)
+    {
+        print_usage();
+        return 1;
+    }
+
+    std::vector<sim_command_t> workload;
+    FILE *f = fopen(workload_path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "Could not open workload file %s\n", workload_path);
+        return 1;
+    }
+
+    char line[256];
+    sim_command_t cmd;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (parse_line(line, &cmd))
+        {
+            workload.push_back(cmd);
+        }
+    }
+    fclose(f);
+
+    zuluscsi_setup();
+
+    // Let the firmware finish the bus reset processing
+    uint64_t start = g_sim_time_ns;
+    while (g_sim_time_ns - start < 1000000000ULL)
+    {
+        zuluscsi_main_loop();
+    }
+
+    bool targets_seen[8] = {false};
+    for (const sim_command_t &c : workload)
+    {
+        if (!targets_seen[c.target_id & 7])
+        {
+            targets_seen[c.target_id & 7] = true;
+            clear_unit_attention(c.target_id & 7);
+        }
+    }
+
+    std::map<uint8_t, sim_opcode_stats_t> stats;
+    uint64_t total_ns = 0;
+    uint64_t total_bytes = 0;
+    uint32_t timeouts = 0;
+
+    for (int r = 0; r < repeat; r++)
+    {
+        for (const sim_command_t &c : workload)
+        {
+            uint64_t cmd_start = g_sim_time_ns;
+            bool ok = run_command(&c);
+            uint64_t elapsed = g_sim_time_ns - cmd_start;
+
+            sim_opcode_stats_t &s = stats[c.cdb[0]];
+            uint32_t bytes = g_sim_scsi_host.data_in_bytes + g_sim_scsi_host.data_out_bytes;
+            s.latency_ns.push_back(elapsed);
+            s.bytes += bytes;
+            total_ns += elapsed;
+            total_bytes += bytes;
+
+            if (!ok)
+            {
+                timeouts++;
+                s.errors++;
+                fprintf(stderr, "Command 0x%02X to ID %d timed out\n", c.cdb[0], c.target_id);
+                break;
+            }
+            else if (g_sim_scsi_host.status != 0)
+            {
+                s.errors++;
+            }
+        }
+
+        if (timeouts) break;
+    }
+
+    printf("Opcode  Count  Errors     Avg us     p50 us     p99 us     Max us     kB/s\n");
+    for (auto &entry : stats)
+    {
+        sim_opcode_stats_t &s = entry.second;
+        std::vector<uint64_t> &lat = s.latency_ns;
+        std::sort(lat.begin(), lat.end());
+
+        uint64_t sum = 0;
+        for (uint64_t v : lat) sum += v;
+
+        size_t n = lat.size();
+        printf("0x%02X  %7d %7d %10.1f %10.1f %10.1f %10.1f %8d\n",
+            entry.first, (int)n, (int)s.errors,
+            sum / 1000.0 / n,
+            lat[n / 2] / 1000.0,
+            lat[std::min(n - 1, n * 99 / 100)] / 1000.0,
+            lat[n - 1] / 1000.0,
+            (int)(sum > 0 ? s.bytes * 1000000ULL / sum : 0));
+    }
+
+    printf("Total %d commands, %d kB in %.3f ms, %d kB/s\n",
+        (int)(workload.size() * repeat), (int)(total_bytes / 1024), total_ns / 1000000.0,
+        (int)(total_ns > 0 ? total_bytes * 1000000ULL / total_ns : 0));
+
+    return timeouts ? 2 : 0;
+}
@@ -25,9 +25,13 @@
 #include <ZuluSCSI_platform.h>
 #include "ZuluSCSI.h"
 #include "ZuluSCSI_log.h"
+#include "ZuluSCSI_log_trace.h"
 #include "ZuluSCSI_config.h"
 #include "ZuluSCSI_settings.h"
+#include "ZuluSCSI_lz.h"
 #include <minIni.h>
+#include <zip_parser.h>
+#include <stdlib.h>
 #include <strings.h>
 #include <string.h>
 #include <assert.h>
@@ -40,11 +44,21 @@ ImageBackingStore::ImageBackingStore()
     m_israw = false;
     g_rawdrive_active = m_israw;
     m_isrom = false;
+    m_isram = false;
+    m_ramdata = nullptr;
+    m_ramsize = m_rampos = 0;
+    m_ramdirty = nullptr;
+    m_extents = nullptr;
+    m_extentcount = m_extentsectors = 0;
+    m_zso = nullptr;
+    m_iszip = false;
+    m_zipoffset = m_zipsize = 0;
     m_isreadonly_attr = false;
     m_blockdev = nullptr;
     m_bgnsector = m_endsector = m_cursector = 0;
     m_isfolder = false;
     m_foldername[0] = '\0';
+    m_filepath[0] = '\0';
 
 #if ENABLE_COW
     // Initialize COW members
@@ -103,6 +117,10 @@ ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_s
             m_isrom = true;
         }
     }
+    else if (strncasecmp(filename, "RAM:", 4) == 0)
+    {
+        _ram_open(filename + 4, scsi_block_size);
+    }
     else
     {
         if (SD.open(filename, O_RDONLY).isDir())
@@ -115,7 +133,11 @@ ImageBackingStore::ImageBackingStore(const char *filename, uint32_t scsi_block_s
         else
         {
             // Regular image file
-            _internal_open(filename);
+            if (_internal_open(filename))
+            {
+                strncpy(m_filepath, filename, sizeof(m_filepath));
+                m_filepath[sizeof(m_filepath)-1] = '\0';
+            }
         }
     }
 }
@@ -130,19 +152,25 @@ bool ImageBackingStore::_internal_open(const char *filename)
         logmsg("---- Image file is read-only, writes disabled");
     }
 
+    char fullpath[MAX_FILE_PATH * 2];
+    const char *path = filename;
     if (m_isfolder)
     {
-        char fullpath[MAX_FILE_PATH * 2];
         strncpy(fullpath, m_foldername, sizeof(fullpath) - strlen(fullpath));
         strncat(fullpath, "/", sizeof(fullpath) - strlen(fullpath));
         strncat(fullpath, filename, sizeof(fullpath) - strlen(fullpath));
-        m_fsfile = SD.open(fullpath, open_flag);
-    }
-    else
-    {
-        m_fsfile = SD.open(filename, open_flag);
+        path = fullpath;
     }
 
+    free(m_extents);
+    m_extents = nullptr;
+    m_extentcount = 0;
+    free(m_zso);
+    m_zso = nullptr;
+    m_iszip = false;
+    m_zipoffset = m_zipsize = 0;
+    m_fsfile = SD.open(path, open_flag);
+
     if (!m_fsfile.isOpen())
     {
 #ifdef CONTAINER_IMAGE_SUPPORT
@@ -157,9 +185,34 @@ bool ImageBackingStore::_internal_open(const char *filename)
         return false;
     }
 
-    uint32_t sectorcount = m_fsfile.size() / SD_SECTOR_SIZE;
+    const char *extension = strrchr(path, '.');
+    if (extension && strcasecmp(extension, ".zso") == 0)
+    {
+        // Compressed blocks are at arbitrary file offsets,
+        // so they are always accessed through SdFat.
+        if (!_zso_open())
+        {
+            m_fsfile.close();
+            return false;
+        }
+        return true;
+    }
+
+    if (extension && strcasecmp(extension, ".zip") == 0)
+    {
+        if (!_zip_open())
+        {
+            m_fsfile.close();
+            return false;
+        }
+    }
+
+    uint64_t datasize = m_iszip ? m_zipsize : m_fsfile.size();
+    uint32_t sectorcount = datasize / SD_SECTOR_SIZE;
+    uint32_t firstsector = m_zipoffset / SD_SECTOR_SIZE;
     uint32_t begin = 0, end = 0;
-    if (m_fsfile.contiguousRange(&begin, &end) && end >= begin + sectorcount - 1)
+    if (m_zipoffset % SD_SECTOR_SIZE == 0 &&
+        m_fsfile.contiguousRange(&begin, &end) && end >= begin + firstsector + sectorcount - 1)
     {
         // Convert to raw mapping, this avoids some unnecessary
         // access overhead in SdFat library.
@@ -167,9 +220,10 @@ bool ImageBackingStore::_internal_open(const char *filename)
         // back to SdFat access mode.
         m_iscontiguous = true;
         m_blockdev = SD.card();
+        begin += firstsector;
         m_bgnsector = begin;
 
-        if (end != begin + sectorcount)
+        if (end != begin + sectorcount && !m_iszip)
         {
             uint32_t allocsize = end - begin + 1;
             // Due to issue #80 in ZuluSCSI version 1.0.8 and 1.0.9 the allocated size was mistakenly reported to SCSI controller.
@@ -185,6 +239,635 @@ bool ImageBackingStore::_internal_open(const char *filename)
         m_endsector = begin + sectorcount - 1;
         m_fsfile.flush(); // Note: m_fsfile is also kept open as a fallback.
     }
+#ifdef CONTAINER_IMAGE_SUPPORT
+    else if (!isContainer() && !m_iszip)
+#else
+    else if (!m_iszip)
+#endif
+    {
+        _extent_map_open(path);
+    }
+
+    return true;
+}
+
+// Walk the cluster chain of a fragmented file once and store the
+// runs of consecutive SD card sectors. Sequential seeks only advance
+// one cluster at a time in SdFat, so this reads each FAT sector once.
+bool ImageBackingStore::_extent_map_open(const char *path)
+{
+    FsFile file = SD.open(path, O_RDONLY);
+    uint64_t size = file.size();
+    uint32_t firstsector = file.firstSector();
+    uint32_t clustersize = SD.vol()->bytesPerCluster();
+    uint32_t sectorspercluster = clustersize / SD_SECTOR_SIZE;
+    if (!file.isOpen() || firstsector == 0 || size < SD_SECTOR_SIZE ||
+        sectorspercluster == 0 || size / SD_SECTOR_SIZE > 0xFFFFFFFF)
+    {
+        return false;
+    }
+
+    image_extent_t *extents = (image_extent_t*)malloc(sizeof(image_extent_t) * IMAGE_EXTENT_MAP_MAX);
+    if (!extents)
+    {
+        return false;
+    }
+
+    uint32_t count = 0;
+    uint32_t heapstart = 0;
+    for (uint64_t pos = 0; pos < size; pos += clustersize)
+    {
+        // SdFat tracks the cluster that contains the byte before current position
+        fspos_t fpos;
+        if (!file.seekSet(pos + 1))
+        {
+            count = 0;
+            break;
+        }
+        file.fgetpos(&fpos);
+
+        if (pos == 0)
+        {
+            // Sector of cluster number 0, wraps around as cluster numbering starts at 2
+            heapstart = firstsector - fpos.cluster * sectorspercluster;
+        }
+
+        uint32_t imgsector = pos / SD_SECTOR_SIZE;
+        uint32_t sdsector = heapstart + fpos.cluster * sectorspercluster;
+        if (count > 0 && extents[count - 1].sdsector + (imgsector - extents[count - 1].imgsector) == sdsector)
+        {
+            // Continues previous extent
+            continue;
+        }
+
+        if (count >= IMAGE_EXTENT_MAP_MAX)
+        {
+            dbgmsg("---- Image file has more than ", (int)IMAGE_EXTENT_MAP_MAX, " fragments, not using extent map");
+            count = 0;
+            break;
+        }
+
+        extents[count].imgsector = imgsector;
+        extents[count].sdsector = sdsector;
+        count++;
+
+        if ((count & 63) == 0)
+        {
+            platform_reset_watchdog();
+        }
+    }
+    file.close();
+
+    if (count == 0)
+    {
+        free(extents);
+        return false;
+    }
+
+    m_extents = (image_extent_t*)realloc(extents, sizeof(image_extent_t) * count);
+    if (!m_extents) m_extents = extents;
+    m_extentcount = count;
+    m_extentsectors = size / SD_SECTOR_SIZE;
+    m_cursector = 0;
+    m_blockdev = SD.card();
+    m_fsfile.flush(); // Note: m_fsfile is also kept open as a fallback.
+    return true;
+}
+
+// Transfer sectors starting at m_cursector through the extent map
+bool ImageBackingStore::_extent_transfer(uint8_t *buf, uint32_t sectorcount, bool write)
+{
+    while (sectorcount > 0)
+    {
+        // Find the last extent that begins at or before current sector
+        uint32_t lo = 0;
+        uint32_t hi = m_extentcount - 1;
+        while (lo < hi)
+        {
+            uint32_t mid = (lo + hi + 1) / 2;
+            if (m_extents[mid].imgsector <= m_cursector)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+
+        uint32_t extent_end = (lo + 1 < m_extentcount) ? m_extents[lo + 1].imgsector : m_extentsectors;
+        uint32_t sdsector = m_extents[lo].sdsector + (m_cursector - m_extents[lo].imgsector);
+        uint32_t len = extent_end - m_cursector;
+        if (len > sectorcount) len = sectorcount;
+
+        bool status;
+        if (write)
+            status = m_blockdev->writeSectors(sdsector, buf, len);
+        else
+            status = m_blockdev->readSectors(sdsector, buf, len);
+
+        if (!status)
+        {
+            return false;
+        }
+
+        m_cursector += len;
+        buf += len * SD_SECTOR_SIZE;
+        sectorcount -= len;
+    }
+
+    return true;
+}
+
+// Find the first file that is stored without compression in a .zip archive.
+// Only the local file headers are parsed, directory entries are skipped.
+bool ImageBackingStore::_zip_open()
+{
+    zipparser::Parser parser;
+    parser.SetMatchAnyFilename();
+
+    uint8_t buf[512];
+    uint64_t pos = 0;
+    while (true)
+    {
+        if (!m_fsfile.seek(pos))
+        {
+            return false;
+        }
+
+        int bytes_read = m_fsfile.read(buf, sizeof(buf));
+        if (bytes_read <= 0)
+        {
+            logmsg("---- Error: no file stored without compression found in .zip archive");
+            return false;
+        }
+
+        int32_t parsed_length = parser.Parse(buf, bytes_read);
+        if (parsed_length == bytes_read)
+        {
+            // Header continues in next buffer
+            pos += bytes_read;
+            continue;
+        }
+        else if (parsed_length < 0)
+        {
+            logmsg("---- Error: no file stored without compression found in .zip archive");
+            return false;
+        }
+
+        uint64_t datastart = pos + parsed_length;
+        uint64_t datasize = parser.GetCompressedSize64();
+        if (parser.IsCompressed())
+        {
+            // Compressed files are skipped, but only if the local header has their size
+            if (datasize == 0)
+            {
+                logmsg("---- Error: compressed file in .zip archive has no size in its header, cannot look past it");
+                return false;
+            }
+            dbgmsg("---- Skipping compressed file in .zip archive at offset ", (int)pos);
+        }
+        else if (parser.FoundMatch() && datasize > 0)
+        {
+            if (datastart + datasize > m_fsfile.size())
+            {
+                logmsg("---- Error: .zip archive is truncated");
+                return false;
+            }
+
+            m_iszip = true;
+            m_zipoffset = datastart;
+            m_zipsize = datasize;
+            logmsg("---- Using file at offset ", (int)datastart, " in .zip archive, size ", (int)(datasize / 1024), " kB");
+            if (datastart % SD_SECTOR_SIZE != 0)
+            {
+                logmsg("---- File data in .zip is not aligned to 512 bytes, direct SD card access is not possible");
+            }
+            return m_fsfile.seek(m_zipoffset);
+        }
+
+        parser.Reset();
+        pos = datastart + datasize;
+    }
+}
+
+// ZSO image format consists of 24-byte header, block index and block data.
+// Index has one entry per block and one extra entry for end of data.
+// Each entry is the file offset of the block shifted right by header align
+// field. The highest bit marks blocks that are stored uncompressed.
+#define ZSO_HEADER_SIZE 24
+#define ZSO_INDEX_PLAIN 0x80000000
+#define ZSO_INDEX_OFFSET(entry, align) ((uint64_t)((entry) & ~ZSO_INDEX_PLAIN) << (align))
+
+bool ImageBackingStore::_zso_open()
+{
+    uint8_t hdr[ZSO_HEADER_SIZE];
+    if (m_fsfile.read(hdr, sizeof(hdr)) != sizeof(hdr) || memcmp(hdr, "ZISO", 4) != 0)
+    {
+        logmsg("---- Error: image is not a valid .zso file");
+        return false;
+    }
+
+    uint32_t hdrsize = hdr[4] | (hdr[5] << 8) | (hdr[6] << 16) | ((uint32_t)hdr[7] << 24);
+    uint64_t size = 0;
+    for (int i = 15; i >= 8; i--) size = (size << 8) | hdr[i];
+    uint32_t blocksize = hdr[16] | (hdr[17] << 8) | (hdr[18] << 16) | ((uint32_t)hdr[19] << 24);
+    uint8_t version = hdr[20];
+    uint8_t align = hdr[21];
+
+    uint8_t blockshift = 0;
+    while (blockshift < 31 && (1UL << blockshift) < blocksize) blockshift++;
+
+    if (hdrsize != ZSO_HEADER_SIZE || version > 1 || align > 31 ||
+        blocksize < SD_SECTOR_SIZE || blocksize > 65536 || (1UL << blockshift) != blocksize ||
+        (size >> blockshift) >= 0xFFFFFFFF)
+    {
+        logmsg("---- Error: unsupported .zso header, block size ", (int)blocksize, ", version ", (int)version);
+        return false;
+    }
+
+    // Staging buffer must fit at least one block.
+    // Uncompressible blocks are stored as is, but alignment may add padding.
+    uint32_t stagesize = IMAGE_ZSO_READ_SIZE;
+    if (stagesize < blocksize + (1UL << align)) stagesize = blocksize + (1UL << align);
+
+    image_zso_t *zso = (image_zso_t*)malloc(sizeof(image_zso_t) + blocksize + stagesize);
+    if (!zso)
+    {
+        logmsg("---- Error: not enough RAM for .zso decompression buffers");
+        return false;
+    }
+
+    zso->size = size;
+    zso->pos = 0;
+    zso->blocksize = blocksize;
+    zso->blockshift = blockshift;
+    zso->align = align;
+    zso->indexstart = zso->indexcount = 0;
+    zso->cachedblock = UINT32_MAX;
+    zso->cache = (uint8_t*)(zso + 1);
+    zso->stage = zso->cache + blocksize;
+    zso->stagesize = stagesize;
+    m_zso = zso;
+
+    if (!_zso_load_index(0))
+    {
+        logmsg("---- Error: could not read .zso block index");
+        free(m_zso);
+        m_zso = nullptr;
+        return false;
+    }
+
+    logmsg("---- Compressed .zso image, ", (int)(size / 1024), " kB in ", (int)blocksize, " byte blocks");
+    return true;
+}
+
+// Load index window starting at given block
+bool ImageBackingStore::_zso_load_index(uint32_t block)
+{
+    image_zso_t *zso = m_zso;
+    uint32_t blocks = (zso->size + zso->blocksize - 1) >> zso->blockshift;
+    if (block >= blocks) return false;
+
+    uint32_t count = blocks + 1 - block;
+    if (count > IMAGE_ZSO_INDEX_WINDOW + 1) count = IMAGE_ZSO_INDEX_WINDOW + 1;
+
+    // Index entries are little endian, same as the supported platforms
+    zso->indexcount = 0;
+    if (!m_fsfile.seek(ZSO_HEADER_SIZE + (uint64_t)block * 4) ||
+        m_fsfile.read(zso->index, count * 4) != (int)(count * 4))
+    {
+        return false;
+    }
+
+    zso->indexstart = block;
+    zso->indexcount = count;
+    return true;
+}
+
+// Decompress up to maxblocks consecutive blocks to dst, reading their
+// compressed data with a single SD card access.
+// Returns number of blocks decompressed, or 0 on error.
+uint32_t ImageBackingStore::_zso_read_blocks(uint8_t *dst, uint32_t block, uint32_t maxblocks)
+{
+    image_zso_t *zso = m_zso;
+    if (block < zso->indexstart || block + 1 >= zso->indexstart + zso->indexcount)
+    {
+        if (!_zso_load_index(block)) return 0;
+    }
+
+    uint32_t first = block - zso->indexstart;
+    uint32_t avail = zso->indexcount - 1 - first;
+    if (maxblocks > avail) maxblocks = avail;
+
+    // Collect blocks while their data fits in the staging buffer
+    uint64_t start = ZSO_INDEX_OFFSET(zso->index[first], zso->align);
+    uint64_t end = start;
+    uint32_t count = 0;
+    while (count < maxblocks)
+    {
+        uint64_t next = ZSO_INDEX_OFFSET(zso->index[first + count + 1], zso->align);
+        if (next < end || next - start > zso->stagesize) break;
+        end = next;
+        count++;
+    }
+
+    if (count == 0)
+    {
+        logmsg("---- Error: corrupt .zso index at block ", (int)block);
+        return 0;
+    }
+
+    if (!m_fsfile.seek(start) || m_fsfile.read(zso->stage, end - start) != (int)(end - start))
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t entry = zso->index[first + i];
+        uint64_t offset = ZSO_INDEX_OFFSET(entry, zso->align);
+        const uint8_t *src = zso->stage + (offset - start);
+        uint32_t srclen = ZSO_INDEX_OFFSET(zso->index[first + i + 1], zso->align) - offset;
+
+        // Last block can be shorter than block size.
+        // Stored data may have alignment padding after the block.
+        uint64_t blockpos = (uint64_t)(block + i) << zso->blockshift;
+        uint32_t len = zso->blocksize;
+        if (len > zso->size - blockpos) len = zso->size - blockpos;
+
+        if (entry & ZSO_INDEX_PLAIN)
+        {
+            if (srclen < len) return 0;
+            memcpy(dst, src, len);
+        }
+        else if (lz_decompress_partial(src, srclen, dst, len) != len)
+        {
+            logmsg("---- Error: corrupt compressed data in .zso block ", (int)(block + i));
+            return 0;
+        }
+
+        dst += zso->blocksize;
+    }
+
+    return count;
+}
+
+ssize_t ImageBackingStore::_zso_read(uint8_t *buf, size_t count)
+{
+    image_zso_t *zso = m_zso;
+    if (zso->pos >= zso->size) return 0;
+    if (count > zso->size - zso->pos) count = zso->size - zso->pos;
+
+    size_t done = 0;
+    while (done < count)
+    {
+        uint32_t block = zso->pos >> zso->blockshift;
+        uint32_t offset = zso->pos & (zso->blocksize - 1);
+        size_t len = zso->blocksize - offset;
+        if (len > count - done) len = count - done;
+
+        if (offset == 0 && len == zso->blocksize && block != zso->cachedblock)
+        {
+            // Whole blocks are decompressed directly to destination
+            uint32_t blocks = _zso_read_blocks(buf + done, block, (count - done) >> zso->blockshift);
+            if (blocks == 0) return -1;
+            len = (size_t)blocks << zso->blockshift;
+        }
+        else
+        {
+            // Partial block reads go through the cache, so that
+            // reading a block in pieces decompresses it only once.
+            if (block != zso->cachedblock)
+            {
+                zso->cachedblock = UINT32_MAX;
+                if (_zso_read_blocks(zso->cache, block, 1) != 1) return -1;
+                zso->cachedblock = block;
+            }
+            memcpy(buf + done, zso->cache + offset, len);
+        }
+
+        zso->pos += len;
+        done += len;
+    }
+
+    return count;
+}
+
+ImageBackingStore::~ImageBackingStore()
+{
+    if (m_isram)
+    {
+        _ram_close();
+    }
+
+    free(m_extents);
+    free(m_zso);
+}
+
+bool ImageBackingStore::_ram_open(const char *params, uint32_t scsi_block_size)
+{
+    char *endptr;
+    uint64_t size = strtoul(params, &endptr, 0);
+    if (*endptr == 'k' || *endptr == 'K')
+    {
+        size *= 1024;
+        endptr++;
+    }
+    else if (*endptr == 'm' || *endptr == 'M')
+    {
+        size *= 1024 * 1024;
+        endptr++;
+    }
+
+    const char *filename = nullptr;
+    if (*endptr == ':' && endptr[1] != '\0')
+    {
+        filename = endptr + 1;
+    }
+    else if (*endptr != '\0')
+    {
+        logmsg("Invalid format for RAM disk filename: RAM:", params);
+        return false;
+    }
+
+    bool save = false;
+    if (filename)
+    {
+        if (!SD.exists(filename))
+        {
+            logmsg("---- Creating RAM disk image file ", filename);
+            m_fsfile = SD.open(filename, O_RDWR | O_CREAT);
+            save = true;
+        }
+        else if (FS_ATTRIB_READ_ONLY & SD.attrib(filename))
+        {
+            logmsg("---- RAM disk image file is read-only, changes will not be saved");
+            m_fsfile = SD.open(filename, O_RDONLY);
+        }
+        else
+        {
+            m_fsfile = SD.open(filename, O_RDWR);
+            save = true;
+        }
+
+        if (save)
+        {
+            // Kept for reopening the file if SD card is removed and inserted again
+            strncpy(m_filepath, filename, sizeof(m_filepath));
+            m_filepath[sizeof(m_filepath)-1] = '\0';
+        }
+
+        if (!m_fsfile.isOpen())
+        {
+            logmsg("---- Failed to open RAM disk image file ", filename);
+            return false;
+        }
+
+        if (size == 0)
+        {
+            size = m_fsfile.size();
+        }
+    }
+
+    size -= size % scsi_block_size;
+    if (size == 0 || size > 0xFFFFFFFF - RAMDISK_CHUNK_SIZE)
+    {
+        logmsg("---- Invalid RAM disk size: RAM:", params);
+        m_fsfile.close();
+        return false;
+    }
+
+#ifdef PLATFORM_HAS_RAMDISK_ALLOC
+    m_ramdata = (uint8_t*)platform_ramdisk_alloc(size);
+#else
+    m_ramdata = (uint8_t*)malloc(size);
+#endif
+    if (!m_ramdata)
+    {
+        logmsg("---- Not enough memory for RAM disk of ", (int)(size / 1024), " kB");
+        m_fsfile.close();
+        return false;
+    }
+
+    m_isram = true;
+    m_ramsize = size;
+    m_rampos = 0;
+    memset(m_ramdata, 0, m_ramsize);
+
+    uint32_t loadsize = 0;
+    if (m_fsfile.isOpen())
+    {
+        // Load in chunks to keep the watchdog happy with large images
+        while (loadsize < m_ramsize && loadsize < m_fsfile.size())
+        {
+            uint32_t len = m_ramsize - loadsize;
+            if (len > RAMDISK_CHUNK_SIZE) len = RAMDISK_CHUNK_SIZE;
+            int status = m_fsfile.read(m_ramdata + loadsize, len);
+            if (status <= 0) break;
+            loadsize += status;
+            platform_reset_watchdog();
+        }
+        logmsg("---- Loaded ", (int)(loadsize / 1024), " kB to RAM disk from ", filename);
+    }
+
+    if (save)
+    {
+        uint32_t chunks = (m_ramsize + RAMDISK_CHUNK_SIZE - 1) / RAMDISK_CHUNK_SIZE;
+        m_ramdirty = (uint32_t*)calloc((chunks + 31) / 32, sizeof(uint32_t));
+        if (!m_ramdirty)
+        {
+            logmsg("---- Not enough memory for RAM disk change tracking, changes will not be saved");
+        }
+        else
+        {
+            // Parts not in the file yet are written out on first sync, so that
+            // the file always grows sequentially.
+            for (uint32_t i = loadsize / RAMDISK_CHUNK_SIZE; i < chunks; i++)
+            {
+                m_ramdirty[i / 32] |= (1UL << (i % 32));
+            }
+        }
+    }
+
+    logmsg("---- RAM disk size ", (int)(m_ramsize / 1024), " kB");
+    return true;
+}
+
+void ImageBackingStore::_ram_close()
+{
+    sync();
+
+#ifdef PLATFORM_HAS_RAMDISK_ALLOC
+    platform_ramdisk_free(m_ramdata);
+#else
+    free(m_ramdata);
+#endif
+    free(m_ramdirty);
+    m_ramdata = nullptr;
+    m_ramdirty = nullptr;
+    m_ramsize = m_rampos = 0;
+    m_isram = false;
+    m_filepath[0] = '\0';
+    m_fsfile.close();
+}
+
+void ImageBackingStore::detachFile()
+{
+    if (m_isram)
+    {
+        m_fsfile.close();
+    }
+}
+
+bool ImageBackingStore::sync()
+{
+    if (!m_isram || !m_ramdirty)
+    {
+        return true;
+    }
+
+    if (!m_fsfile.isOpen())
+    {
+        // File was closed when SD card was removed, reopen it once a card is present
+        if (!g_sdcard_present || m_filepath[0] == '\0')
+        {
+            return false;
+        }
+
+        m_fsfile = SD.open(m_filepath, O_RDWR);
+        if (!m_fsfile.isOpen())
+        {
+            logmsg("RAM disk image file ", m_filepath, " not found on SD card, changes not saved");
+            return false;
+        }
+    }
+
+    uint32_t chunks = (m_ramsize + RAMDISK_CHUNK_SIZE - 1) / RAMDISK_CHUNK_SIZE;
+    uint32_t saved = 0;
+    for (uint32_t i = 0; i < chunks; i++)
+    {
+        if (!(m_ramdirty[i / 32] & (1UL << (i % 32))))
+        {
+            continue;
+        }
+
+        uint32_t offset = i * RAMDISK_CHUNK_SIZE;
+        uint32_t len = m_ramsize - offset;
+        if (len > RAMDISK_CHUNK_SIZE) len = RAMDISK_CHUNK_SIZE;
+
+        if (!m_fsfile.seek(offset) || m_fsfile.write(m_ramdata + offset, len) != len)
+        {
+            logmsg("RAM disk save failed at offset ", (int)offset, ": ", SD.sdErrorCode());
+            return false;
+        }
+
+        m_ramdirty[i / 32] &= ~(1UL << (i % 32));
+        saved++;
+        platform_reset_watchdog();
+    }
+
+    if (saved > 0)
+    {
+        m_fsfile.flush();
+        dbgmsg("---- Saved ", (int)saved, " changed chunks of RAM disk");
+    }
 
     return true;
 }
@@ -196,7 +879,15 @@ void ImageBackingStore::revert_to_noncontiguous()
         // Revert from direct SD card access to filesystem based access.
         // Keep the seek position.
         m_iscontiguous = false;
-        m_fsfile.seek((m_cursector - m_bgnsector) * SD_SECTOR_SIZE);
+        m_fsfile.seek(m_zipoffset + (uint64_t)(m_cursector - m_bgnsector) * SD_SECTOR_SIZE);
+    }
+    else if (m_extents)
+    {
+        // Revert from extent map to filesystem based access.
+        free(m_extents);
+        m_extents = nullptr;
+        m_extentcount = 0;
+        m_fsfile.seek((uint64_t)m_cursector * SD_SECTOR_SIZE);
     }
 }
 
@@ -214,6 +905,10 @@ bool ImageBackingStore::isOpen()
         {
             return (m_romhdr.imagesize > 0);
         }
+        else if (m_isram)
+        {
+            return m_ramdata != nullptr;
+        }
         return false;
     }
     else
@@ -222,6 +917,8 @@ bool ImageBackingStore::isOpen()
             return (m_blockdev != NULL);
         else if (m_isrom)
             return (m_romhdr.imagesize > 0);
+        else if (m_isram)
+            return m_ramdata != nullptr;
         else if (m_isfolder)
             return m_foldername[0] != '\0';
         else
@@ -239,7 +936,7 @@ bool ImageBackingStore::isWritable()
     }
 #endif
 
-    return !m_isrom && !m_isreadonly_attr;
+    return !m_isrom && !m_isreadonly_attr && !m_zso;
 }
 
 bool ImageBackingStore::isRaw()
@@ -252,6 +949,11 @@ bool ImageBackingStore::isRom()
     return m_isrom;
 }
 
+bool ImageBackingStore::isRam()
+{
+    return m_isram;
+}
+
 bool ImageBackingStore::isFolder()
 {
 #if ENABLE_COW
@@ -268,6 +970,21 @@ bool ImageBackingStore::isContiguous()
     return m_iscontiguous;
 }
 
+uint32_t ImageBackingStore::extentCount()
+{
+    return m_extentcount;
+}
+
+bool ImageBackingStore::isCompressed()
+{
+    return m_zso != nullptr;
+}
+
+bool ImageBackingStore::isZip()
+{
+    return m_iszip;
+}
+
 bool ImageBackingStore::close()
 {
 #if ENABLE_COW
@@ -288,8 +1005,18 @@ bool ImageBackingStore::close()
         m_romhdr.imagesize = 0;
         return true;
     }
+    else if (m_isram)
+    {
+        _ram_close();
+        return true;
+    }
     else
     {
+        free(m_extents);
+        m_extents = nullptr;
+        m_extentcount = 0;
+        free(m_zso);
+        m_zso = nullptr;
         return m_fsfile.close();
     }
 }
@@ -312,6 +1039,18 @@ uint64_t ImageBackingStore::size()
     {
         return m_romhdr.imagesize;
     }
+    else if (m_isram)
+    {
+        return m_ramsize;
+    }
+    else if (m_zso)
+    {
+        return m_zso->size;
+    }
+    else if (m_iszip)
+    {
+        return m_zipsize;
+    }
     else
     {
         return m_fsfile.size();
@@ -332,6 +1071,10 @@ bool ImageBackingStore::contiguousRange(uint32_t* bgnSector, uint32_t* endSector
         *endSector = 0;
         return true;
     }
+    else if (m_isram || m_zso || m_iszip)
+    {
+        return false;
+    }
     else
     {
         return m_fsfile.contiguousRange(bgnSector, endSector);
@@ -350,7 +1093,7 @@ bool ImageBackingStore::seek(uint64_t pos)
 
     uint32_t sectornum = pos / SD_SECTOR_SIZE;
 
-    if (m_iscontiguous && (uint64_t)sectornum * SD_SECTOR_SIZE != pos)
+    if ((m_iscontiguous || m_extents) && (uint64_t)sectornum * SD_SECTOR_SIZE != pos)
     {
         dbgmsg("---- Unaligned access to image, falling back to SdFat access mode");
         revert_to_noncontiguous();
@@ -368,6 +1111,28 @@ bool ImageBackingStore::seek(uint64_t pos)
         m_cursector = sectornum;
         return m_cursector * SD_SECTOR_SIZE < m_romhdr.imagesize;
     }
+    else if (m_isram)
+    {
+        if (pos > m_ramsize) return false;
+        m_rampos = pos;
+        return true;
+    }
+    else if (m_zso)
+    {
+        if (pos > m_zso->size) return false;
+        m_zso->pos = pos;
+        return true;
+    }
+    else if (m_extents)
+    {
+        m_cursector = sectornum;
+        return (pos <= m_fsfile.size());
+    }
+    else if (m_iszip)
+    {
+        if (pos > m_zipsize) return false;
+        return m_fsfile.seek(m_zipoffset + pos);
+    }
     else
     {
         return m_fsfile.seek(pos);
@@ -376,6 +1141,8 @@ bool ImageBackingStore::seek(uint64_t pos)
 
 ssize_t ImageBackingStore::read(void* buf, size_t count)
 {
+    scsiTraceSDTimer trace_timer;
+
 #if ENABLE_COW
     // Handle Copy-on-Write mode
     if (m_iscow)
@@ -385,7 +1152,8 @@ ssize_t ImageBackingStore::read(void* buf, size_t count)
 #endif
 
     uint32_t sectorcount = count / SD_SECTOR_SIZE;
-    if (m_iscontiguous && (uint64_t)sectorcount * SD_SECTOR_SIZE != count)
+    if ((m_iscontiguous || m_extents) && ((uint64_t)sectorcount * SD_SECTOR_SIZE != count ||
+        (m_extents && (uint64_t)m_cursector + sectorcount > m_extentsectors)))
     {
         dbgmsg("---- Unaligned access to image, falling back to SdFat access mode");
         revert_to_noncontiguous();
@@ -418,14 +1186,39 @@ ssize_t ImageBackingStore::read(void* buf, size_t count)
             return -1;
         }
     }
+    else if (m_isram)
+    {
+        if (count > m_ramsize - m_rampos) count = m_ramsize - m_rampos;
+        memcpy(buf, m_ramdata + m_rampos, count);
+        m_rampos += count;
+        return count;
+    }
+    else if (m_zso)
+    {
+        return _zso_read((uint8_t*)buf, count);
+    }
+    else if (m_extents)
+    {
+        return _extent_transfer((uint8_t*)buf, sectorcount, false) ? (ssize_t)count : -1;
+    }
     else
     {
+        if (m_iszip)
+        {
+            // Stay within the file data in the archive
+            uint64_t end = m_zipoffset + m_zipsize;
+            uint64_t pos = m_fsfile.curPosition();
+            if (pos >= end) return 0;
+            if (count > end - pos) count = end - pos;
+        }
         return m_fsfile.read(buf, count);
     }
 }
 
 ssize_t ImageBackingStore::write(const void* buf, size_t count)
 {
+    scsiTraceSDTimer trace_timer;
+
     #if ENABLE_COW
     // Handle Copy-on-Write mode
     if (m_iscow)
@@ -435,8 +1228,11 @@ ssize_t ImageBackingStore::write(const void* buf, size_t count)
 #endif
 
     uint32_t sectorcount = count / SD_SECTOR_SIZE;
-    if (m_iscontiguous && (uint64_t)sectorcount * SD_SECTOR_SIZE != count)
+    if ((m_iscontiguous || m_extents) && ((uint64_t)sectorcount * SD_SECTOR_SIZE != count ||
+        (m_iscontiguous && (uint64_t)m_cursector + sectorcount > (uint64_t)m_endsector + 1) ||
+        (m_extents && (uint64_t)m_cursector + sectorcount > m_extentsectors)))
     {
+        // Writes that extend the file also go through SdFat, so that clusters get allocated
         dbgmsg("---- Unaligned access to image, falling back to SdFat access mode");
         revert_to_noncontiguous();
     }
@@ -458,17 +1254,115 @@ ssize_t ImageBackingStore::write(const void* buf, size_t count)
         logmsg("ERROR: attempted to write to ROM drive");
         return 0;
     }
-    else  if (m_isreadonly_attr)
+    else if (m_isram)
+    {
+        if (count > m_ramsize - m_rampos) count = m_ramsize - m_rampos;
+        memcpy(m_ramdata + m_rampos, buf, count);
+
+        if (m_ramdirty && count > 0)
+        {
+            uint32_t last = (m_rampos + count - 1) / RAMDISK_CHUNK_SIZE;
+            for (uint32_t i = m_rampos / RAMDISK_CHUNK_SIZE; i <= last; i++)
+            {
+                m_ramdirty[i / 32] |= (1UL << (i % 32));
+            }
+        }
+
+        m_rampos += count;
+        return count;
+    }
+    else  if (m_isreadonly_attr || m_zso)
     {
         logmsg("ERROR: attempted to write to a read only image");
         return 0;
     }
+    else if (m_extents)
+    {
+        return _extent_transfer((uint8_t*)buf, sectorcount, true) ? (ssize_t)count : 0;
+    }
     else
     {
+        if (m_iszip)
+        {
+            // Writes must not overwrite rest of the archive
+            uint64_t end = m_zipoffset + m_zipsize;
+            uint64_t pos = m_fsfile.curPosition();
+            if (pos >= end) return 0;
+            if (count > end - pos) count = end - pos;
+        }
         return m_fsfile.write(buf, count);
     }
 }
 
+bool ImageBackingStore::canErase()
+{
+#if ENABLE_COW
+    if (m_iscow)
+    {
+        return false;
+    }
+#endif
+
+    return m_isram || (m_iscontiguous && m_blockdev && !m_isreadonly_attr);
+}
+
+bool ImageBackingStore::erase(uint64_t pos, uint64_t count)
+{
+#if ENABLE_COW
+    if (m_iscow)
+    {
+        return false;
+    }
+#endif
+
+    if (m_isram)
+    {
+        if (pos > m_ramsize || count > m_ramsize - pos) return false;
+        memset(m_ramdata + pos, 0, count);
+
+        if (m_ramdirty && count > 0)
+        {
+            uint32_t last = (pos + count - 1) / RAMDISK_CHUNK_SIZE;
+            for (uint32_t i = pos / RAMDISK_CHUNK_SIZE; i <= last; i++)
+            {
+                m_ramdirty[i / 32] |= (1UL << (i % 32));
+            }
+        }
+        return true;
+    }
+
+    if (!m_iscontiguous || !m_blockdev || m_isreadonly_attr ||
+        pos % SD_SECTOR_SIZE != 0 || count % SD_SECTOR_SIZE != 0 || count == 0)
+    {
+        return false;
+    }
+
+    uint64_t first = m_bgnsector + pos / SD_SECTOR_SIZE;
+    uint64_t last = first + count / SD_SECTOR_SIZE - 1;
+    if (last > m_endsector)
+    {
+        return false;
+    }
+
+    // Split large ranges so that single erase command does not run into timeout
+    while (first <= last)
+    {
+        uint64_t end = first + SD_ERASE_MAX_SECTORS - 1;
+        if (end > last) end = last;
+
+        if (!m_blockdev->erase(first, end))
+        {
+            logmsg("SD card erase of sectors ", (int)first, " to ", (int)end, " failed: ", SD.sdErrorCode());
+            return false;
+        }
+
+        first = end + 1;
+        platform_reset_watchdog();
+    }
+
+    return true;
+}
+
 void ImageBackingStore::flush()
 {
 #if ENABLE_COW
@@ -480,7 +1374,7 @@ void ImageBackingStore::flush()
     }
 #endif
 
-    if (!m_iscontiguous && !m_isrom && !m_isreadonly_attr)
+    if (!m_iscontiguous && !m_extents && !m_isrom && !m_isram && !m_isreadonly_attr && !m_zso)
     {
         m_fsfile.flush();
     }
@@ -488,14 +1382,14 @@ void ImageBackingStore::flush()
 
 bool ImageBackingStore::truncate(uint64_t size)
 {
-    if (m_isrom || m_israw || m_isreadonly_attr)
+    if (m_isrom || m_israw || m_isram || m_isreadonly_attr || m_zso || m_iszip)
     {
         logmsg("ERROR: truncate called on non-writable or non-regular file");
         return false;
     }
     else
     {
-        if (m_iscontiguous)
+        if (m_iscontiguous || m_extents)
         {
             revert_to_noncontiguous();
         }
@@ -513,9 +1407,21 @@ uint64_t ImageBackingStore::position()
     }
 #endif
 
-    if (!m_iscontiguous && !m_isrom)
+    if (m_isram)
+    {
+        return m_rampos;
+    }
+    else if (m_zso)
     {
-        return m_fsfile.curPosition();
+        return m_zso->pos;
+    }
+    else if (m_extents)
+    {
+        return (uint64_t)m_cursector * SD_SECTOR_SIZE;
+    }
+    else if (!m_iscontiguous && !m_isrom)
+    {
+        return m_fsfile.curPosition() - m_zipoffset;
     }
     else
     {
@@ -546,6 +1452,47 @@ bool ImageBackingStore::selectImageFile(const char *filename)
     return _internal_open(filename);
 }
 
+size_t ImageBackingStore::getFilepath(char* buf, size_t buflen)
+{
+    if (m_isram)
+        return 0;
+
+    size_t name_length = strlen(m_filepath);
+    if (name_length == 0 || name_length + 1 > buflen)
+        return 0;
+
+    strncpy(buf, m_filepath, buflen);
+    return name_length;
+}
+
+bool ImageBackingStore::reopen(const char *filename)
+{
+    if (m_isfolder || m_isram || m_isrom || m_israw)
+    {
+        logmsg("Attempted reopen() but image is not a regular file");
+        return false;
+    }
+
+    close();
+    if (m_fsfile.isOpen())
+    {
+        // Contiguous images keep the file open as fallback
+        m_fsfile.close();
+    }
+    m_iscontiguous = false;
+    m_blockdev = nullptr;
+    m_filepath[0] = '\0';
+
+    if (!_internal_open(filename))
+    {
+        return false;
+    }
+
+    strncpy(m_filepath, filename, sizeof(m_filepath));
+    m_filepath[sizeof(m_filepath)-1] = '\0';
+    return true;
+}
+
 size_t ImageBackingStore::getFoldername(char* buf, size_t buflen)
 {
     if (m_isfolder)
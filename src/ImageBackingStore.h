@@ -26,6 +26,9 @@
  * - Files on SD card
  * - Raw SD card partitions
  * - Microcontroller flash ROM drive
+ * - RAM disk, optionally loaded from and saved to a file on SD card
+ * - Block-compressed .zso images (read-only)
+ * - Files stored without compression inside .zip archives
  */
 
 #pragma once
@@ -50,6 +53,31 @@ extern "C" {
 extern SdFs SD;
 #define SD_SECTOR_SIZE 512
 
+// Run of image sectors that are consecutive on SD card.
+// The run ends where the next extent begins.
+typedef struct {
+    uint32_t imgsector;
+    uint32_t sdsector;
+} image_extent_t;
+
+// State of a block-compressed .zso image.
+// Only a window of the block index is kept in RAM, it is reloaded
+// from the file when access moves outside of it.
+typedef struct {
+    uint64_t size;          // Uncompressed image size in bytes
+    uint64_t pos;           // Current position in uncompressed image
+    uint32_t blocksize;     // Uncompressed block size, power of two
+    uint8_t blockshift;
+    uint8_t align;          // Index entries are file offsets shifted right by this
+    uint32_t indexstart;    // Block number of first entry in index window
+    uint32_t indexcount;    // Number of valid entries in index window
+    uint32_t index[IMAGE_ZSO_INDEX_WINDOW + 1];
+    uint32_t cachedblock;   // Block number stored in cache, or UINT32_MAX
+    uint8_t *cache;         // Last block decompressed for a partial read
+    uint8_t *stage;         // Compressed data of consecutive blocks
+    uint32_t stagesize;
+} image_zso_t;
+
 // This class wraps SdFat library FsFile to allow access
 // through either FAT filesystem or as a raw sector range.
 //
@@ -58,6 +86,20 @@ extern SdFs SD;
 //
 // If the platform supports a ROM drive, it is activated by using
 // filename "ROM:".
+//
+// RAM disk is activated by using filename like "RAM:16M" or "RAM:16M:swap.img",
+// where the number is the size in bytes with optional K or M suffix.
+// If a file is given, the RAM disk is loaded from it and the changed
+// parts are written back on sync() and when the image is closed.
+//
+// Fragmented image files are accessed through an extent map that is
+// built when the file is opened, which avoids FAT cluster chain lookups.
+//
+// Files with .zso extension are CD images compressed in 2 kB blocks with
+// LZ4. They are decompressed on the fly and cannot be written.
+//
+// For .zip files the first file stored without compression in the archive
+// is used as the image. Accesses are offset to the location of its data.
 class ImageBackingStore
 {
 public:
@@ -68,6 +110,7 @@ public:
     // Special filename formats:
     //    RAW:start:end
     //    ROM:
+    //    RAM:size[:filename]
     //    *.cow (enables copy-on-write)
     ImageBackingStore(const char *filename, uint32_t scsi_block_size, scsi_device_settings_t *device_config);
 
@@ -77,6 +120,9 @@ public:
     ImageBackingStore(ImageBackingStore &&) = delete;
     ImageBackingStore &operator=(ImageBackingStore &&) = delete;
 
+    // Saves and releases RAM disk
+    ~ImageBackingStore();
+
     // Can the image be read?
     bool isOpen();
 
@@ -89,12 +135,25 @@ public:
     // Is this internal ROM drive in microcontroller flash?
     bool isRom();
 
+    // Is this a RAM disk?
+    bool isRam();
+
     // Is the image a folder, which contains multiple files (used for .bin/.cue)
     bool isFolder();
 
     // Is this a contigious block on the SD card? Allowing less overhead
     bool isContiguous();
 
+    // Number of fragments in the extent map of the image file.
+    // Returns 0 if the image is not accessed through an extent map.
+    uint32_t extentCount();
+
+    // Is this a block-compressed image?
+    bool isCompressed();
+
+    // Is the image a file inside a .zip archive?
+    bool isZip();
+
     // Close the image so that .isOpen() will return false.
     bool close();
 
@@ -114,9 +173,27 @@ public:
     // Write data to image file, returns number of bytes written, or negative on error.
     ssize_t write(const void* buf, size_t count);
 
+    // Erase a range of the image using SD card erase command.
+    // Afterwards the range reads as all zeros or all ones, depending on the card.
+    // Only supported for images mapped directly to SD card sectors and RAM disks.
+    // Returns false if the range could not be erased.
+    bool erase(uint64_t pos, uint64_t count);
+
+    // Can erase() be used on this image?
+    bool canErase();
+
     // Flush any pending changes to filesystem
     void flush();
 
+    // Write RAM disk changes back to its image file on SD card.
+    // Does nothing for other image types.
+    bool sync();
+
+    // Close the image file of a RAM disk when SD card is removed.
+    // The RAM disk stays usable, and sync() reopens the file once
+    // a card is mounted again.
+    void detachFile();
+
     // Gets current position for following read/write operations
     // Result is only valid for regular files, not raw or flash access
     uint64_t position();
@@ -126,6 +203,14 @@ public:
 
     size_t getFilename(char* buf, size_t buflen);
 
+    // Get path of the image file on SD card.
+    // Returns 0 for images that are not regular files.
+    size_t getFilepath(char* buf, size_t buflen);
+
+    // Close the image file and open another file in its place.
+    // Used to swap in a defragmented copy with identical contents.
+    bool reopen(const char *filename);
+
     // Change image if the image is a folder (used for .cue with multiple .bin)
     bool selectImageFile(const char *filename);
     size_t getFoldername(char* buf, size_t buflen);
@@ -142,6 +227,18 @@ protected:
     bool m_isrom;
     bool m_isreadonly_attr;
     romdrive_hdr_t m_romhdr;
+    bool m_isram;
+    uint8_t *m_ramdata;
+    uint32_t m_ramsize;
+    uint32_t m_rampos;
+    uint32_t *m_ramdirty; // Bitmap of RAMDISK_CHUNK_SIZE chunks changed since last sync
+    image_extent_t *m_extents;
+    uint32_t m_extentcount;
+    uint32_t m_extentsectors; // Total number of sectors accessible through extent map
+    image_zso_t *m_zso;
+    bool m_iszip;
+    uint64_t m_zipoffset; // Start of image data in .zip file
+    uint64_t m_zipsize;
 #ifdef CONTAINER_IMAGE_SUPPORT
     ZuluContainerFs::ZCFsFile m_fsfile;
 #else
@@ -154,9 +251,23 @@ protected:
 
     bool m_isfolder;
     char m_foldername[MAX_FILE_PATH + 1];
+    char m_filepath[MAX_FILE_PATH + 1];
 
     bool _internal_open(const char *filename);
 
+    bool _ram_open(const char *params, uint32_t scsi_block_size);
+    void _ram_close();
+
+    bool _extent_map_open(const char *path);
+    bool _extent_transfer(uint8_t *buf, uint32_t sectorcount, bool write);
+
+    bool _zip_open();
+
+    bool _zso_open();
+    bool _zso_load_index(uint32_t block);
+    uint32_t _zso_read_blocks(uint8_t *dst, uint32_t block, uint32_t maxblocks);
+    ssize_t _zso_read(uint8_t *buf, size_t count);
+
     void revert_to_noncontiguous();
 
 #if ENABLE_COW
@@ -28,11 +28,15 @@
 #include "ZuluSCSI_config.h"
 #include <strings.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include "ui.h"
+#include "ZuluSCSI_lz.h"
+#include <minIni.h>
 
 extern "C" {
 #include <scsi.h>
+#include <crc32_ethernet.h>
 }
 
 extern SdFs SD;
@@ -63,6 +67,63 @@ bool romDriveRead(uint8_t *buf, uint32_t start, uint32_t count)
 
 #else
 
+// Header of the currently programmed drive, used by romDriveRead()
+static romdrive_hdr_t g_romdrive_hdr;
+
+// Cache of recently decompressed blocks for partial block reads
+#ifndef ROMDRIVE_CACHE_BLOCKS
+#define ROMDRIVE_CACHE_BLOCKS 2
+#endif
+
+// Buffers for compressed images, allocated only when one is used
+struct romdrive_lz_buffers_t {
+    struct {
+        uint32_t block;
+        uint32_t lastused;
+        bool valid;
+        uint8_t data[ROMDRIVE_COMP_BLOCKSIZE];
+    } cache[ROMDRIVE_CACHE_BLOCKS];
+
+    // Compressed data of one block, with room for 4-byte alignment of flash reads
+    uint32_t compbuf[ROMDRIVE_COMP_BLOCKSIZE / 4 + 2];
+};
+static romdrive_lz_buffers_t *g_romdrive_lz;
+static uint32_t g_romdrive_cache_counter;
+
+static void romDriveInvalidateCache()
+{
+    if (!g_romdrive_lz)
+        return;
+
+    for (int i = 0; i < ROMDRIVE_CACHE_BLOCKS; i++)
+    {
+        g_romdrive_lz->cache[i].valid = false;
+    }
+}
+
+static bool romDriveAllocBuffers()
+{
+    if (!g_romdrive_lz)
+    {
+        g_romdrive_lz = (romdrive_lz_buffers_t*)malloc(sizeof(romdrive_lz_buffers_t));
+        if (!g_romdrive_lz)
+        {
+            logmsg("ROM drive failed to allocate ", (int)sizeof(romdrive_lz_buffers_t), " bytes for decompression");
+            return false;
+        }
+        romDriveInvalidateCache();
+    }
+    return true;
+}
+
+// Let SCSI code send data that was decompressed to the stream buffer
+static void romDriveStreamFilled(const uint8_t *dest, uint32_t count)
+{
+#ifdef PLATFORM_HAS_ROMDRIVE_CALLBACK
+    platform_romdrive_stream_filled(dest, count);
+#endif
+}
+
 // Check if the romdrive is present
 bool romDriveCheckPresent(romdrive_hdr_t *hdr)
 {
@@ -84,12 +145,34 @@ bool romDriveCheckPresent(romdrive_hdr_t *hdr)
         return false;
     }
 
+    if (hdr->compression == ROMDRIVE_COMPRESSION_LZ)
+    {
+        if (hdr->comp_blocksize != ROMDRIVE_COMP_BLOCKSIZE || hdr->dataoffset >= platform_get_romdrive_maxsize())
+        {
+            logmsg("---- Unsupported compressed ROM drive block size ", (int)hdr->comp_blocksize);
+            return false;
+        }
+
+        if (!romDriveAllocBuffers())
+        {
+            return false;
+        }
+    }
+    else if (hdr->compression != ROMDRIVE_COMPRESSION_NONE)
+    {
+        logmsg("---- Unsupported ROM drive compression type ", (int)hdr->compression);
+        return false;
+    }
+
+    g_romdrive_hdr = *hdr;
     return true;
 }
 
 // Clear the drive metadata header
 bool romDriveClear()
 {
+    memset(&g_romdrive_hdr, 0, sizeof(g_romdrive_hdr));
+    romDriveInvalidateCache();
     memset(scsiDev.data, 0, PLATFORM_ROMDRIVE_PAGE_SIZE);
     if (!platform_write_romdrive(scsiDev.data, 0, PLATFORM_ROMDRIVE_PAGE_SIZE))
     {
@@ -101,6 +184,160 @@ bool romDriveClear()
     return true;
 }
 
+// Decompress one block of a compressed image to dest
+static bool romDriveDecompressBlock(const romdrive_hdr_t *hdr, uint32_t block, uint8_t *dest)
+{
+    uint32_t index[2];
+    if (!platform_read_romdrive((uint8_t*)index, PLATFORM_ROMDRIVE_PAGE_SIZE + block * 4, sizeof(index)))
+    {
+        return false;
+    }
+
+    uint32_t len = index[1] - index[0];
+    if (index[1] < index[0] || len > hdr->comp_blocksize)
+    {
+        logmsg("ROM drive index corrupt at block ", (int)block);
+        return false;
+    }
+
+    // Flash reads must be 4-byte aligned
+    uint32_t start = hdr->dataoffset + index[0];
+    uint32_t skip = start & 3;
+    if (len == hdr->comp_blocksize && skip == 0 && ((uintptr_t)dest & 3) == 0)
+    {
+        // Uncompressed block goes straight to destination, streamed like a normal image
+        return platform_read_romdrive(dest, start, len);
+    }
+
+    uint32_t readlen = (skip + len + 3) & ~3;
+    if (!platform_read_romdrive((uint8_t*)g_romdrive_lz->compbuf, start - skip, readlen))
+    {
+        return false;
+    }
+
+    const uint8_t *src = (const uint8_t*)g_romdrive_lz->compbuf + skip;
+    if (len == hdr->comp_blocksize)
+    {
+        memcpy(dest, src, len);
+    }
+    else if (lz_decompress_block(src, len, dest, hdr->comp_blocksize) != hdr->comp_blocksize)
+    {
+        logmsg("ROM drive decompression failed at block ", (int)block);
+        return false;
+    }
+
+    romDriveStreamFilled(dest, hdr->comp_blocksize);
+    return true;
+}
+
+// Read from image data area, decompressing if needed
+static bool romDriveReadImage(const romdrive_hdr_t *hdr, uint8_t *buf, uint32_t start, uint32_t count)
+{
+    if (hdr->compression == ROMDRIVE_COMPRESSION_NONE)
+    {
+        return platform_read_romdrive(buf, start + PLATFORM_ROMDRIVE_PAGE_SIZE, count);
+    }
+
+    if (!romDriveAllocBuffers())
+    {
+        return false;
+    }
+
+    uint32_t bs = hdr->comp_blocksize;
+    while (count > 0)
+    {
+        uint32_t block = start / bs;
+        uint32_t offset = start % bs;
+        uint32_t len = bs - offset;
+        if (len > count) len = count;
+
+        int slot = -1;
+        int oldest = 0;
+        for (int i = 0; i < ROMDRIVE_CACHE_BLOCKS; i++)
+        {
+            if (g_romdrive_lz->cache[i].valid && g_romdrive_lz->cache[i].block == block)
+            {
+                slot = i;
+                break;
+            }
+
+            if (!g_romdrive_lz->cache[i].valid ||
+                (g_romdrive_lz->cache[oldest].valid && g_romdrive_lz->cache[i].lastused < g_romdrive_lz->cache[oldest].lastused))
+            {
+                oldest = i;
+            }
+        }
+
+        if (slot < 0 && len == bs)
+        {
+            // Whole block is needed, decompress straight to destination
+            if (!romDriveDecompressBlock(hdr, block, buf)) return false;
+        }
+        else
+        {
+            if (slot < 0)
+            {
+                slot = oldest;
+                g_romdrive_lz->cache[slot].valid = false;
+                if (!romDriveDecompressBlock(hdr, block, g_romdrive_lz->cache[slot].data)) return false;
+                g_romdrive_lz->cache[slot].block = block;
+                g_romdrive_lz->cache[slot].valid = true;
+            }
+
+            g_romdrive_lz->cache[slot].lastused = ++g_romdrive_cache_counter;
+            memcpy(buf, g_romdrive_lz->cache[slot].data + offset, len);
+            romDriveStreamFilled(buf, len);
+        }
+
+        buf += len;
+        start += len;
+        count -= len;
+    }
+
+    return true;
+}
+
+// State for writing pages while programming the drive
+struct romdrive_writer_t {
+    uint8_t *oldbuf;
+    bool header_valid;
+    uint32_t changed_pages;
+    uint32_t total_pages;
+};
+
+// Write one page, skipping it if flash already contains the same data.
+// The header is invalidated before the first changed page, so that an
+// interrupted programming does not leave a valid header pointing at
+// partial contents.
+static bool romDriveWritePage(romdrive_writer_t *w, const uint8_t *page, uint32_t offset)
+{
+    w->total_pages++;
+
+    if (!platform_read_romdrive(w->oldbuf, offset, PLATFORM_ROMDRIVE_PAGE_SIZE))
+    {
+        return false;
+    }
+
+    if (memcmp(page, w->oldbuf, PLATFORM_ROMDRIVE_PAGE_SIZE) == 0)
+    {
+        return true;
+    }
+
+    if (w->header_valid)
+    {
+        memset(w->oldbuf, 0, PLATFORM_ROMDRIVE_PAGE_SIZE);
+        if (!platform_write_romdrive(w->oldbuf, 0, PLATFORM_ROMDRIVE_PAGE_SIZE))
+        {
+            logmsg("---- Failed to clear ROM drive header");
+            return false;
+        }
+        w->header_valid = false;
+    }
+
+    w->changed_pages++;
+    return platform_write_romdrive(page, offset, PLATFORM_ROMDRIVE_PAGE_SIZE);
+}
+
 // Load an image file to romdrive
 bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S2S_CFG_TYPE type)
 {
@@ -113,14 +350,21 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
 
     uint64_t filesize = file.size();
     uint32_t maxsize = platform_get_romdrive_maxsize() - PLATFORM_ROMDRIVE_PAGE_SIZE;
+    bool compress = ini_getbool("SCSI", "CompressROMDrive", 0, CONFIGFILE);
 
     logmsg("---- SCSI ID: ", scsi_id, " blocksize ", blocksize, " type ", (int)type);
     logmsg("---- ROM drive maximum size is ", (int)maxsize,
           " bytes, image file is ", (int)filesize, " bytes");
 
-    if (filesize > maxsize)
+    if (filesize > maxsize && !compress)
     {
-        logmsg("---- Image size exceeds ROM space, not loading");
+        logmsg("---- Image size exceeds ROM space, trying compression");
+        compress = true;
+    }
+
+    if (filesize > 0xFFFFFFFF - ROMDRIVE_COMP_BLOCKSIZE)
+    {
+        logmsg("---- Image size exceeds ROM drive format limits, not loading");
         file.close();
         return false;
     }
@@ -132,40 +376,175 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
     hdr.blocksize = blocksize;
     hdr.drivetype = type;
 
-    memset(scsiDev.data, 0, PLATFORM_ROMDRIVE_PAGE_SIZE);
-    memcpy(scsiDev.data, &hdr, sizeof(hdr));
-
-    // Program the drive metadata header
-    if (!platform_write_romdrive(scsiDev.data, 0, PLATFORM_ROMDRIVE_PAGE_SIZE))
+    // Buffer layout in scsiDev.data while programming
+    const uint32_t P = PLATFORM_ROMDRIVE_PAGE_SIZE;
+    uint8_t *pagebuf = scsiDev.data;
+    uint8_t *oldbuf = scsiDev.data + P;
+    uint8_t *srcbuf = scsiDev.data + 2 * P;
+    uint8_t *compbuf = scsiDev.data + 3 * P;
+    uint8_t *indexbuf = scsiDev.data + 4 * P;
+    uint8_t *workmem = scsiDev.data + 5 * P;
+    static_assert(5 * PLATFORM_ROMDRIVE_PAGE_SIZE + LZ_COMPRESS_WORKMEM_SIZE <= sizeof(scsiDev.data), "Buffer too small");
+    static_assert(ROMDRIVE_COMP_BLOCKSIZE <= PLATFORM_ROMDRIVE_PAGE_SIZE, "Compression block larger than page");
+
+    romdrive_writer_t writer = {};
+    writer.oldbuf = oldbuf;
+    writer.header_valid = romDriveCheckPresent();
+    memset(&g_romdrive_hdr, 0, sizeof(g_romdrive_hdr));
+    romDriveInvalidateCache();
+
+    // Image CRC is computed from the source data and compared against
+    // the data read back through the normal ROM drive read path.
+    uint32_t image_crc = 0;
+    uint32_t pages = (filesize + P - 1) / P;
+    bool status = true;
+
+    UIRomCopyInit(scsi_id, type, pages, P, filename);
+
+    if (!compress)
     {
-        logmsg("---- Failed to program ROM drive header");
-        file.close();
-        return false;
-    }
-
-    // Program the drive contents
-    uint32_t pages = (filesize + PLATFORM_ROMDRIVE_PAGE_SIZE - 1) / PLATFORM_ROMDRIVE_PAGE_SIZE;
+        hdr.compression = ROMDRIVE_COMPRESSION_NONE;
 
-    UIRomCopyInit(scsi_id, type, pages, PLATFORM_ROMDRIVE_PAGE_SIZE, filename);
-
-    for (uint32_t i = 0; i < pages; i++)
+        for (uint32_t i = 0; i < pages && status; i++)
+        {
+            uint32_t time_start = millis();
+
+            if (i % 2)
+                LED_ON();
+            else
+                LED_OFF();
+
+            memset(pagebuf, 0, P);
+            uint32_t len = (i == pages - 1) ? filesize - i * P : P;
+            if (file.read(pagebuf, len) != (int)len)
+            {
+                logmsg("---- Failed to read image file page ", (int)i);
+                status = false;
+                break;
+            }
+
+            uint32_t crcs[2] = {image_crc, crc32(pagebuf, len)};
+            image_crc = crc32(crcs, sizeof(crcs));
+
+            if (!romDriveWritePage(&writer, pagebuf, (i + 1) * P))
+            {
+                logmsg("---- Failed to program ROM drive page ", (int)i);
+                status = false;
+            }
+
+            UIRomCopyProgress(scsi_id, millis() - time_start, i);
+        }
+    }
+    else
     {
-        uint32_t time_start = millis();
+        uint32_t blocks = (filesize + ROMDRIVE_COMP_BLOCKSIZE - 1) / ROMDRIVE_COMP_BLOCKSIZE;
+        uint32_t index_bytes = (blocks + 1) * 4;
+        hdr.compression = ROMDRIVE_COMPRESSION_LZ;
+        hdr.comp_blocksize = ROMDRIVE_COMP_BLOCKSIZE;
+        hdr.dataoffset = P + (index_bytes + P - 1) / P * P;
 
-        if (i % 2)
-            LED_ON();
-        else
-            LED_OFF();
-
-        if (file.read(scsiDev.data, PLATFORM_ROMDRIVE_PAGE_SIZE) <= 0 ||
-            !platform_write_romdrive(scsiDev.data, (i + 1) * PLATFORM_ROMDRIVE_PAGE_SIZE, PLATFORM_ROMDRIVE_PAGE_SIZE))
+        if (hdr.dataoffset >= platform_get_romdrive_maxsize())
         {
-            logmsg("---- Failed to program ROM drive page ", (int)i);
+            logmsg("---- Compressed image index does not fit in ROM space, not loading");
             file.close();
             return false;
         }
 
-        UIRomCopyProgress(scsi_id, millis() - time_start, i);
+        uint32_t datapos = 0; // Position of next compressed block relative to dataoffset
+        uint32_t pagefill = 0; // Bytes in pagebuf not yet written
+        uint32_t *index32 = (uint32_t*)indexbuf;
+        const uint32_t index_per_page = P / 4;
+        memset(pagebuf, 0, P);
+        memset(indexbuf, 0, P);
+
+        for (uint32_t i = 0; i <= blocks && status; i++)
+        {
+            // Store block start offset to index, flushing full index pages
+            index32[i % index_per_page] = datapos;
+            if (i % index_per_page == index_per_page - 1 || i == blocks)
+            {
+                if (!romDriveWritePage(&writer, indexbuf, P + (i / index_per_page) * P))
+                {
+                    logmsg("---- Failed to program ROM drive index");
+                    status = false;
+                }
+                memset(indexbuf, 0, P);
+            }
+            if (i == blocks || !status) break;
+
+            uint32_t time_start = millis();
+
+            if (i % 2)
+                LED_ON();
+            else
+                LED_OFF();
+
+            memset(srcbuf, 0, ROMDRIVE_COMP_BLOCKSIZE);
+            uint32_t len = (i == blocks - 1) ? filesize - i * ROMDRIVE_COMP_BLOCKSIZE : ROMDRIVE_COMP_BLOCKSIZE;
+            if (file.read(srcbuf, len) != (int)len)
+            {
+                logmsg("---- Failed to read image file block ", (int)i);
+                status = false;
+                break;
+            }
+
+            uint32_t crcs[2] = {image_crc, crc32(srcbuf, len)};
+            image_crc = crc32(crcs, sizeof(crcs));
+
+            // Blocks that do not compress are stored as is
+            const uint8_t *blockdata = compbuf;
+            uint32_t complen = lz_compress_block(srcbuf, ROMDRIVE_COMP_BLOCKSIZE, compbuf, ROMDRIVE_COMP_BLOCKSIZE - 1, workmem);
+            if (complen == 0)
+            {
+                blockdata = srcbuf;
+                complen = ROMDRIVE_COMP_BLOCKSIZE;
+            }
+
+            if (hdr.dataoffset + datapos + complen > platform_get_romdrive_maxsize())
+            {
+                logmsg("---- Compressed image exceeds ROM space at ", (int)(i * ROMDRIVE_COMP_BLOCKSIZE / 1024), " kB, not loading");
+                status = false;
+                break;
+            }
+
+            // Append to the output page, writing it out once full
+            datapos += complen;
+            while (complen > 0 && status)
+            {
+                uint32_t n = P - pagefill;
+                if (n > complen) n = complen;
+                memcpy(pagebuf + pagefill, blockdata, n);
+                pagefill += n;
+                blockdata += n;
+                complen -= n;
+
+                if (pagefill == P)
+                {
+                    uint32_t offset = hdr.dataoffset + (datapos - complen - P);
+                    status = romDriveWritePage(&writer, pagebuf, offset);
+                    memset(pagebuf, 0, P);
+                    pagefill = 0;
+                }
+            }
+
+            if (!status)
+            {
+                logmsg("---- Failed to program ROM drive block ", (int)i);
+            }
+
+            UIRomCopyProgress(scsi_id, millis() - time_start, (uint32_t)((uint64_t)i * ROMDRIVE_COMP_BLOCKSIZE / P));
+        }
+
+        if (status && pagefill > 0)
+        {
+            status = romDriveWritePage(&writer, pagebuf, hdr.dataoffset + datapos - pagefill);
+        }
+
+        if (status)
+        {
+            logmsg("---- Compressed ", (int)(filesize / 1024), " kB image to ",
+                   (int)((datapos + hdr.dataoffset - P) / 1024), " kB including index");
+        }
     }
 
     UIRomCopyProgress(scsi_id, 0, pages);
@@ -174,6 +553,45 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
 
     file.close();
 
+    if (!status)
+    {
+        return false;
+    }
+
+    // Verify the whole image by reading it back through the ROM drive read path
+    uint32_t verify_crc = 0;
+    for (uint32_t pos = 0; pos < filesize; pos += P)
+    {
+        uint32_t len = (filesize - pos < P) ? filesize - pos : P;
+        uint32_t readlen = (len + 3) & ~3;
+        if (!romDriveReadImage(&hdr, pagebuf, pos, readlen))
+        {
+            logmsg("---- ROM drive verify read failed at ", (int)pos);
+            return false;
+        }
+        uint32_t crcs[2] = {verify_crc, crc32(pagebuf, len)};
+        verify_crc = crc32(crcs, sizeof(crcs));
+    }
+
+    if (verify_crc != image_crc)
+    {
+        logmsg("---- ROM drive verify failed, CRC ", verify_crc, " expected ", image_crc);
+        return false;
+    }
+
+    // Program the drive metadata header last
+    memset(pagebuf, 0, P);
+    memcpy(pagebuf, &hdr, sizeof(hdr));
+    if (!platform_write_romdrive(pagebuf, 0, P))
+    {
+        logmsg("---- Failed to program ROM drive header");
+        return false;
+    }
+    g_romdrive_hdr = hdr;
+    romDriveInvalidateCache();
+
+    logmsg("---- ROM drive ", (int)writer.changed_pages, " of ", (int)writer.total_pages, " pages changed, CRC ", image_crc);
+
     char newname[MAX_FILE_PATH * 2] = "";
     strlcat(newname, filename, sizeof(newname));
     strlcat(newname, "_loaded", sizeof(newname));
@@ -185,7 +603,12 @@ bool scsiDiskProgramRomDrive(const char *filename, int scsi_id, int blocksize, S
 
 bool romDriveRead(uint8_t *buf, uint32_t start, uint32_t count)
 {
-    return platform_read_romdrive(buf, start + PLATFORM_ROMDRIVE_PAGE_SIZE, count);
+    if (memcmp(g_romdrive_hdr.magic, "ROMDRIVE", 8) != 0 && !romDriveCheckPresent())
+    {
+        return false;
+    }
+
+    return romDriveReadImage(&g_romdrive_hdr, buf, start, count);
 }
 
 #endif
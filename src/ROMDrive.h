@@ -14,9 +14,20 @@ struct romdrive_hdr_t {
     uint32_t imagesize;
     uint32_t blocksize;
     S2S_CFG_TYPE drivetype;
-    uint32_t reserved[32];
+    uint32_t compression; // ROMDRIVE_COMPRESSION_*
+    uint32_t comp_blocksize; // Uncompressed size of each compressed block
+    uint32_t dataoffset; // Flash offset of compressed data, block index is at start of page 1
+    uint32_t reserved[29];
 };
 
+// Compressed images consist of independently compressed blocks.
+// The index has one uint32_t offset per block relative to dataoffset,
+// plus a final entry marking the end of data. A block whose stored length
+// equals comp_blocksize is stored uncompressed.
+#define ROMDRIVE_COMPRESSION_NONE 0
+#define ROMDRIVE_COMPRESSION_LZ 1
+#define ROMDRIVE_COMP_BLOCKSIZE 4096
+
 // Return true if ROM drive is found.
 // If hdr is not NULL, it will receive the ROM drive header information.
 // If flash is empty, returns false.
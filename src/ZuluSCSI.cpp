@@ -57,6 +57,7 @@
 #include "ZuluSCSI_log_trace.h"
 #include "ZuluSCSI_settings.h"
 #include "ZuluSCSI_disk.h"
+#include "ZuluSCSI_defrag.h"
 #include "ZuluSCSI_sca_hw_config.h"
 #include "ZuluSCSI_initiator.h"
 #include "ZuluSCSI_msc_initiator.h"
@@ -73,6 +74,7 @@
 
 SdFs SD;
 FsFile g_logfile;
+FsFile g_tracefile;
 bool g_rawdrive_active;
 bool g_romdrive_active;
 bool g_sdcard_present;
@@ -88,6 +90,198 @@ bool g_log_to_sd;
 /* Log saving */
 /**************/
 
+// Write binary command trace records from RAM to SD card
+static void save_tracefile(bool always)
+{
+  static uint32_t prev_trace_save = 0;
+  const scsi_trace_record_t *records;
+  uint32_t count = scsiTraceGetPending(&records);
+
+  if (count == 0 || !g_sdcard_present)
+    return;
+
+  // Save when ring buffer is getting full, or periodically
+  if (!always && count < SCSI_TRACE_RECORDS / 2 &&
+      (uint32_t)(millis() - prev_trace_save) < LOG_SAVE_INTERVAL_MS)
+    return;
+
+  if (!g_tracefile.isOpen())
+  {
+    static bool first_open_after_boot = true;
+    int flags = O_WRONLY | O_CREAT | (first_open_after_boot ? O_TRUNC : O_APPEND);
+    g_tracefile = SD.open(TRACEFILE, flags);
+    first_open_after_boot = false;
+
+    if (!g_tracefile.isOpen())
+    {
+      logmsg("Failed to open trace file: ", SD.sdErrorCode());
+      scsiTraceEnable(false);
+      return;
+    }
+
+    if (g_tracefile.size() == 0)
+    {
+      scsi_trace_header_t header = {SCSI_TRACE_MAGIC, SCSI_TRACE_VERSION, sizeof(scsi_trace_record_t)};
+      g_tracefile.write(&header, sizeof(header));
+    }
+  }
+
+  while (count > 0)
+  {
+    g_tracefile.write(records, count * sizeof(scsi_trace_record_t));
+    scsiTraceConsume(count);
+    count = scsiTraceGetPending(&records);
+  }
+  g_tracefile.flush();
+  prev_trace_save = millis();
+
+  uint32_t dropped = scsiTraceGetDropped();
+  if (dropped > 0)
+  {
+    logmsg("Trace buffer overflow, ", (int)dropped, " commands not recorded");
+  }
+}
+
+// On FAT volumes the log file is preallocated at boot and written
+// directly by sector address. This avoids file system updates in the
+// SCSI command path. The file is truncated to actual length when closed.
+// The preallocated area is zeroed first, so that after a power loss the
+// length can be recovered at next boot by finding the end of the text.
+static struct {
+  bool active;
+  uint32_t first_sector;
+  uint32_t sector_count;
+  uint32_t length; // Bytes of log written
+  uint8_t tail[SD_SECTOR_SIZE]; // Partially filled last sector
+} g_lograw;
+
+static bool start_raw_logfile()
+{
+  uint32_t begin, end;
+  if (SD.fatType() == FAT_TYPE_EXFAT || g_logfile.size() != 0)
+    return false; // exFAT valid data length can't be updated without file writes
+
+  if (!g_logfile.preAllocate(LOG_PREALLOC_SIZE) || !g_logfile.contiguousRange(&begin, &end))
+  {
+    g_logfile.truncate(0);
+    return false;
+  }
+
+  // Clear old cluster contents, scsiDev.data is free during log init
+  uint32_t count = end - begin + 1;
+  uint32_t chunk = sizeof(scsiDev.data) / SD_SECTOR_SIZE;
+  memset(scsiDev.data, 0, chunk * SD_SECTOR_SIZE);
+  for (uint32_t sector = 0; sector < count; sector += chunk)
+  {
+    uint32_t n = count - sector;
+    if (n > chunk) n = chunk;
+    if (!SD.card()->writeSectors(begin + sector, scsiDev.data, n))
+    {
+      g_logfile.truncate(0);
+      return false;
+    }
+  }
+
+  g_lograw.active = true;
+  g_lograw.first_sector = begin;
+  g_lograw.sector_count = count;
+  g_lograw.length = 0;
+  return true;
+}
+
+// If the previous session ended without finish_raw_logfile(), the log file
+// still has its preallocated size. Truncate it at the first zero byte.
+static void recover_raw_logfile()
+{
+  FsFile file = SD.open(LOGFILE, O_RDWR);
+  if (!file.isOpen() || file.size() != LOG_PREALLOC_SIZE)
+  {
+    file.close();
+    return;
+  }
+
+  // Written sectors always start with text, find the first one starting with zero
+  uint8_t *buf = scsiDev.data;
+  uint32_t lo = 0, hi = LOG_PREALLOC_SIZE / SD_SECTOR_SIZE;
+  while (lo < hi)
+  {
+    uint32_t mid = (lo + hi) / 2;
+    if (!file.seekSet((uint64_t)mid * SD_SECTOR_SIZE) || file.read(buf, 1) != 1)
+    {
+      file.close();
+      return;
+    }
+
+    if (buf[0] != 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  // Last written sector may be partially filled
+  uint32_t length = lo * SD_SECTOR_SIZE;
+  if (lo > 0 && file.seekSet(length - SD_SECTOR_SIZE) &&
+      file.read(buf, SD_SECTOR_SIZE) == SD_SECTOR_SIZE)
+  {
+    uint8_t *end = (uint8_t*)memchr(buf, 0, SD_SECTOR_SIZE);
+    if (end) length -= SD_SECTOR_SIZE - (end - buf);
+  }
+
+  file.truncate(length);
+  file.close();
+}
+
+// Write log text to the preallocated area, returns number of bytes written
+static uint32_t write_raw_logfile(const char *data, uint32_t len)
+{
+  uint32_t done = 0;
+  while (done < len)
+  {
+    uint32_t sector = g_lograw.length / SD_SECTOR_SIZE;
+    uint32_t offset = g_lograw.length % SD_SECTOR_SIZE;
+    if (sector >= g_lograw.sector_count)
+      break;
+
+    uint32_t n = SD_SECTOR_SIZE - offset;
+    if (n > len - done) n = len - done;
+    if (offset == 0) memset(g_lograw.tail, 0, SD_SECTOR_SIZE);
+    memcpy(g_lograw.tail + offset, data + done, n);
+
+    // Full sectors are written once, the last partial sector is
+    // rewritten on the next save.
+    if (!SD.card()->writeSector(g_lograw.first_sector + sector, g_lograw.tail))
+      break;
+
+    g_lograw.length += n;
+    done += n;
+  }
+  return done;
+}
+
+// Truncate preallocated log file to written length and return to normal writes
+static void finish_raw_logfile()
+{
+  if (!g_lograw.active)
+    return;
+
+  g_lograw.active = false;
+
+  if (!g_logfile.isOpen())
+  {
+    // File was closed by SD card reinit, only fix it if it is still the same file
+    g_logfile = SD.open(LOGFILE, O_WRONLY);
+    if (!g_logfile.isOpen() || g_logfile.size() != LOG_PREALLOC_SIZE)
+    {
+      g_logfile.close();
+      return;
+    }
+  }
+
+  g_logfile.truncate(g_lograw.length);
+  g_logfile.seekEnd();
+  g_logfile.flush();
+}
+
 void save_logfile(bool always = false)
 {
 #ifdef ZULUSCSI_HARDWARE_CONFIG
@@ -96,24 +290,51 @@ void save_logfile(bool always = false)
     return;
 #endif
 
+  if (scsiTraceEnabled())
+  {
+    save_tracefile(always);
+  }
+
   if (!g_log_to_sd)
     return;
   
   static uint32_t prev_log_pos = 0;
-  static uint32_t prev_log_len = 0;
   static uint32_t prev_log_save = 0;
   uint32_t loglen = log_get_buffer_len();
 
-  if (loglen != prev_log_len && g_sdcard_present)
+  if (loglen != prev_log_pos && g_sdcard_present)
   {
-    // When debug is off, save log at most every LOG_SAVE_INTERVAL_MS
-    // When debug is on, save after every SCSI command.
-    if (always || g_log_debug || (LOG_SAVE_INTERVAL_MS > 0 && (uint32_t)(millis() - prev_log_save) > LOG_SAVE_INTERVAL_MS))
+    // Save log when asked to, when enough data is pending
+    // or at most every LOG_SAVE_INTERVAL_MS.
+    if (always || loglen - prev_log_pos >= LOG_SAVE_THRESHOLD ||
+        (LOG_SAVE_INTERVAL_MS > 0 && (uint32_t)(millis() - prev_log_save) > LOG_SAVE_INTERVAL_MS))
     {
-      g_logfile.write(log_get_buffer(&prev_log_pos));
-      g_logfile.flush();
+      // Ring buffer may wrap, which takes two calls to log_get_buffer()
+      for (int i = 0; i < 2 && prev_log_pos != loglen; i++)
+      {
+        uint32_t available;
+        const char *data = log_get_buffer(&prev_log_pos, &available);
+
+        uint32_t done = 0;
+        if (g_lograw.active)
+        {
+          done = write_raw_logfile(data, available);
+          if (done < available)
+          {
+            // Preallocated area is full or write failed, continue as normal file
+            finish_raw_logfile();
+          }
+        }
+
+        if (done < available)
+        {
+          g_logfile.write(data + done, available - done);
+        }
+      }
+
+      if (!g_lograw.active)
+        g_logfile.flush();
 
-      prev_log_len = loglen;
       prev_log_save = millis();
     }
   }
@@ -130,10 +351,14 @@ void init_logfile()
   if (g_rawdrive_active)
     return;
 
+  finish_raw_logfile();
+
   static bool first_open_after_boot = true;
 
   if (first_open_after_boot)
   {
+    recover_raw_logfile();
+
     // Rotate file to LOGFILEPREV
     if (g_scsi_settings.getSystem()->logRotate == 1 || g_scsi_settings.getSystem()->logRotate == 2)
     {
@@ -239,6 +464,10 @@ void init_logfile()
   {
     logmsg("Failed to open log file: ", SD.sdErrorCode());
   }
+  else if (truncate && !start_raw_logfile())
+  {
+    dbgmsg("Log file preallocation not available, using normal file writes");
+  }
   save_logfile(true);
 
   first_open_after_boot = false;
@@ -915,6 +1144,7 @@ bool findHDDImages()
 
         scsiDiskGetImageConfig(id).tapeDensity = g_scsi_settings.getDevice(id)->tapeDensity;
         scsiDiskGetImageConfig(id).tapeBufferedMode = g_scsi_settings.getDevice(id)->tapeBufferedMode;
+        scsiDiskGetImageConfig(id).tapeCompression = g_scsi_settings.getDevice(id)->tapeCompression;
 
         // Open the image file
         if (id < S2S_MAX_TARGETS && is_romdrive)
@@ -1070,6 +1300,7 @@ static bool mountSDCard()
   // are invalidated and accessing old files results in crash.
   invalidate_ini_cache();
   g_logfile.close();
+  g_tracefile.close();
   scsiDiskCloseSDCardImages();
 
   // Check for the common case, FAT filesystem as first partition
@@ -1540,6 +1771,7 @@ static void zuluscsi_setup_sd_card(bool wait_for_card = true)
     ini_gets("SCSI", "System", "", presetName, sizeof(presetName), CONFIGFILE);
     scsi_system_settings_t *cfg = g_scsi_settings.initSystem(presetName, true);
     g_log_to_sd = g_scsi_settings.getSystem()->logToSDCard;
+    scsiTraceEnable(g_scsi_settings.getSystem()->traceToSDCard);
     initUIPostSDInit(true);
 
     #ifdef RECLOCKING_SUPPORTED
@@ -1568,12 +1800,18 @@ static void zuluscsi_setup_sd_card(bool wait_for_card = true)
       delay(boot_delay_ms);
     }
     platform_post_sd_card_init();
+    defragRecover();
 #ifdef PLATFORM_HAS_INITIATOR_MODE
     if (!platform_is_initiator_mode_enabled())
 #endif
       kiosk_restore_images();
     reinitSCSI();
 
+    if (cfg->defragImages == DEFRAG_AT_BOOT)
+    {
+      defragAllImages();
+    }
+
     boot_delay_ms = cfg->initPostDelay;
     if (boot_delay_ms > 0)
     {
@@ -1701,9 +1939,12 @@ static void spin_for_reboot(bool rebooting)
     {
       platform_reset_watchdog();
     }
+    scsiDiskSyncRamImages();
     scsiDiskCloseSDCardImages();
-    save_logfile();
+    save_logfile(true);
+    finish_raw_logfile();
     g_logfile.close();
+    g_tracefile.close();
     SD.card()->syncDevice();
     platform_reset_mcu(1000);
     while(1)
@@ -1722,6 +1963,7 @@ extern "C" void zuluscsi_main_loop(void)
 
   static uint32_t sd_card_check_time = 0;
   static uint32_t last_request_time = 0;
+  static uint32_t last_bus_activity = 0;
 
   bool is_initiator = false;
 #ifdef PLATFORM_HAS_INITIATOR_MODE
@@ -1760,17 +2002,38 @@ extern "C" void zuluscsi_main_loop(void)
     scsiDiskPoll();
     scsiLogPhaseChange(scsiDev.phase);
 
-    // Save log periodically during status phase if there are new messages.
-    // In debug mode, also save every 2 seconds if no SCSI requests come in.
+    // Save log during status phase if enough new messages have accumulated,
+    // and save all pending messages once the bus has been idle for a while.
     // SD card writing takes a while, during which the code can't handle new
     // SCSI requests, so normally we only want to save during a phase where
-    // the host is waiting for us. But for debugging issues where no requests
-    // come through or a request hangs, it's useful to force saving of log.
-    if (scsiDev.phase == STATUS || (g_log_debug && (uint32_t)(millis() - last_request_time) > 2000))
+    // the host is waiting for us or not using the bus. But for debugging
+    // issues where a request hangs, it's useful to force saving of log.
+    if (scsiDev.phase != BUS_FREE)
+    {
+      last_bus_activity = millis();
+    }
+
+    if (scsiDev.phase == STATUS)
     {
       save_logfile();
       last_request_time = millis();
     }
+    else if (scsiDev.phase == BUS_FREE && (uint32_t)(millis() - last_bus_activity) > LOG_IDLE_SAVE_MS)
+    {
+      save_logfile(true);
+
+      // Copy fragmented images to contiguous files while host is not using the bus
+      if (g_scsi_settings.getSystem()->defragImages == DEFRAG_WHEN_IDLE &&
+          (uint32_t)(millis() - last_bus_activity) > DEFRAG_IDLE_MS)
+      {
+        defragPoll();
+      }
+    }
+    else if (g_log_debug && (uint32_t)(millis() - last_request_time) > 2000)
+    {
+      save_logfile(true);
+      last_request_time = millis();
+    }
   }
 
   if (g_sdcard_present)
@@ -1817,6 +2080,7 @@ extern "C" void zuluscsi_main_loop(void)
       {
         sdCardStateChanged(g_sdcard_present, g_romdrive_active);
       }
+      defragRecover();
       reinitSCSI();
       init_logfile();
       init_eject_button();
@@ -54,6 +54,8 @@
 #define LOGFILEPREV "zululog_prev.txt"
 #define LOGFILEROTATE "zululog_rotate"
 #define LOGFILEDIR "zuluscsi_log"
+#define TRACEFILE   "zulutrace.bin"
+#define DEFRAG_JOURNAL_FILE "zuludefrag.txt"
 
 // AS/400 disk profile definitions, captured by utils/extract_as400_disk_data.sh
 // and selected per-[SCSIn] via the AS400_DiskProfile key.
@@ -75,6 +77,22 @@
 #define LOGBUFSIZE 16384
 #endif
 #define LOG_SAVE_INTERVAL_MS 1000
+// Save log before the interval if this many bytes are pending
+#define LOG_SAVE_THRESHOLD (LOGBUFSIZE / 4)
+// Save pending log once SCSI bus has been idle for this long
+#define LOG_IDLE_SAVE_MS 50
+
+// Bus idle time before background image defragmentation continues
+#define DEFRAG_IDLE_MS 2000
+// Log file area preallocated at boot and written by sector address
+#ifndef LOG_PREALLOC_SIZE
+#define LOG_PREALLOC_SIZE (1024 * 1024)
+#endif
+
+// Number of commands stored in RAM for binary trace (TraceToSDCard)
+#ifndef SCSI_TRACE_RECORDS
+#define SCSI_TRACE_RECORDS 64
+#endif
 
 // How often to check for SD card presence
 #define SDCARD_POLL_INTERVAL 5000
@@ -116,6 +134,11 @@
 
 // Image definition options
 #define IMAGE_INDEX_MAX 99              // Maximum number of 'IMG0' - `IMG99` style statements parsed
+#define RAMDISK_CHUNK_SIZE 32768        // Granularity of RAM disk write back to SD card
+#define SD_ERASE_MAX_SECTORS 65536      // Maximum sectors per SD card erase command
+#define IMAGE_EXTENT_MAP_MAX 256        // Maximum number of fragments in an image file for direct SD card access
+#define IMAGE_ZSO_INDEX_WINDOW 256      // Number of .zso block index entries kept in RAM
+#define IMAGE_ZSO_READ_SIZE 8192        // Compressed .zso data read from SD card at once
 
 // SCSI config
 #define NUM_SCSILUN 1          // Maximum number of LUNs supported     (Currently has to be 1)
@@ -174,6 +197,13 @@
 #define PREFETCH_BUFFER_SIZE 8192
 #endif
 
+// RAM region that host can fill with PRE-FETCH and pin with LOCK UNLOCK CACHE.
+// Disabled unless the platform has RAM to spare for it.
+#ifndef HOST_CACHE_SIZE
+#define HOST_CACHE_SIZE 0
+#endif
+#define HOST_CACHE_LOAD_BYTES 2048      // Amount of data loaded per main loop iteration while bus is free
+
 // Enable Copy-on-Write functionality for kiosk environments unless specifically disabled
 #ifndef ENABLE_COW
 #define ENABLE_COW 1
@@ -185,6 +215,13 @@
 
 #define TAPE_DEFAULT_NAME  "tape.000"
 
+// Staging buffer for .TAP record headers and unaligned data, so that record
+// data can be written to SD card sector-aligned.
+// Disabled unless the platform has RAM to spare for it.
+#ifndef TAPE_WRITE_BUFFER_SIZE
+#define TAPE_WRITE_BUFFER_SIZE 0
+#endif
+
 // Settings for rebooting
 #define REBOOT_PURPOSE_MASK 0x00FFFFFF
 #define REBOOT_INTO_MASS_STORAGE_MAGIC_NUM 0x5eeded
@@ -0,0 +1,419 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2025 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_defrag.h"
+#include "ZuluSCSI.h"
+#include "ZuluSCSI_disk.h"
+#include "ZuluSCSI_log.h"
+#include "ZuluSCSI_config.h"
+#include "ZuluSCSI_settings.h"
+#include <ZuluSCSI_platform.h>
+#include <SdFat.h>
+#include <string.h>
+#include <algorithm>
+
+extern "C" {
+#include <scsi.h>
+}
+
+#define DEFRAG_TMP_SUFFIX ".defrag"
+#define DEFRAG_OLD_SUFFIX ".defrag_old"
+
+// Half of the buffer is used for reading existing copy when resuming
+#define DEFRAG_CHUNK_SIZE (sizeof(scsiDev.data) / 2)
+
+static struct {
+    bool active;
+    uint8_t scsiId;
+    FsFile src;
+    FsFile dst;
+    uint64_t size;
+    uint64_t done; // Bytes copied to destination
+    uint64_t compare_end; // Below this position destination may already contain the data
+    uint8_t progress; // Last logged progress, in 10% steps
+    uint32_t skipmask; // Targets that have already been processed
+    char path[MAX_FILE_PATH + 1];
+} g_defrag;
+
+static void defragPath(char *buf, const char *path, const char *suffix)
+{
+    strcpy(buf, path);
+    strcat(buf, suffix);
+}
+
+// Check if the image on a target should be defragmented
+static bool defragCandidate(uint8_t id, char *path, size_t pathlen)
+{
+    image_config_t &img = scsiDiskGetImageConfig(id);
+    if (!img.file.isOpen() || img.file.isContiguous() || !img.file.isWritable() ||
+        img.deviceType == S2S_CFG_SEQUENTIAL || img.deviceType == S2S_CFG_NETWORK ||
+        img.file.size() == 0)
+    {
+        return false;
+    }
+
+#ifdef CONTAINER_IMAGE_SUPPORT
+    if (img.file.isContainer())
+    {
+        return false;
+    }
+#endif
+
+    // Tracking of written sectors does not account for image offset in .zip archive
+    if (img.file.isZip())
+    {
+        return false;
+    }
+
+    // CD images with .cue sheet keep a second handle to the .bin file for
+    // audio playback, which would be left pointing to the removed original.
+    if (img.cuesheetfile.isOpen() || img.bin_container.isOpen())
+    {
+        return false;
+    }
+
+    // Only regular files have a path, this excludes RAW, ROM, RAM and .cow images
+    size_t len = img.file.getFilepath(path, pathlen);
+    return len > 0 && len + strlen(DEFRAG_OLD_SUFFIX) <= MAX_FILE_PATH;
+}
+
+static void defragAbort(bool remove_copy)
+{
+    g_defrag.src.close();
+    g_defrag.dst.close();
+    g_defrag.active = false;
+
+    if (remove_copy)
+    {
+        char tmppath[MAX_FILE_PATH + 1];
+        defragPath(tmppath, g_defrag.path, DEFRAG_TMP_SUFFIX);
+        SD.remove(tmppath);
+    }
+}
+
+// Begin defragmenting the image on given target.
+// Returns false if the image cannot be defragmented.
+static bool defragStart(uint8_t id)
+{
+    if (!defragCandidate(id, g_defrag.path, sizeof(g_defrag.path)))
+    {
+        return false;
+    }
+
+    char tmppath[MAX_FILE_PATH + 1];
+    defragPath(tmppath, g_defrag.path, DEFRAG_TMP_SUFFIX);
+
+    g_defrag.src = SD.open(g_defrag.path, O_RDONLY);
+    g_defrag.size = g_defrag.src.size();
+    if (!g_defrag.src.isOpen())
+    {
+        return false;
+    }
+
+    // Reuse a copy left over from previous boot if it has the right size
+    g_defrag.compare_end = 0;
+    FsFile dst = SD.open(tmppath, O_RDWR);
+    uint32_t begin, end;
+    if (dst.isOpen() && dst.size() == g_defrag.size && dst.contiguousRange(&begin, &end))
+    {
+        logmsg("Defrag: Resuming copy of ", g_defrag.path, " to contiguous file");
+        g_defrag.compare_end = g_defrag.size;
+    }
+    else
+    {
+        dst.close();
+        SD.remove(tmppath);
+
+        uint64_t free_space = (uint64_t)SD.freeClusterCount() * SD.bytesPerCluster();
+        if (g_defrag.size > free_space)
+        {
+            logmsg("Defrag: Not enough free space to defragment ", g_defrag.path);
+            g_defrag.src.close();
+            return false;
+        }
+
+        dst = SD.open(tmppath, O_RDWR | O_CREAT);
+        if (!dst.isOpen() || !dst.preAllocate(g_defrag.size) || !dst.contiguousRange(&begin, &end))
+        {
+            logmsg("Defrag: No contiguous free space for ", g_defrag.path, ", leaving it fragmented");
+            dst.close();
+            SD.remove(tmppath);
+            g_defrag.src.close();
+            return false;
+        }
+
+        logmsg("Defrag: Copying ", g_defrag.path, " (", (int)(g_defrag.size >> 20), " MB) to contiguous file");
+    }
+
+    g_defrag.dst = dst;
+    g_defrag.scsiId = id;
+    g_defrag.done = 0;
+    g_defrag.progress = 0;
+    g_defrag.active = true;
+    return true;
+}
+
+// Replace the original image with the defragmented copy
+static void defragSwap()
+{
+    image_config_t &img = scsiDiskGetImageConfig(g_defrag.scsiId);
+    char tmppath[MAX_FILE_PATH + 1];
+    char oldpath[MAX_FILE_PATH + 1];
+    defragPath(tmppath, g_defrag.path, DEFRAG_TMP_SUFFIX);
+    defragPath(oldpath, g_defrag.path, DEFRAG_OLD_SUFFIX);
+
+    g_defrag.src.close();
+    if (!g_defrag.dst.sync())
+    {
+        logmsg("Defrag: Failed to save copy of ", g_defrag.path);
+        defragAbort(true);
+        return;
+    }
+    g_defrag.dst.close();
+    g_defrag.active = false;
+
+    // Record the swap so that it can be completed if power is lost in between
+    FsFile journal = SD.open(DEFRAG_JOURNAL_FILE, O_RDWR | O_CREAT | O_TRUNC);
+    journal.write(g_defrag.path);
+    if (!journal.sync())
+    {
+        logmsg("Defrag: Failed to write ", DEFRAG_JOURNAL_FILE);
+        journal.close();
+        SD.remove(tmppath);
+        return;
+    }
+    journal.close();
+
+    img.file.close();
+    bool status = SD.rename(g_defrag.path, oldpath);
+    if (status)
+    {
+        status = SD.rename(tmppath, g_defrag.path);
+        if (!status)
+        {
+            // Put the original back
+            SD.rename(oldpath, g_defrag.path);
+        }
+    }
+
+    if (status)
+    {
+        SD.remove(oldpath);
+        logmsg("Defrag: Image ", g_defrag.path, " is now contiguous");
+    }
+    else
+    {
+        logmsg("Defrag: Failed to rename ", tmppath, " to ", g_defrag.path);
+        SD.remove(tmppath);
+    }
+
+    SD.remove(DEFRAG_JOURNAL_FILE);
+
+    if (!img.file.reopen(g_defrag.path))
+    {
+        // Report medium not present rather than accessing a closed image
+        logmsg("Defrag: ERROR - Failed to reopen ", g_defrag.path, ", SCSI ID ", (int)g_defrag.scsiId, " is not ready");
+        img.ejected = true;
+    }
+}
+
+// Copy next chunk of the active image.
+// Returns false when there is nothing left to copy.
+static bool defragStep()
+{
+    image_config_t &img = scsiDiskGetImageConfig(g_defrag.scsiId);
+    char path[MAX_FILE_PATH + 1];
+    if (img.file.getFilepath(path, sizeof(path)) == 0 || strcmp(path, g_defrag.path) != 0)
+    {
+        // Image was changed, copy is no longer valid
+        logmsg("Defrag: Image on SCSI ID ", (int)g_defrag.scsiId, " changed, stopping defragmentation");
+        defragAbort(true);
+        return false;
+    }
+
+    if (g_defrag.done >= g_defrag.size)
+    {
+        defragSwap();
+        return false;
+    }
+
+    uint32_t chunk = std::min<uint64_t>(DEFRAG_CHUNK_SIZE, g_defrag.size - g_defrag.done);
+    uint8_t *buf = scsiDev.data;
+    uint8_t *cmpbuf = scsiDev.data + DEFRAG_CHUNK_SIZE;
+
+    if (!g_defrag.src.seek(g_defrag.done) || g_defrag.src.read(buf, chunk) != (int)chunk)
+    {
+        logmsg("Defrag: Read failed from ", g_defrag.path, " at offset ", (int)g_defrag.done);
+        defragAbort(true);
+        return false;
+    }
+
+    bool write = true;
+    if (g_defrag.done < g_defrag.compare_end)
+    {
+        write = !g_defrag.dst.seek(g_defrag.done) ||
+                g_defrag.dst.read(cmpbuf, chunk) != (int)chunk ||
+                memcmp(buf, cmpbuf, chunk) != 0;
+    }
+
+    if (write && (!g_defrag.dst.seek(g_defrag.done) || g_defrag.dst.write(buf, chunk) != chunk))
+    {
+        logmsg("Defrag: Write failed to copy of ", g_defrag.path, " at offset ", (int)g_defrag.done);
+        defragAbort(true);
+        return false;
+    }
+
+    g_defrag.done += chunk;
+
+    uint8_t progress = g_defrag.done * 10 / g_defrag.size;
+    if (progress != g_defrag.progress)
+    {
+        g_defrag.progress = progress;
+        logmsg("Defrag: ", g_defrag.path, " ", (int)(progress * 10), "% done");
+    }
+
+    return true;
+}
+
+// Pick next fragmented image and start copying it
+static bool defragStartNext()
+{
+    for (uint8_t id = 0; id < S2S_MAX_TARGETS; id++)
+    {
+        if (g_defrag.skipmask & (1UL << id)) continue;
+
+        // Each image is attempted only once until it is changed or card is reinserted
+        g_defrag.skipmask |= (1UL << id);
+
+        if (defragStart(id))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void defragRecover()
+{
+    // Card was (re)mounted, all images are candidates again
+    g_defrag.active = false;
+    g_defrag.skipmask = 0;
+
+    FsFile journal = SD.open(DEFRAG_JOURNAL_FILE, O_RDONLY);
+    if (!journal.isOpen())
+    {
+        return;
+    }
+
+    char path[MAX_FILE_PATH + 1];
+    int len = journal.read(path, MAX_FILE_PATH);
+    journal.close();
+    path[len > 0 ? len : 0] = '\0';
+
+    if (len > 0 && len + strlen(DEFRAG_OLD_SUFFIX) <= MAX_FILE_PATH)
+    {
+        char tmppath[MAX_FILE_PATH + 1];
+        char oldpath[MAX_FILE_PATH + 1];
+        defragPath(tmppath, path, DEFRAG_TMP_SUFFIX);
+        defragPath(oldpath, path, DEFRAG_OLD_SUFFIX);
+
+        if (!SD.exists(path))
+        {
+            // Power was lost between the renames. The copy is complete,
+            // because the journal is written only after copying has finished.
+            if (SD.exists(tmppath))
+            {
+                logmsg("Defrag: Completing interrupted swap of ", path);
+                SD.rename(tmppath, path);
+            }
+            else if (SD.exists(oldpath))
+            {
+                logmsg("Defrag: Restoring original image ", path);
+                SD.rename(oldpath, path);
+            }
+        }
+
+        if (SD.exists(path))
+        {
+            SD.remove(oldpath);
+        }
+    }
+
+    SD.remove(DEFRAG_JOURNAL_FILE);
+}
+
+void defragAllImages()
+{
+    g_defrag.skipmask = 0;
+    if (g_defrag.active)
+    {
+        defragAbort(false);
+    }
+
+    while (defragStartNext())
+    {
+        while (defragStep())
+        {
+            if (millis() & 128) { LED_ON(); } else { LED_OFF(); }
+            platform_reset_watchdog();
+        }
+    }
+    LED_OFF();
+}
+
+void defragPoll()
+{
+    if (!g_sdcard_present)
+    {
+        // Files are no longer valid after card removal
+        g_defrag.active = false;
+        g_defrag.skipmask = 0;
+        return;
+    }
+
+    if (!g_defrag.active && !defragStartNext())
+    {
+        return;
+    }
+
+    defragStep();
+}
+
+void defragImageWritten(uint8_t scsiId, uint32_t lba)
+{
+    if (g_defrag.active && g_defrag.scsiId == (scsiId & S2S_CFG_TARGET_ID_BITS))
+    {
+        image_config_t &img = scsiDiskGetImageConfig(g_defrag.scsiId);
+        uint64_t pos = (uint64_t)lba * img.bytesPerSector;
+        if (pos < g_defrag.done)
+        {
+            // Copy again from the modified position, but only
+            // write the chunks that have actually changed.
+            g_defrag.compare_end = std::max(g_defrag.compare_end, g_defrag.done);
+            g_defrag.done = pos - pos % DEFRAG_CHUNK_SIZE;
+        }
+    }
+}
+
+void defragImageChanged(uint8_t scsiId)
+{
+    g_defrag.skipmask &= ~(1UL << (scsiId & S2S_CFG_TARGET_ID_BITS));
+}
@@ -0,0 +1,57 @@
+/**
+ * ZuluSCSI™ - Copyright (c) 2025 Rabbit Hole Computing™
+ *
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version.
+ *
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+
+// Defragmentation of image files that are not contiguous on SD card.
+// The image is copied to a preallocated contiguous file "<image>.defrag",
+// which is then swapped in place of the original file.
+//
+// The copy can be resumed after power loss: an existing copy is compared
+// chunk by chunk and only differing chunks are rewritten. The swap is
+// recorded in DEFRAG_JOURNAL_FILE so that an interrupted swap can be
+// completed at next boot.
+
+#pragma once
+
+#include <stdint.h>
+
+// Values for DefragImages setting
+#define DEFRAG_DISABLED 0
+#define DEFRAG_WHEN_IDLE 1
+#define DEFRAG_AT_BOOT 2
+
+// Complete an image swap that was interrupted by power loss.
+// Must be called before image files are opened, each time the card is mounted.
+void defragRecover();
+
+// Defragment all open images before SCSI bus is enabled
+void defragAllImages();
+
+// Copy the next chunk of an image while SCSI bus is idle
+void defragPoll();
+
+// Notify that the host has modified the image, so that the already
+// copied part from this sector onwards must be checked again.
+void defragImageWritten(uint8_t scsiId, uint32_t lba);
+
+// Notify that the image on a target has been opened, switched or ejected,
+// so that it is considered for defragmentation again.
+void defragImageChanged(uint8_t scsiId);
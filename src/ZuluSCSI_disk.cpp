@@ -29,6 +29,8 @@
 
 #include "ZuluSCSI_disk.h"
 #include "ZuluSCSI_log.h"
+#include "ZuluSCSI_stats.h"
+#include "ZuluSCSI_defrag.h"
 #include "ZuluSCSI_config.h"
 #include "ZuluSCSI_settings.h"
 #include "ZuluSCSI_blink.h"
@@ -280,7 +282,12 @@ void scsiDiskCloseSDCardImages()
 {
     for (int i = 0; i < S2S_MAX_TARGETS; i++)
     {
-        if (!g_DiskImages[i].file.isRom())
+        if (g_DiskImages[i].file.isRam())
+        {
+            // Keep serving from RAM, changes are saved after card is inserted again
+            g_DiskImages[i].file.detachFile();
+        }
+        else if (!g_DiskImages[i].file.isRom())
         {
             g_DiskImages[i].file.close();
             g_DiskImages[i].image_directory = false;
@@ -291,6 +298,18 @@ void scsiDiskCloseSDCardImages()
 }
 
 
+// Save RAM disk contents to SD card before reboot
+void scsiDiskSyncRamImages()
+{
+    for (int i = 0; i < S2S_MAX_TARGETS; i++)
+    {
+        if (g_DiskImages[i].file.isRam() && !g_DiskImages[i].file.sync())
+        {
+            logmsg("---- Failed to save RAM disk for SCSI ID ", i, " before reboot");
+        }
+    }
+}
+
 // remove path and extension from filename
 void extractFileName(const char* path, char* output) {
 
@@ -473,10 +492,12 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_lun, in
     img.cdrom_binfile_index = -1;
     img.cdrom_track_end_lba = 0;
     scsiDiskSetImageConfig(target_idx);
+    defragImageChanged(target_idx);
 
     auto device_config = g_scsi_settings.getDevice(target_idx);
 
     // Close existing file and construct new one in-place
+    scsiDiskHostCacheRelease(target_idx);
     img.file.~ImageBackingStore();
     new (&img.file) ImageBackingStore(filename, blocksize, device_config);
 
@@ -495,7 +516,7 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_lun, in
         }
 
         // Detect SIMH .tap format with filename extension
-        char *extension = strrchr(filename, '.');
+        const char *extension = strrchr(filename, '.');
         if (type == S2S_CFG_SEQUENTIAL && extension && strcasecmp(extension, ".tap") == 0)
         {
             logmsg("---- SIMH simulated tape drive format detected with extension ", extension);
@@ -510,7 +531,7 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_lun, in
         }
 
         uint32_t sector_begin = 0, sector_end = 0;
-        if (img.file.isRom() || type == S2S_CFG_NETWORK || type == S2S_CFG_AMIGAWIFI || type == S2S_CFG_AUDIO || img.file.isFolder() || tape_is_tap_format)
+        if (img.file.isRom() || img.file.isRam() || type == S2S_CFG_NETWORK || type == S2S_CFG_AMIGAWIFI || type == S2S_CFG_AUDIO || img.file.isFolder() || tape_is_tap_format)
         {
             // Contiguous file doesn't matter for these types
         }
@@ -527,6 +548,18 @@ bool scsiDiskOpenHDDImage(int target_idx, const char *filename, int scsi_lun, in
                 dbgmsg("---- Image file is contiguous, SD card sectors ", (int)sector_begin, " to ", (int)sector_end);
             }
         }
+        else if (img.file.isCompressed())
+        {
+            // Compressed blocks are read through SdFat, fragmentation has little effect
+        }
+        else if (img.file.isZip())
+        {
+            logmsg("---- WARNING: file in .zip archive is accessed through filesystem. This will increase read latency.");
+        }
+        else if (img.file.extentCount() > 0)
+        {
+            logmsg("---- File ", filename, " is fragmented into ", (int)img.file.extentCount(), " parts, using extent map for access");
+        }
         else
         {
             logmsg("---- WARNING: file ", filename, " is not contiguous. This will increase read latency.");
@@ -784,6 +817,7 @@ bool scsiDiskFilenameValid(const char* name)
 	    ".ini", ".mid", ".midi", ".aiff", ".mp3", ".m4a",
             ".ori", // Kiosk mode original images
             ".tmp", // COW dirty files (contains only the writes)
+            ".defrag", ".defrag_old", // Image defragmentation in progress
 #if ENABLE_COW==0
             ".cow", // If COW is not enabled, we ignore .cow files
 #endif
@@ -796,7 +830,7 @@ bool scsiDiskFilenameValid(const char* name)
         };
         const char *archive_exts[] = {
             ".tar", ".tgz", ".gz", ".bz2", ".tbz2", ".xz", ".zst", ".z",
-            ".zip", ".zipx", ".rar", ".lzh", ".lha", ".lzo", ".lz4", ".arj",
+            ".zipx", ".rar", ".lzh", ".lha", ".lzo", ".lz4", ".arj",
             ".dmg", ".hqx", ".cpt", ".7z", ".s7z", ".mid", ".wav", ".aiff",
             NULL
         };
@@ -809,6 +843,11 @@ bool scsiDiskFilenameValid(const char* name)
                 return false;
             }
         }
+        if (strcasecmp(extension, ".zip") == 0 && strncasecmp(name, FIRMWARE_PREFIX, sizeof(FIRMWARE_PREFIX) - 1) == 0)
+        {
+            // firmware update package
+            return false;
+        }
         for (int i = 0; archive_exts[i]; i++)
         {
             if (strcasecmp(extension, archive_exts[i]) == 0)
@@ -1023,6 +1062,7 @@ void scsiDiskCloseTray(image_config_t &img)
 void doPerformEject(image_config_t &img)
 {
     uint8_t target = img.scsiId & S2S_CFG_TARGET_ID_BITS;
+    defragImageChanged(target);
     if (img.deviceType == S2S_CFG_FIXED)
     {
         if (img.ejectFixedDiskReadOnly)
@@ -1416,6 +1456,7 @@ void scsiDiskLoadConfig(int target_idx)
             // set custom tape density
             img.tapeDensity = g_scsi_settings.getDevice(target_idx)->tapeDensity;
             img.tapeBufferedMode = g_scsi_settings.getDevice(target_idx)->tapeBufferedMode;
+            img.tapeCompression = g_scsi_settings.getDevice(target_idx)->tapeCompression;
 
             if (scsiDev.targets[target_idx].liveCfg.bytesPerSector != 0)
             {
@@ -1860,8 +1901,39 @@ const S2S_TargetCfg* s2s_getConfigById(int scsiId)
 /**********************/
 
 // Callback once all data has been read in the data out phase.
+// Erase the whole image so that the SD card can reclaim the space
+// Can blocks of the current target be erased by FORMAT UNIT and UNMAP?
+// Only then is logical block provisioning reported to the host.
+static bool scsiDiskCanErase()
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    S2S_CFG_TYPE type = (S2S_CFG_TYPE)scsiDev.target->cfg->deviceType;
+    return (type == S2S_CFG_FIXED || type == S2S_CFG_REMOVABLE) &&
+           !(blockDev.state & DISK_WP) && img.file.isWritable() &&
+           !img.ejectFixedDiskWriteBlocked && img.file.canErase();
+}
+
+static void doFormatUnitErase(void)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    if (!scsiDiskCanErase())
+    {
+        return;
+    }
+
+    uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
+    uint64_t size = (img.file.size() / bytesPerSector) * bytesPerSector;
+
+    scsiDiskPrefetchInvalidate(scsiDev.target->targetId);
+    if (img.file.erase(0, size))
+    {
+        logmsg("---- FORMAT UNIT erased ", (int)(size / 1024), " kB on SCSI ID ", (int)scsiDev.target->targetId);
+    }
+}
+
 static void doFormatUnitComplete(void)
 {
+    doFormatUnitErase();
     scsiDev.phase = STATUS;
 }
 
@@ -2045,6 +2117,10 @@ static void doReadCapacity16()
         memset(scsiDev.data, 0, 32);
         storeBe64(scsiDev.data, highestBlock);
         storeBe32(scsiDev.data + 8, bytesPerSector);
+        if (scsiDiskCanErase())
+        {
+            scsiDev.data[14] = 0x80; // LBPME, UNMAP is supported
+        }
         scsiDev.dataLen = allocationLength < 32 ? allocationLength : 32;
         scsiDev.phase = DATA_IN;
         }
@@ -2199,6 +2275,26 @@ static struct {
 } g_scsi_prefetch;
 #endif
 
+/*******************************************/
+/* Host cache for PRE-FETCH and LOCK CACHE */
+/*******************************************/
+
+// Single RAM region that the host can fill with PRE-FETCH.
+// Sectors are loaded in order, so sectors below validSectors are usable.
+// Remaining sectors are loaded in background while the bus is free.
+// A locked region is not replaced by later PRE-FETCH commands.
+#if HOST_CACHE_SIZE > 0
+static struct {
+    uint8_t buffer[HOST_CACHE_SIZE];
+    uint32_t firstSector;
+    uint32_t bytesPerSector;
+    uint32_t numSectors;
+    uint32_t validSectors;
+    uint8_t scsiId;
+    bool locked;
+} g_scsi_hostcache;
+#endif
+
 // Begin writing to prefetch buffer.
 // If the buffer is not available, returns NULL.
 // Otherwise returns pointer to which caller can write up to maxSectors sectors.
@@ -2252,6 +2348,19 @@ void scsiDiskPrefetchFinishWrite(uint8_t scsiId, uint32_t firstSector, uint32_t
 // Otherwise returns pointer for reading up to numSectors sectors of data, beginning at firstSector.
 const uint8_t *scsiDiskPrefetchRead(uint8_t scsiId, uint32_t firstSector, uint32_t bytesPerSector, uint32_t *numSectors)
 {
+#if HOST_CACHE_SIZE > 0
+    if ((scsiId & S2S_CFG_TARGET_ID_BITS) == g_scsi_hostcache.scsiId &&
+        bytesPerSector == g_scsi_hostcache.bytesPerSector &&
+        firstSector >= g_scsi_hostcache.firstSector &&
+        firstSector < g_scsi_hostcache.firstSector + g_scsi_hostcache.validSectors)
+    {
+        // At least one sector found in host cache
+        uint32_t offset = firstSector - g_scsi_hostcache.firstSector;
+        *numSectors = g_scsi_hostcache.validSectors - offset;
+        return g_scsi_hostcache.buffer + offset * bytesPerSector;
+    }
+#endif
+
 #ifdef PREFETCH_BUFFER_SIZE
     if (scsiId == g_scsi_prefetch.scsiId &&
         bytesPerSector == g_scsi_prefetch.bytesPerSector &&
@@ -2273,7 +2382,7 @@ const uint8_t *scsiDiskPrefetchRead(uint8_t scsiId, uint32_t firstSector, uint32
 // Invalidate SCSI prefetch buffer.
 // If scsiId is given, only invalidate if that device has data in buffer.
 // If scsiId is not given (value -1), invalidate for all devices.
-void scsiDiskPrefetchInvalidate(uint8_t scsiId)
+void scsiDiskPrefetchInvalidate(uint8_t scsiId, uint32_t lba, uint32_t blocks)
 {
 #ifdef PREFETCH_BUFFER_SIZE
     if (scsiId == (uint8_t)-1 ||
@@ -2283,6 +2392,164 @@ void scsiDiskPrefetchInvalidate(uint8_t scsiId)
         g_scsi_prefetch.firstSector = 0;
     }
 #endif
+
+    if (scsiId != (uint8_t)-1)
+    {
+        defragImageWritten(scsiId, lba);
+    }
+
+#if HOST_CACHE_SIZE > 0
+    if (scsiId == (uint8_t)-1 ||
+        g_scsi_hostcache.scsiId == (scsiId & S2S_CFG_TARGET_ID_BITS))
+    {
+        // Reload everything from the first changed sector onwards
+        uint64_t end = (uint64_t)lba + blocks;
+        if (lba < g_scsi_hostcache.firstSector + g_scsi_hostcache.validSectors &&
+            end > g_scsi_hostcache.firstSector)
+        {
+            uint32_t offset = (lba > g_scsi_hostcache.firstSector) ? lba - g_scsi_hostcache.firstSector : 0;
+            g_scsi_hostcache.validSectors = offset;
+        }
+    }
+#endif
+}
+
+// Drop the host cache contents and lock of a device, e.g. when image changes.
+// If scsiId is -1, release for all devices.
+void scsiDiskHostCacheRelease(uint8_t scsiId)
+{
+#if HOST_CACHE_SIZE > 0
+    if (scsiId == (uint8_t)-1 ||
+        g_scsi_hostcache.scsiId == (scsiId & S2S_CFG_TARGET_ID_BITS))
+    {
+        g_scsi_hostcache.numSectors = 0;
+        g_scsi_hostcache.validSectors = 0;
+        g_scsi_hostcache.firstSector = 0;
+        g_scsi_hostcache.locked = false;
+    }
+#endif
+}
+
+// Load up to maxBytes of pending sectors into host cache.
+// Returns true if there is more to load.
+static bool scsiDiskHostCacheLoad(uint32_t maxBytes)
+{
+#if HOST_CACHE_SIZE > 0
+    if (g_scsi_hostcache.validSectors >= g_scsi_hostcache.numSectors)
+    {
+        return false;
+    }
+
+    image_config_t &img = g_DiskImages[g_scsi_hostcache.scsiId];
+    uint32_t bytesPerSector = g_scsi_hostcache.bytesPerSector;
+    uint32_t sectors = std::min(g_scsi_hostcache.numSectors - g_scsi_hostcache.validSectors,
+                                std::max<uint32_t>(1, maxBytes / bytesPerSector));
+    uint32_t sector = g_scsi_hostcache.firstSector + g_scsi_hostcache.validSectors;
+    uint8_t *dest = g_scsi_hostcache.buffer + g_scsi_hostcache.validSectors * bytesPerSector;
+
+    if (!img.file.isOpen() ||
+        !img.file.seek((uint64_t)sector * bytesPerSector) ||
+        img.file.read(dest, sectors * bytesPerSector) != sectors * bytesPerSector)
+    {
+        logmsg("Host cache load failed at sector ", (int)sector, " for SCSI ID ", (int)g_scsi_hostcache.scsiId);
+        g_scsi_hostcache.numSectors = g_scsi_hostcache.validSectors;
+        return false;
+    }
+
+    g_scsi_hostcache.validSectors += sectors;
+    return g_scsi_hostcache.validSectors < g_scsi_hostcache.numSectors;
+#else
+    return false;
+#endif
+}
+
+// PRE-FETCH(10), PRE-FETCH(16) and LOCK UNLOCK CACHE with LOCK bit.
+// Loads as much of the range as fits into host cache, unless the cache is locked.
+// With IMMED bit the command completes at once and data is loaded while bus is free.
+static void scsiDiskPrefetchRange(uint64_t lba, uint32_t blocks, bool immed, bool lock)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
+    uint64_t capacity = img.file.size() / bytesPerSector;
+
+    if (lba > capacity || blocks > capacity - lba)
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        scsiDev.target->sense.asc = LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+#if HOST_CACHE_SIZE > 0
+    if (img.deviceType == S2S_CFG_OPTICAL || img.deviceType == S2S_CFG_SEQUENTIAL)
+    {
+        // Image file does not map linearly to sectors
+        return;
+    }
+
+    // Zero block count means until the end of the medium
+    if (blocks == 0) blocks = capacity - lba;
+    uint32_t maxSectors = sizeof(g_scsi_hostcache.buffer) / bytesPerSector;
+    if (blocks > maxSectors) blocks = maxSectors;
+
+    bool sameRange = g_scsi_hostcache.numSectors > 0 &&
+        g_scsi_hostcache.scsiId == scsiDev.target->targetId &&
+        g_scsi_hostcache.bytesPerSector == bytesPerSector &&
+        g_scsi_hostcache.firstSector == lba &&
+        g_scsi_hostcache.numSectors >= blocks;
+
+    if (!sameRange)
+    {
+        if (g_scsi_hostcache.locked)
+        {
+            if (lock)
+            {
+                // Only one range can be locked at a time
+                scsiDev.status = CHECK_CONDITION;
+                scsiDev.target->sense.code = ILLEGAL_REQUEST;
+                scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+                scsiDev.phase = STATUS;
+            }
+            return;
+        }
+
+        dbgmsg("------ Host cache load ", (int)blocks, "x", (int)bytesPerSector, " starting at ", (int)lba);
+        g_scsi_hostcache.scsiId = scsiDev.target->targetId;
+        g_scsi_hostcache.firstSector = lba;
+        g_scsi_hostcache.bytesPerSector = bytesPerSector;
+        g_scsi_hostcache.numSectors = blocks;
+        g_scsi_hostcache.validSectors = 0;
+    }
+
+    if (lock)
+    {
+        g_scsi_hostcache.locked = true;
+    }
+
+    if (!immed)
+    {
+        while (scsiDiskHostCacheLoad(HOST_CACHE_SIZE))
+        {
+            platform_reset_watchdog();
+        }
+    }
+#endif
+}
+
+// LOCK UNLOCK CACHE with LOCK bit cleared.
+// Unlocking keeps the data in cache, but allows later PRE-FETCH to replace it.
+static void scsiDiskUnlockCache(uint64_t lba, uint32_t blocks)
+{
+#if HOST_CACHE_SIZE > 0
+    uint64_t end = (blocks == 0) ? UINT64_MAX : lba + blocks;
+    if (g_scsi_hostcache.scsiId == scsiDev.target->targetId &&
+        lba < g_scsi_hostcache.firstSector + g_scsi_hostcache.numSectors &&
+        end > g_scsi_hostcache.firstSector)
+    {
+        g_scsi_hostcache.locked = false;
+    }
+#endif
 }
 
 /*****************/
@@ -2351,8 +2618,9 @@ void scsiDiskStartWrite(uint32_t lba, uint32_t blocks)
         scsiDev.phase = DATA_OUT;
         scsiDev.dataLen = 0;
         scsiDev.dataPtr = 0;
+        scsiStatsCurrent()->write_commands++;
 
-        scsiDiskPrefetchInvalidate(scsiDev.target->targetId);
+        scsiDiskPrefetchInvalidate(scsiDev.target->targetId, lba, blocks);
 
         if (img.ejectFixedDiskPending)
         {
@@ -2492,8 +2760,9 @@ static void scsiDiskStartWriteAndVerify(uint32_t lba, uint32_t blocks)
         scsiDev.dataPtr = 0;
         g_disk_data_out.verify = false;
         g_disk_data_out.write_and_verify = true;
+        scsiStatsCurrent()->write_commands++;
 
-        scsiDiskPrefetchInvalidate(scsiDev.target->targetId);
+        scsiDiskPrefetchInvalidate(scsiDev.target->targetId, lba, blocks);
 
         if (img.ejectFixedDiskPending)
         {
@@ -2610,144 +2879,226 @@ static void scsiDiskHandleVerify(uint64_t lba, uint32_t blocks, bool compareData
     scsiDiskVerifyMedium((uint32_t)lba, blocks);
 }
 
-static void diskVerifyDataOut()
+// VERIFY and WRITE AND VERIFY data out phase.
+// The first half of scsiDev.data is used as a ring buffer for data from the
+// SCSI bus, so that the host can keep sending the next chunk while the
+// current one is being written and read back from SD card.
+// The read back data goes to the third quarter and is compared to host data
+// sector by sector as it arrives from SD card. If the buffer is too small for
+// that split, the ring holds a single chunk and transfers are not overlapped.
+static struct {
+    uint64_t bytes_total; // Bytes in this data out phase
+    uint64_t bytes_scsi_started; // Bytes for which SCSI read has been started
+    uint64_t bytes_done; // Bytes that have been verified and can be overwritten
+    uint32_t ring_size;
+    int parityError;
+
+    // Comparison of the chunk being read back from SD card
+    const uint8_t *compare_host;
+    const uint8_t *compare_disk;
+    uint32_t compare_len;
+    uint32_t compared;
+    bool mismatch;
+    uint32_t mismatch_offset;
+} g_disk_verify;
+
+// Compare sectors that have been read back from SD card so far
+static void diskVerifyCompare(uint32_t bytes_complete)
 {
-    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
-    uint32_t compareBufferSize = sizeof(scsiDev.data) / 2;
-    uint32_t remainingBlocks = transfer.blocks - transfer.currentBlock;
-    uint32_t maxBlocksPerChunk = compareBufferSize / bytesPerSector;
-    if (maxBlocksPerChunk == 0)
+    if (bytes_complete > g_disk_verify.compare_len)
     {
-        maxBlocksPerChunk = 1;
+        bytes_complete = g_disk_verify.compare_len;
     }
-    uint32_t chunkBlocks = remainingBlocks;
-    if (chunkBlocks > maxBlocksPerChunk)
+
+    while (!g_disk_verify.mismatch && g_disk_verify.compared + bytesPerSector <= bytes_complete)
     {
-        chunkBlocks = maxBlocksPerChunk;
+        uint32_t offset = g_disk_verify.compared;
+        if (memcmp(g_disk_verify.compare_host + offset, g_disk_verify.compare_disk + offset, bytesPerSector) != 0)
+        {
+            g_disk_verify.mismatch = true;
+            g_disk_verify.mismatch_offset = offset;
+        }
+        g_disk_verify.compared += bytesPerSector;
     }
-    uint32_t chunkBytes = chunkBlocks * bytesPerSector;
-    uint8_t *compareBuffer = scsiDev.data;
-    uint8_t *diskBuffer = scsiDev.data + compareBufferSize;
+}
 
-    scsiEnterPhase(DATA_OUT);
+// Start next SCSI read if there is free space in the ring buffer.
+// Called from SD card driver during SD card access.
+static void diskVerifyDataOut_callback(uint32_t bytes_complete)
+{
+    if (g_disk_verify.compare_len > 0)
+    {
+        diskVerifyCompare(bytes_complete);
+    }
 
-    int parityError = 0;
-    scsiRead(compareBuffer, chunkBytes, &parityError);
-    if (parityError && (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_PARITY))
+    if (g_disk_verify.bytes_scsi_started >= g_disk_verify.bytes_total)
     {
-        diskSpecialDataOutError(ABORTED_COMMAND, SCSI_PARITY_ERROR);
         return;
     }
 
-    if (img.file.read(diskBuffer, chunkBytes) != chunkBytes)
+    uint64_t remain = g_disk_verify.bytes_total - g_disk_verify.bytes_scsi_started;
+    uint32_t start = g_disk_verify.bytes_scsi_started % g_disk_verify.ring_size;
+    uint32_t len = g_disk_verify.ring_size - start;
+    if (len > remain)
     {
-        logmsg("SD card read failed during VERIFY at sector ", (int)(transfer.lba + transfer.currentBlock),
-              " SCSI ID", (int)scsiDev.target->targetId, " error ", SD.sdErrorCode());
-        diskSpecialDataOutError(MEDIUM_ERROR, UNRECOVERED_READ_ERROR);
-        return;
+        len = remain;
     }
 
-    for (uint32_t block = 0; block < chunkBlocks; block++)
+    if (len > PLATFORM_OPTIMAL_SCSI_READ_BLOCK_SIZE)
     {
-        uint8_t *compareSector = compareBuffer + block * bytesPerSector;
-        uint8_t *diskSector = diskBuffer + block * bytesPerSector;
-        if (memcmp(compareSector, diskSector, bytesPerSector) != 0)
-        {
-            uint32_t failingLba = transfer.lba + transfer.currentBlock + block;
-            transfer.lba = failingLba;
-            scsiDev.target->sense.info = failingLba;
-            diskSpecialDataOutError(MISCOMPARE, MISCOMPARE_DURING_VERIFY_OPERATION);
-            return;
-        }
+        len = PLATFORM_OPTIMAL_SCSI_READ_BLOCK_SIZE;
     }
 
-    transfer.currentBlock += chunkBlocks;
-    platform_reset_watchdog();
+    // Don't overwrite data that has not been verified yet
+    uint64_t limit = g_disk_verify.bytes_done + g_disk_verify.ring_size;
+    if (g_disk_verify.bytes_scsi_started + len > limit)
+    {
+        len = limit - g_disk_verify.bytes_scsi_started;
+    }
 
-    if (transfer.currentBlock == transfer.blocks)
+    uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
+    if (remain >= bytesPerSector && len % bytesPerSector != 0)
     {
-        diskSpecialDataOutStop();
-        scsiDev.status = GOOD;
-        scsiDev.phase = STATUS;
+        len -= len % bytesPerSector;
     }
+
+    if (len == 0)
+        return;
+
+    scsiStartRead(&scsiDev.data[start], len, &g_disk_verify.parityError);
+    g_disk_verify.bytes_scsi_started += len;
 }
 
-static void diskWriteVerifyDataOut()
+static void diskVerifyTransfer(bool write)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
-    uint32_t halfBufferSize = sizeof(scsiDev.data) / 2;
-    uint32_t remainingBlocks = transfer.blocks - transfer.currentBlock;
-    uint32_t maxBlocksPerChunk = halfBufferSize / bytesPerSector;
-    if (maxBlocksPerChunk == 0)
+
+    uint32_t chunkSize = ((sizeof(scsiDev.data) / 4) / bytesPerSector) * bytesPerSector;
+    uint32_t ringSize = 2 * chunkSize;
+    if (chunkSize == 0)
     {
-        maxBlocksPerChunk = 1;
+        // Buffer cannot hold two chunks of host data and the read back data.
+        // Use a single chunk so that the next one is received only after
+        // the current one has been verified.
+        chunkSize = ((sizeof(scsiDev.data) / 2) / bytesPerSector) * bytesPerSector;
+        ringSize = chunkSize;
     }
-    uint32_t chunkBlocks = remainingBlocks;
-    if (chunkBlocks > maxBlocksPerChunk)
+
+    if (chunkSize == 0)
     {
-        chunkBlocks = maxBlocksPerChunk;
+        logmsg("Sector size ", (int)bytesPerSector, " is too large for ", write ? "WRITE AND VERIFY" : "VERIFY");
+        diskSpecialDataOutError(ILLEGAL_REQUEST, INVALID_FIELD_IN_CDB);
+        return;
     }
-    uint32_t chunkBytes = chunkBlocks * bytesPerSector;
-    uint32_t chunkLba = transfer.lba + transfer.currentBlock;
-    uint64_t chunkOffset = (uint64_t)chunkLba * bytesPerSector;
-    uint8_t *writeBuffer = scsiDev.data;
-    uint8_t *verifyBuffer = scsiDev.data + halfBufferSize;
+
+    uint8_t *diskBuffer = scsiDev.data + ringSize;
+    assert(ringSize + chunkSize <= sizeof(scsiDev.data));
+
+    g_disk_verify.bytes_total = (uint64_t)(transfer.blocks - transfer.currentBlock) * bytesPerSector;
+    g_disk_verify.bytes_scsi_started = 0;
+    g_disk_verify.bytes_done = 0;
+    g_disk_verify.ring_size = ringSize;
+    g_disk_verify.parityError = 0;
+    g_disk_verify.compare_len = 0;
 
     scsiEnterPhase(DATA_OUT);
 
-    int parityError = 0;
-    scsiRead(writeBuffer, chunkBytes, &parityError);
-    if (parityError && (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_PARITY))
+    while (g_disk_verify.bytes_done < g_disk_verify.bytes_total
+           && scsiDev.phase == DATA_OUT
+           && !scsiDev.resetFlag)
     {
-        diskSpecialDataOutError(ABORTED_COMMAND, SCSI_PARITY_ERROR);
-        return;
-    }
+        platform_poll();
+        diskEjectButtonUpdate(false);
 
-    if (img.file.write(writeBuffer, chunkBytes) != chunkBytes)
-    {
-        logmsg("SD card write failed during WRITE AND VERIFY at sector ", (int)chunkLba,
-              " SCSI ID", (int)scsiDev.target->targetId, " error ", SD.sdErrorCode());
-        diskSpecialDataOutError(MEDIUM_ERROR, WRITE_ERROR_AUTO_REALLOCATION_FAILED);
-        return;
-    }
+        uint64_t remain = g_disk_verify.bytes_total - g_disk_verify.bytes_done;
+        uint32_t len = (remain > chunkSize) ? chunkSize : remain;
+        uint8_t *hostData = &scsiDev.data[g_disk_verify.bytes_done % g_disk_verify.ring_size];
+        uint32_t chunkLba = transfer.lba + transfer.currentBlock;
 
-    img.file.flush();
+        // Wait for host data of this chunk
+        while ((g_disk_verify.bytes_scsi_started < g_disk_verify.bytes_done + len ||
+                !scsiIsReadFinished(hostData + len - 1)) && !scsiDev.resetFlag)
+        {
+            diskVerifyDataOut_callback(0);
+        }
+        if (scsiDev.resetFlag) break;
 
-    if (!img.file.seek(chunkOffset))
-    {
-        logmsg("Seek to ", chunkLba, " failed during WRITE AND VERIFY for SCSI ID ", (int)scsiDev.target->targetId);
-        diskSpecialDataOutError(MEDIUM_ERROR, NO_SEEK_COMPLETE);
-        return;
-    }
+        scsiFinishRead(hostData, len, &g_disk_verify.parityError);
+        if (g_disk_verify.parityError && (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_PARITY))
+        {
+            diskSpecialDataOutError(ABORTED_COMMAND, SCSI_PARITY_ERROR);
+            break;
+        }
 
-    if (img.file.read(verifyBuffer, chunkBytes) != chunkBytes)
-    {
-        logmsg("SD card read failed during WRITE AND VERIFY at sector ", (int)chunkLba,
-              " SCSI ID", (int)scsiDev.target->targetId, " error ", SD.sdErrorCode());
-        diskSpecialDataOutError(MEDIUM_ERROR, UNRECOVERED_READ_ERROR);
-        return;
-    }
+        if (write)
+        {
+            platform_set_sd_callback(&diskVerifyDataOut_callback, hostData);
+            ssize_t status = img.file.write(hostData, len);
+            platform_set_sd_callback(NULL, NULL);
 
-    for (uint32_t block = 0; block < chunkBlocks; block++)
-    {
-        uint8_t *writeSector = writeBuffer + block * bytesPerSector;
-        uint8_t *verifySector = verifyBuffer + block * bytesPerSector;
-        if (memcmp(writeSector, verifySector, bytesPerSector) != 0)
+            if (status != len)
+            {
+                logmsg("SD card write failed during WRITE AND VERIFY at sector ", (int)chunkLba,
+                      " SCSI ID", (int)scsiDev.target->targetId, " error ", SD.sdErrorCode());
+                scsiStatsCurrent()->write_errors++;
+                diskSpecialDataOutError(MEDIUM_ERROR, WRITE_ERROR_AUTO_REALLOCATION_FAILED);
+                break;
+            }
+
+            scsiStatsCurrent()->bytes_written += len;
+            img.file.flush();
+
+            if (!img.file.seek((uint64_t)chunkLba * bytesPerSector))
+            {
+                logmsg("Seek to ", chunkLba, " failed during WRITE AND VERIFY for SCSI ID ", (int)scsiDev.target->targetId);
+                diskSpecialDataOutError(MEDIUM_ERROR, NO_SEEK_COMPLETE);
+                break;
+            }
+        }
+
+        // Read back from SD card, comparing sectors as they arrive
+        g_disk_verify.compare_host = hostData;
+        g_disk_verify.compare_disk = diskBuffer;
+        g_disk_verify.compare_len = len;
+        g_disk_verify.compared = 0;
+        g_disk_verify.mismatch = false;
+
+        platform_set_sd_callback(&diskVerifyDataOut_callback, diskBuffer);
+        ssize_t status = img.file.read(diskBuffer, len);
+        platform_set_sd_callback(NULL, NULL);
+
+        if (status != len)
+        {
+            g_disk_verify.compare_len = 0;
+            logmsg("SD card read failed during ", write ? "WRITE AND VERIFY" : "VERIFY", " at sector ", (int)chunkLba,
+                  " SCSI ID", (int)scsiDev.target->targetId, " error ", SD.sdErrorCode());
+            diskSpecialDataOutError(MEDIUM_ERROR, UNRECOVERED_READ_ERROR);
+            break;
+        }
+
+        diskVerifyCompare(len);
+        g_disk_verify.compare_len = 0;
+
+        if (g_disk_verify.mismatch)
         {
-            uint32_t failingLba = chunkLba + block;
+            uint32_t failingLba = chunkLba + g_disk_verify.mismatch_offset / bytesPerSector;
             transfer.lba = failingLba;
             scsiDev.target->sense.info = failingLba;
             diskSpecialDataOutError(MISCOMPARE, MISCOMPARE_DURING_VERIFY_OPERATION);
-            return;
+            break;
         }
+
+        g_disk_verify.bytes_done += len;
+        transfer.currentBlock += len / bytesPerSector;
+        platform_reset_watchdog();
     }
 
-    transfer.currentBlock += chunkBlocks;
-    platform_reset_watchdog();
+    // Release SCSI bus
+    scsiFinishRead(NULL, 0, &g_disk_verify.parityError);
 
-    if (transfer.currentBlock == transfer.blocks)
+    if (transfer.currentBlock == transfer.blocks && scsiDev.phase == DATA_OUT)
     {
         diskSpecialDataOutStop();
         scsiDev.status = GOOD;
@@ -2755,6 +3106,16 @@ static void diskWriteVerifyDataOut()
     }
 }
 
+static void diskVerifyDataOut()
+{
+    diskVerifyTransfer(false);
+}
+
+static void diskWriteVerifyDataOut()
+{
+    diskVerifyTransfer(true);
+}
+
 // Called to transfer next block from SCSI bus.
 // Usually called from SD card driver during waiting for SD card access.
 void diskDataOut_callback(uint32_t bytes_complete)
@@ -3051,6 +3412,11 @@ void diskDataOut()
             platform_set_sd_callback(NULL, NULL);
             scsiDev.target->transfer.bytes_sd += len;
 
+            if (scsiDev.phase == STATUS)
+                scsiStatsCurrent()->write_errors++;
+            else
+                scsiStatsCurrent()->bytes_written += len;
+
             // Reset the watchdog while the transfer is progressing.
             // If the host stops transferring, the watchdog will eventually expire.
             // This is needed to avoid hitting the watchdog if the host performs
@@ -3127,6 +3493,7 @@ void scsiDiskStartRead(uint32_t lba, uint32_t blocks)
         scsiDev.phase = DATA_IN;
         scsiDev.dataLen = 0;
         scsiDev.dataPtr = 0;
+        scsiStatsCurrent()->read_commands++;
 
 #ifdef PREFETCH_BUFFER_SIZE
         uint32_t prefetch_sectors = 0;
@@ -3141,6 +3508,10 @@ void scsiDiskStartRead(uint32_t lba, uint32_t blocks)
             scsiStartWrite(prefetch_ptr, prefetch_sectors * bytesPerSector);
             dbgmsg("------ Found ", (int)prefetch_sectors, " sectors in prefetch cache");
             transfer.currentBlock += prefetch_sectors;
+
+            scsi_target_stats_t *stats = scsiStatsCurrent();
+            stats->prefetch_hits += prefetch_sectors;
+            stats->bytes_read += prefetch_sectors * bytesPerSector;
         }
 
         if (transfer.currentBlock == transfer.blocks)
@@ -3236,6 +3607,9 @@ static void start_dataInTransfer(uint8_t *buffer, uint32_t count)
     // Start transferring from SD card
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     platform_set_sd_callback(&diskDataIn_callback, buffer);
+#ifdef PLATFORM_HAS_ROMDRIVE_CALLBACK
+    platform_set_romdrive_callback(&diskDataIn_callback, buffer);
+#endif
 
 #ifdef PLATFORM_AS400
     if (g_disk_transfer.skip_command == 0xE8)
@@ -3301,8 +3675,22 @@ static void start_dataInTransfer(uint8_t *buffer, uint32_t count)
         scsiDev.phase = STATUS;
     }
 
+    scsi_target_stats_t *stats = scsiStatsCurrent();
+    if (scsiDev.phase == STATUS)
+    {
+        stats->read_errors++;
+    }
+    else
+    {
+        stats->bytes_read += count;
+        stats->prefetch_misses += count / scsiDev.target->liveCfg.bytesPerSector;
+    }
+
     diskDataIn_callback(count);
     platform_set_sd_callback(NULL, NULL);
+#ifdef PLATFORM_HAS_ROMDRIVE_CALLBACK
+    platform_set_romdrive_callback(NULL, NULL);
+#endif
 
     platform_poll();
     diskEjectButtonUpdate(false);
@@ -3430,23 +3818,82 @@ static void diskDataIn()
 }
 
 
-#ifdef PLATFORM_AS400
-// AS/400 Write Same(10) entry point
-void scsiDiskWriteSame(uint32_t lba, uint32_t blocks) 
+// Check that the drive can be written, report DATA PROTECT otherwise
+static bool scsiDiskCheckWritable()
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    if (unlikely(blockDev.state & DISK_WP) ||
+        unlikely(scsiDev.target->cfg->deviceType == S2S_CFG_OPTICAL) ||
+        unlikely(!img.file.isWritable()) ||
+        unlikely(img.ejectFixedDiskWriteBlocked))
+    {
+        logmsg("WARNING: Host attempted write to read-only drive ID ", (int)(img.scsiId & S2S_CFG_TARGET_ID_BITS));
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = DATA_PROTECT;
+        scsiDev.target->sense.asc = WRITE_PROTECTED;
+        scsiDev.phase = STATUS;
+        return false;
+    }
+    return true;
+}
+
+// Try to fill the range using SD card erase.
+// Succeeds only if the erased sectors read back as the given pattern sector.
+// Small ranges are only erased if the host requested unmapping.
+static bool scsiDiskEraseWithPattern(uint32_t lba, uint32_t blocks, const uint8_t *pattern, bool unmap)
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
     uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
-    uint32_t capacity = img.file.size() / bytesPerSector;
 
-    uint32_t writesame_count = 0;
-    if(blocks == 0)
-        writesame_count = capacity - lba;
-    else
-        writesame_count = blocks;
+    // Cards erase to either all zeros or all ones
+    if (pattern[0] != 0x00 && pattern[0] != 0xFF)
+    {
+        return false;
+    }
+    for (uint32_t i = 1; i < bytesPerSector; i++)
+    {
+        if (pattern[i] != pattern[0]) return false;
+    }
 
-    dbgmsg("------ Write Same ", (int)writesame_count, "x", (int)bytesPerSector, " starting at ", (int)lba);
+    if (!unmap && (uint64_t)blocks * bytesPerSector < sizeof(scsiDev.data))
+    {
+        // Small range is faster to just write
+        return false;
+    }
 
+    uint64_t pos = (uint64_t)lba * bytesPerSector;
+    if (!img.file.erase(pos, (uint64_t)blocks * bytesPerSector))
+    {
+        return false;
+    }
 
+    uint8_t *readback = scsiDev.data + bytesPerSector;
+    if (!img.file.seek(pos) || img.file.read(readback, bytesPerSector) != bytesPerSector ||
+        memcmp(readback, pattern, bytesPerSector) != 0)
+    {
+        dbgmsg("---- SD card erase did not produce requested pattern, writing it instead");
+        return false;
+    }
+
+    dbgmsg("---- Erased ", (int)blocks, " sectors starting at ", (int)lba);
+    return true;
+}
+
+// WRITE SAME(10) and WRITE SAME(16)
+// Large ranges with all zeros or all ones pattern are handled by SD card erase,
+// which also lets the card reclaim the space. With the UNMAP bit set this is
+// done for any range size. Other ranges are written with the pattern
+// replicated to fill the whole buffer.
+void scsiDiskWriteSame(uint32_t lba, uint32_t blocks, bool unmap)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
+    uint32_t capacity = img.file.size() / bytesPerSector;
+
+    if (!scsiDiskCheckWritable())
+    {
+        return;
+    }
 
     if (unlikely(((uint64_t) lba) + blocks > capacity))
     {
@@ -3460,10 +3907,31 @@ void scsiDiskWriteSame(uint32_t lba, uint32_t blocks)
         return;
     }
 
+    // Zero block count means until the end of the medium
+    uint32_t writesame_count = (blocks == 0) ? capacity - lba : blocks;
+
+    dbgmsg("------ Write Same ", (int)writesame_count, "x", (int)bytesPerSector, " starting at ", (int)lba);
+
     int parityError = 0;
     // Read exactly one block from the host, then replicate it
     scsiEnterPhase(DATA_OUT);
     scsiRead(scsiDev.data, bytesPerSector, &parityError);
+    if (parityError && (scsiDev.boardCfg.flags & S2S_CFG_ENABLE_PARITY))
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ABORTED_COMMAND;
+        scsiDev.target->sense.asc = SCSI_PARITY_ERROR;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    scsiDiskPrefetchInvalidate(scsiDev.target->targetId, lba, writesame_count);
+
+    if (scsiDiskEraseWithPattern(lba, writesame_count, scsiDev.data, unmap))
+    {
+        scsiDev.phase = STATUS;
+        return;
+    }
 
     const uint32_t buffer_sectors = sizeof(scsiDev.data) / bytesPerSector;
     uint32_t sectors_to_write = std::min(writesame_count, buffer_sectors);
@@ -3495,10 +3963,85 @@ void scsiDiskWriteSame(uint32_t lba, uint32_t blocks)
         writesame_count -= sectors_to_write;
         platform_reset_watchdog();
     }
+    img.file.flush();
+    scsiDev.phase = STATUS;
+}
+
+// Callback from the data out phase of UNMAP command.
+// Unmapping is advisory, ranges that cannot be erased are left as they are.
+static void doUnmapParameters(void)
+{
+    image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
+    uint32_t bytesPerSector = scsiDev.target->liveCfg.bytesPerSector;
+    uint64_t capacity = img.file.size() / bytesPerSector;
+
+    uint32_t descLength = ((uint32_t)scsiDev.data[2] << 8) | scsiDev.data[3];
+    if (descLength > (uint32_t)scsiDev.dataLen - 8)
+    {
+        descLength = scsiDev.dataLen - 8;
+    }
+
+    scsiDiskPrefetchInvalidate(scsiDev.target->targetId);
+
+    for (uint32_t offset = 8; offset + 16 <= descLength + 8; offset += 16)
+    {
+        const uint8_t *desc = &scsiDev.data[offset];
+        uint64_t lba = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            lba = (lba << 8) | desc[i];
+        }
+        uint32_t blocks = ((uint32_t)desc[8] << 24) | ((uint32_t)desc[9] << 16) |
+                          ((uint32_t)desc[10] << 8) | desc[11];
+
+        if (lba > capacity || blocks > capacity - lba)
+        {
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = ILLEGAL_REQUEST;
+            scsiDev.target->sense.asc = LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+            break;
+        }
+
+        if (blocks > 0 && img.file.erase(lba * bytesPerSector, (uint64_t)blocks * bytesPerSector))
+        {
+            dbgmsg("---- Unmapped ", (int)blocks, " sectors starting at ", (int)lba);
+        }
+    }
+
     scsiDev.phase = STATUS;
+}
 
+extern "C"
+int scsiDiskHasProvisioning(void)
+{
+    return scsiDiskCanErase();
+}
+
+extern "C"
+uint32_t scsiDiskProvisioningVPD(uint8_t pageCode, uint8_t *buf)
+{
+    if (pageCode == 0xB0)
+    {
+        // Block Limits, UNMAP parameter list must fit in scsiDev.data
+        memset(buf, 0, 64);
+        buf[1] = 0xB0;
+        buf[3] = 0x3C;
+        storeBe32(buf + 20, 0xFFFFFFFF); // Maximum unmap LBA count
+        storeBe32(buf + 24, (sizeof(scsiDev.data) - 8) / 16); // Maximum unmap block descriptor count
+        return 64;
+    }
+    else if (pageCode == 0xB2)
+    {
+        // Logical Block Provisioning
+        memset(buf, 0, 8);
+        buf[1] = 0xB2;
+        buf[3] = 0x04;
+        buf[5] = 0xE0; // LBPU, LBPWS, LBPWS10: UNMAP and WRITE SAME with UNMAP bit
+        buf[6] = 0x02; // Thin provisioned
+        return 8;
+    }
+    return 0;
 }
-#endif
 
 #ifdef PLATFORM_AS400
 int skip_total_true_bits(uint8_t *mask, size_t masklen) {
@@ -3916,14 +4459,98 @@ int scsiDiskCommand()
             scsiDiskStartWriteAndVerify((uint32_t)lba, blocks);
         }
     }
+    else if (unlikely(command == 0x41 || command == 0x93))
+    {
+        // WRITE SAME(10) and WRITE SAME(16)
+        // PBdata, LBdata, RelAdr not implemented.
+        // UNMAP bit requests SD card erase also for small ranges, it is
+        // handled as a normal write if the image cannot be erased.
+        uint64_t lba;
+        uint32_t blocks;
+        if (command == 0x41)
+        {
+            lba =
+                (((uint32_t) scsiDev.cdb[2]) << 24) +
+                (((uint32_t) scsiDev.cdb[3]) << 16) +
+                (((uint32_t) scsiDev.cdb[4]) << 8) +
+                scsiDev.cdb[5];
+            blocks =
+                (((uint32_t) scsiDev.cdb[7]) << 8) +
+                scsiDev.cdb[8];
+        }
+        else
+        {
+            lba =
+                (((uint64_t) scsiDev.cdb[2]) << 56) +
+                (((uint64_t) scsiDev.cdb[3]) << 48) +
+                (((uint64_t) scsiDev.cdb[4]) << 40) +
+                (((uint64_t) scsiDev.cdb[5]) << 32) +
+                (((uint64_t) scsiDev.cdb[6]) << 24) +
+                (((uint64_t) scsiDev.cdb[7]) << 16) +
+                (((uint64_t) scsiDev.cdb[8]) << 8) +
+                scsiDev.cdb[9];
+            blocks =
+                (((uint32_t) scsiDev.cdb[10]) << 24) +
+                (((uint32_t) scsiDev.cdb[11]) << 16) +
+                (((uint32_t) scsiDev.cdb[12]) << 8) +
+                scsiDev.cdb[13];
+        }
+
+        if (lba > UINT32_MAX)
+        {
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = ILLEGAL_REQUEST;
+            scsiDev.target->sense.asc = LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE;
+            scsiDev.phase = STATUS;
+        }
+        else
+        {
+            bool unmap = (scsiDev.cdb[1] & 0x08) != 0;
+            scsiDiskWriteSame((uint32_t)lba, blocks, unmap);
+        }
+    }
+    else if (unlikely(command == 0x42))
+    {
+        // UNMAP
+        uint32_t paramLength =
+            (((uint32_t) scsiDev.cdb[7]) << 8) +
+            scsiDev.cdb[8];
+
+        if (!scsiDiskCheckWritable())
+        {
+            // Status already set
+        }
+        else if (paramLength < 8)
+        {
+            // No block descriptors, nothing to do
+        }
+        else if (paramLength > sizeof(scsiDev.data))
+        {
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = ILLEGAL_REQUEST;
+            scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+            scsiDev.phase = STATUS;
+        }
+        else
+        {
+            scsiDev.dataLen = paramLength;
+            scsiDev.phase = DATA_OUT;
+            scsiDev.postDataOutHook = doUnmapParameters;
+        }
+    }
     else if (unlikely(command == 0x04))
     {
         // FORMAT UNIT
-        // We don't really do any formatting, but we need to read the correct
-        // number of bytes in the DATA_OUT phase to make the SCSI host happy.
+        // The parameter list is read to make the SCSI host happy, but
+        // only used for saving parameters. Images that map directly to
+        // SD card sectors are erased, other images are left as they are.
 
         int fmtData = (scsiDev.cdb[1] & 0x10) ? 1 : 0;
-        if (fmtData)
+        if (!scsiDiskCheckWritable())
+        {
+            // Status already set
+        }
+        else if (fmtData)
         {
             // We need to read the parameter list, but we don't know how
             // big it is yet. Start with the header.
@@ -3934,6 +4561,7 @@ int scsiDiskCommand()
         else
         {
             // No data to read, we're already finished!
+            doFormatUnitErase();
         }
     }
     else if (unlikely(command == 0x25))
@@ -3982,12 +4610,61 @@ int scsiDiskCommand()
     else if (unlikely(command == 0x36))
     {
         // LOCK UNLOCK CACHE
-        // We don't have a cache to lock data into. do nothing.
+        uint32_t lba =
+            (((uint32_t) scsiDev.cdb[2]) << 24) +
+            (((uint32_t) scsiDev.cdb[3]) << 16) +
+            (((uint32_t) scsiDev.cdb[4]) << 8) +
+            scsiDev.cdb[5];
+        uint32_t blocks =
+            (((uint32_t) scsiDev.cdb[7]) << 8) +
+            scsiDev.cdb[8];
+        bool lock = scsiDev.cdb[1] & 0x02;
+
+        if (lock)
+        {
+            scsiDiskPrefetchRange(lba, blocks, false, true);
+        }
+        else
+        {
+            scsiDiskUnlockCache(lba, blocks);
+        }
     }
-    else if (unlikely(command == 0x34))
+    else if (unlikely(command == 0x34 || command == 0x90))
     {
-        // PRE-FETCH.
-        // We don't have a cache to pre-fetch into. do nothing.
+        // PRE-FETCH(10) and PRE-FETCH(16)
+        uint64_t lba;
+        uint32_t blocks;
+        if (command == 0x34)
+        {
+            lba =
+                (((uint32_t) scsiDev.cdb[2]) << 24) +
+                (((uint32_t) scsiDev.cdb[3]) << 16) +
+                (((uint32_t) scsiDev.cdb[4]) << 8) +
+                scsiDev.cdb[5];
+            blocks =
+                (((uint32_t) scsiDev.cdb[7]) << 8) +
+                scsiDev.cdb[8];
+        }
+        else
+        {
+            lba =
+                (((uint64_t) scsiDev.cdb[2]) << 56) +
+                (((uint64_t) scsiDev.cdb[3]) << 48) +
+                (((uint64_t) scsiDev.cdb[4]) << 40) +
+                (((uint64_t) scsiDev.cdb[5]) << 32) +
+                (((uint64_t) scsiDev.cdb[6]) << 24) +
+                (((uint64_t) scsiDev.cdb[7]) << 16) +
+                (((uint64_t) scsiDev.cdb[8]) << 8) +
+                scsiDev.cdb[9];
+            blocks =
+                (((uint32_t) scsiDev.cdb[10]) << 24) +
+                (((uint32_t) scsiDev.cdb[11]) << 16) +
+                (((uint32_t) scsiDev.cdb[12]) << 8) +
+                scsiDev.cdb[13];
+        }
+        bool immed = scsiDev.cdb[1] & 0x02;
+
+        scsiDiskPrefetchRange(lba, blocks, immed, false);
     }
     else if (unlikely(command == 0x1E))
     {
@@ -4003,7 +4680,14 @@ int scsiDiskCommand()
     else if (unlikely(command == 0x35))
     {
         // SYNCHRONIZE CACHE
-        // We don't have a cache. do nothing.
+        // Only RAM disk images have data that is not yet on SD card.
+        if (!img.file.sync())
+        {
+            scsiDev.status = CHECK_CONDITION;
+            scsiDev.target->sense.code = MEDIUM_ERROR;
+            scsiDev.target->sense.asc = WRITE_ERROR_AUTO_REALLOCATION_FAILED;
+            scsiDev.phase = STATUS;
+        }
     }
     else if (unlikely(command == 0x2F))
     {
@@ -4074,6 +4758,20 @@ int scsiDiskCommand()
 
         scsiDev.phase = DATA_IN;
     }
+    else if (unlikely(command == 0x4D)
+#ifdef PLATFORM_AS400
+        && scsiDev.target->cfg->quirks != S2S_CFG_QUIRKS_AS400
+#endif
+        )
+    {
+        // LOG SENSE
+        scsiStatsLogSense();
+    }
+    else if (unlikely(command == 0x4C))
+    {
+        // LOG SELECT
+        scsiStatsLogSelect();
+    }
     else if (!img.file.isWritable() || img.ejectFixedDiskWriteBlocked)
     {
         // Special handling for ROM drive to make SCSI2SD code report it as read-only
@@ -4082,20 +4780,6 @@ int scsiDiskCommand()
         blockDev.state &= ~DISK_WP;
     }
 #ifdef PLATFORM_AS400
-    else if (likely(command == 0x41))
-    {
-         // Write Same(10)
-        // PBdata, LBdata, RelAdr not implemented
-        uint32_t lba =
-            (((uint32_t) scsiDev.cdb[2]) << 24) +
-            (((uint32_t) scsiDev.cdb[3]) << 16) +
-            (((uint32_t) scsiDev.cdb[4]) << 8) +
-            scsiDev.cdb[5];
-        uint32_t blocks =
-            (((uint32_t) scsiDev.cdb[7]) << 8) +
-            scsiDev.cdb[8];
-        scsiDiskWriteSame(lba, blocks);
-    }
     else if (likely(command == 0xEA) || likely(command == 0xE8))
     {
         // 0xEA = Skip Write(10), 0xE8 = Skip Read(10) (AS/400 vendor commands)
@@ -4198,6 +4882,12 @@ void scsiDiskPoll()
         }
     }
 
+    if (scsiDev.phase == BUS_FREE)
+    {
+        // Continue loading host cache while there is no SCSI activity
+        scsiDiskHostCacheLoad(HOST_CACHE_LOAD_BYTES);
+    }
+
     if (scsiDev.phase == STATUS && scsiDev.target)
     {
         // Check if the command is affected by drive geometry.
@@ -4240,6 +4930,7 @@ void scsiDiskReset()
     g_disk_data_out.write_and_verify = false;
 
     scsiDiskPrefetchInvalidate();
+    scsiDiskHostCacheRelease();
 
 #ifdef ENABLE_AUDIO_OUTPUT
     audio_stop(0xFF, true);
@@ -150,6 +150,9 @@ void scsiDiskResetImages();
 // Close any files opened from SD card (prepare for remounting SD)
 void scsiDiskCloseSDCardImages();
 
+// Write changed RAM disk data back to the image files on SD card
+void scsiDiskSyncRamImages();
+
 // Get blocksize from filename or use device setting in ini file
 uint32_t getBlockSize(const char *filename, uint8_t scsi_id);
 
@@ -250,13 +253,18 @@ uint8_t *scsiDiskPrefetchBeginWrite(uint8_t scsiId, uint32_t firstSector, uint32
 // Should be called after scsiDiskPrefetchBeginWrite().
 void scsiDiskPrefetchFinishWrite(uint8_t scsiId, uint32_t firstSector, uint32_t bytesPerSector, uint32_t numSectors);
 
-// Check if data is available from prefetch buffer.
+// Check if data is available from host cache or prefetch buffer.
 // If data is not found, returns NULL.
 // Otherwise returns pointer for reading up to numSectors sectors of data, beginning at firstSector.
 const uint8_t *scsiDiskPrefetchRead(uint8_t scsiId, uint32_t firstSector, uint32_t bytesPerSector, uint32_t *numSectors);
 
-// Invalidate SCSI prefetch buffer
 // Invalidate SCSI prefetch buffer.
 // If scsiId is given, only invalidate if that device has data in buffer.
 // If scsiId is not given (value -1), invalidate for all devices.
-void scsiDiskPrefetchInvalidate(uint8_t scsiId = (uint8_t)-1);
+// Host cache sectors in the given range are reloaded from the image,
+// and background defragmentation copies the range again.
+void scsiDiskPrefetchInvalidate(uint8_t scsiId = (uint8_t)-1, uint32_t lba = 0, uint32_t blocks = UINT32_MAX);
+
+// Drop host cache contents loaded with PRE-FETCH and release LOCK UNLOCK CACHE lock.
+// If scsiId is not given (value -1), release for all devices.
+void scsiDiskHostCacheRelease(uint8_t scsiId = (uint8_t)-1);
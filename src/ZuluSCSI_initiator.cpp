@@ -34,6 +34,7 @@
 #include <minIni.h>
 #include "SdFat.h"
 #include "vhd_support.h"
+#include "sha256.h"
 #include "ui.h"
 #include "ZuluSCSI_disk.h"
 #include <numeric>
@@ -113,9 +114,84 @@ static struct {
     // Negotiated bus width for targets
     int targetBusWidth[S2S_MAX_TARGETS];
 
+    // Adjust number of sectors per READ command based on measured throughput
+    bool adaptive_transfer;
+
+    // Sparse output: the preallocated image area is erased before imaging and
+    // sectors that match the erased state are not written (opt-in via InitiatorSparse=1)
+    bool use_sparse;
+    bool sparse_active;
+    uint8_t sparse_fill; // Value of erased bytes
+    uint64_t sparse_skipped_bytes;
+
+    // Write SHA-256 of the image to <image>.sha256 (opt-in via InitiatorSHA256=1)
+    bool use_sha256;
+
+    char filename[32];
     FsFile target_file;
 } g_initiator_state;
 
+// SHA-256 of the image is computed on the second core where available,
+// in parallel with SD card writes and SCSI reads.
+static struct {
+    sha256_ctx_t ctx;
+    sha256_ctx_t ctx_saved; // State at start of current READ command, restored if it fails
+    const uint8_t *buf;
+    uint32_t len;
+    uint32_t start; // Transfer byte position of buf
+    volatile uint32_t done; // Transfer byte position up to which data has been hashed
+    volatile bool busy;
+} g_initiator_hash;
+
+// This uses callbacks to run SD and SCSI transfers in parallel
+static struct {
+    uint32_t bytes_sd; // Number of bytes that have been transferred on SD card side
+    uint32_t bytes_sd_scheduled; // Number of bytes scheduled for transfer on SD card side
+    uint32_t bytes_scsi; // Number of bytes that have been scheduled for transfer on SCSI side
+    uint32_t bytes_scsi_done; // Number of bytes that have been transferred on SCSI side
+
+    uint32_t bytes_per_sector;
+    bool all_ok;
+
+    // Phase durations of the latest command, in microseconds
+    uint32_t us_command;
+    uint32_t us_data;
+    uint32_t us_scsi_read;
+    uint32_t us_status;
+} g_initiator_transfer;
+
+// Adaptive transfer size control.
+// Transfer size starts small and is doubled while the measured throughput keeps
+// improving, up to max_sector_per_transfer. It is reduced again if a larger size
+// turns out slower, if commands take too long or if a read fails.
+#define INITIATOR_ADAPT_START_BYTES 16384
+#define INITIATOR_ADAPT_SAMPLES 4
+#define INITIATOR_ADAPT_HOLD 64
+#define INITIATOR_ADAPT_MAX_LATENCY_MS 2000
+
+static struct {
+    uint32_t sectors; // Current number of sectors per READ command
+    uint32_t prev_sectors; // Transfer size before the latest increase
+    uint32_t prev_kbps; // Throughput measured at prev_sectors, 0 if not probing
+    uint32_t sample_bytes; // Bytes transferred at current size
+    uint32_t sample_us; // Time spent transferring at current size
+    uint32_t sample_count; // Commands completed at current size
+    uint32_t hold; // Number of commands to wait before trying larger transfers again
+} g_initiator_adapt;
+
+// Per-phase timing statistics for the drive currently being imaged
+static struct {
+    uint64_t bytes;
+    uint64_t us_total; // From selection until bus free
+    uint64_t us_command; // Selection and command phases until target enters DATA IN
+    uint64_t us_data; // DATA IN phase, including SD writes that overlap it
+    uint64_t us_scsi_read; // Time spent waiting for data from the SCSI bus
+    uint64_t us_status; // Remaining SD writes, STATUS and MESSAGE IN phases
+    uint32_t us_max_latency;
+    uint32_t commands;
+    uint32_t start_ms;
+} g_initiator_stats;
+
 extern SdFs SD;
 static bool g_pause = false;
 
@@ -137,6 +213,10 @@ void scsiInitiatorInit()
     g_initiator_state.max_retry_count = ini_getl("SCSI", "InitiatorMaxRetry", 5, CONFIGFILE);
     g_initiator_state.use_read10 = ini_getbool("SCSI", "InitiatorUseRead10", false, CONFIGFILE);
     g_initiator_state.use_vhd_format = ini_getbool("SCSI", "InitiatorVHD", false, CONFIGFILE);
+    g_initiator_state.adaptive_transfer = ini_getbool("SCSI", "InitiatorAdaptiveTransfer", true, CONFIGFILE);
+    g_initiator_state.use_sparse = ini_getbool("SCSI", "InitiatorSparse", false, CONFIGFILE);
+    g_initiator_state.use_sha256 = ini_getbool("SCSI", "InitiatorSHA256", false, CONFIGFILE);
+    g_initiator_state.sparse_active = false;
 
     // treat initiator id as already imaged drive so it gets skipped
     g_initiator_state.drives_imaged = 1 << g_initiator_state.initiator_id;
@@ -242,6 +322,312 @@ static bool initiatorShouldWriteVhd()
            !g_initiator_state.removable;
 }
 
+// Hash data that has been received from SCSI bus
+static void scsiInitiatorHashJob()
+{
+    const uint8_t *buf = g_initiator_hash.buf;
+    uint32_t len = g_initiator_hash.len;
+    uint32_t pos = 0;
+    while (pos < len)
+    {
+        uint32_t n = len - pos;
+        if (n > SD_SECTOR_SIZE) n = SD_SECTOR_SIZE;
+        sha256_update(&g_initiator_hash.ctx, buf + pos, n);
+        pos += n;
+
+        // Let SCSI reads reuse the buffer area that has been hashed
+        __sync_synchronize();
+        g_initiator_hash.done = g_initiator_hash.start + pos;
+    }
+
+    __sync_synchronize();
+    g_initiator_hash.busy = false;
+}
+
+static void scsiInitiatorHashWait()
+{
+    while (g_initiator_hash.busy);
+    __sync_synchronize();
+}
+
+// Start hashing a block of data that is about to be written to SD card
+static void scsiInitiatorHashStart(const uint8_t *buf, uint32_t len, uint32_t start)
+{
+    if (!g_initiator_state.use_sha256 || len == 0)
+        return;
+
+    scsiInitiatorHashWait();
+    g_initiator_hash.buf = buf;
+    g_initiator_hash.len = len;
+    g_initiator_hash.start = start;
+    g_initiator_hash.busy = true;
+    __sync_synchronize();
+
+#ifdef PLATFORM_HAS_CORE1_DISPATCH
+    platform_core1_dispatch(&scsiInitiatorHashJob);
+#else
+    scsiInitiatorHashJob();
+#endif
+}
+
+// Write the hash in sha256sum compatible format next to the image
+static void scsiInitiatorWriteHashFile()
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    scsiInitiatorHashWait();
+    sha256_final(&g_initiator_hash.ctx, digest);
+
+    char hexdigest[SHA256_DIGEST_SIZE * 2 + 1];
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++)
+    {
+        snprintf(hexdigest + i * 2, 3, "%02x", digest[i]);
+    }
+
+    char hashfilename[sizeof(g_initiator_state.filename) + 8];
+    snprintf(hashfilename, sizeof(hashfilename), "%s.sha256", g_initiator_state.filename);
+
+    char line[sizeof(hexdigest) + sizeof(g_initiator_state.filename) + 4];
+    int linelen = snprintf(line, sizeof(line), "%s  %s\n", hexdigest, g_initiator_state.filename);
+
+    FsFile hashfile = SD.open(hashfilename, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!hashfile.isOpen() || hashfile.write(line, linelen) != (size_t)linelen)
+    {
+        logmsg("WARNING: Failed to write ", hashfilename);
+    }
+    else
+    {
+        logmsg("Image SHA-256 ", hexdigest, " written to ", hashfilename);
+    }
+    hashfile.close();
+}
+
+// Erase the preallocated image area so that blank sectors do not need to be written.
+// Returns true if the area reads back as erased.
+static bool scsiInitiatorPrepareSparse(FsFile &file, uint64_t size)
+{
+    uint32_t begin = 0, end = 0;
+    uint32_t count = (size + SD_SECTOR_SIZE - 1) / SD_SECTOR_SIZE;
+    if (count == 0 || !file.contiguousRange(&begin, &end) || end - begin + 1 < count)
+    {
+        logmsg("-- Image file is not contiguous, sparse output disabled");
+        return false;
+    }
+
+    uint32_t last = begin + count - 1;
+    if (!SD.card()->erase(begin, last))
+    {
+        logmsg("-- SD card erase failed, sparse output disabled");
+        return false;
+    }
+
+    // Cards report either all zeros or all ones after erase
+    uint8_t *buf = scsiDev.data;
+    if (!SD.card()->readSector(begin, buf) || !SD.card()->readSector(last, buf + SD_SECTOR_SIZE) ||
+        (buf[0] != 0x00 && buf[0] != 0xFF))
+    {
+        logmsg("-- SD card erase state unknown, sparse output disabled");
+        return false;
+    }
+
+    for (uint32_t i = 1; i < 2 * SD_SECTOR_SIZE; i++)
+    {
+        if (buf[i] != buf[0])
+        {
+            logmsg("-- SD card area did not erase, sparse output disabled");
+            return false;
+        }
+    }
+
+    g_initiator_state.sparse_fill = buf[0];
+    g_initiator_state.sparse_skipped_bytes = 0;
+    logmsg("-- Sparse output enabled, erased sectors read as 0x", g_initiator_state.sparse_fill);
+    return true;
+}
+
+// Check if a SD sector worth of data matches the erased state
+static bool scsiInitiatorIsErasedSector(const uint8_t *buf, uint8_t fill)
+{
+    if (((uintptr_t)buf & 3) == 0)
+    {
+        uint32_t fill32 = fill * 0x01010101U;
+        const uint32_t *p = (const uint32_t*)buf;
+        for (int i = 0; i < SD_SECTOR_SIZE / 4; i++)
+        {
+            if (p[i] != fill32) return false;
+        }
+    }
+    else
+    {
+        for (int i = 0; i < SD_SECTOR_SIZE; i++)
+        {
+            if (buf[i] != fill) return false;
+        }
+    }
+    return true;
+}
+
+// Get length of the run of either erased or non-erased sectors at start of buffer
+static uint32_t scsiInitiatorSparseRun(const uint8_t *buf, uint32_t len, bool *erased)
+{
+    *erased = false;
+    if (len < SD_SECTOR_SIZE)
+        return len;
+
+    uint8_t fill = g_initiator_state.sparse_fill;
+    *erased = scsiInitiatorIsErasedSector(buf, fill);
+    uint32_t run = SD_SECTOR_SIZE;
+    while (run + SD_SECTOR_SIZE <= len && scsiInitiatorIsErasedSector(buf + run, fill) == *erased)
+    {
+        run += SD_SECTOR_SIZE;
+    }
+
+    if (!*erased && len - run < SD_SECTOR_SIZE)
+    {
+        // Partial sector at end is written along with the preceding data
+        run = len;
+    }
+
+    return run;
+}
+
+// Select initial transfer size when imaging starts
+static void scsiInitiatorAdaptReset()
+{
+    uint32_t max_sectors = g_initiator_state.max_sector_per_transfer;
+    uint32_t sectors = max_sectors;
+    if (g_initiator_state.adaptive_transfer && g_initiator_state.sectorsize > 0)
+    {
+        sectors = INITIATOR_ADAPT_START_BYTES / g_initiator_state.sectorsize;
+        if (sectors < 1) sectors = 1;
+        if (sectors > max_sectors) sectors = max_sectors;
+    }
+
+    memset(&g_initiator_adapt, 0, sizeof(g_initiator_adapt));
+    g_initiator_adapt.sectors = sectors;
+    g_initiator_adapt.prev_sectors = sectors;
+
+    memset(&g_initiator_stats, 0, sizeof(g_initiator_stats));
+    g_initiator_stats.start_ms = millis();
+}
+
+// Update transfer size after a successful read command
+static void scsiInitiatorAdaptSuccess(uint32_t sectors, uint32_t elapsed_us)
+{
+    if (!g_initiator_state.adaptive_transfer)
+        return;
+
+    uint32_t max_sectors = g_initiator_state.max_sector_per_transfer;
+
+    if (elapsed_us > INITIATOR_ADAPT_MAX_LATENCY_MS * 1000 && g_initiator_adapt.sectors > 1)
+    {
+        // Very long commands delay eject button handling and retries, prefer smaller transfers
+        g_initiator_adapt.sectors /= 2;
+        g_initiator_adapt.prev_sectors = g_initiator_adapt.sectors;
+        g_initiator_adapt.prev_kbps = 0;
+        g_initiator_adapt.sample_bytes = g_initiator_adapt.sample_us = g_initiator_adapt.sample_count = 0;
+        g_initiator_adapt.hold = INITIATOR_ADAPT_HOLD;
+        dbgmsg("-- Command took ", (int)(elapsed_us / 1000), " ms, reducing transfer size to ", (int)g_initiator_adapt.sectors, " sectors");
+        return;
+    }
+
+    if (sectors != g_initiator_adapt.sectors)
+    {
+        // Retry or end of drive, not representative of the current transfer size
+        return;
+    }
+
+    g_initiator_adapt.sample_bytes += sectors * g_initiator_state.sectorsize;
+    g_initiator_adapt.sample_us += elapsed_us;
+    g_initiator_adapt.sample_count++;
+    if (g_initiator_adapt.sample_count < INITIATOR_ADAPT_SAMPLES)
+        return;
+
+    uint32_t sample_us = g_initiator_adapt.sample_us;
+    if (sample_us == 0) sample_us = 1;
+    uint32_t kbps = (uint64_t)g_initiator_adapt.sample_bytes * 1000 / sample_us;
+    uint32_t prev_kbps = g_initiator_adapt.prev_kbps;
+    g_initiator_adapt.sample_bytes = g_initiator_adapt.sample_us = g_initiator_adapt.sample_count = 0;
+
+    if (prev_kbps != 0 && (uint64_t)kbps * 100 < (uint64_t)prev_kbps * 95)
+    {
+        // Larger transfers were slower, go back and stay there for a while
+        dbgmsg("-- ", (int)sectors, " sectors per transfer gave ", (int)kbps, " kB/s, returning to ",
+               (int)g_initiator_adapt.prev_sectors, " sectors (", (int)prev_kbps, " kB/s)");
+        g_initiator_adapt.sectors = g_initiator_adapt.prev_sectors;
+        g_initiator_adapt.prev_kbps = 0;
+        g_initiator_adapt.hold = INITIATOR_ADAPT_HOLD;
+    }
+    else if (g_initiator_adapt.hold > 0)
+    {
+        g_initiator_adapt.hold -= (g_initiator_adapt.hold > INITIATOR_ADAPT_SAMPLES) ? INITIATOR_ADAPT_SAMPLES : g_initiator_adapt.hold;
+    }
+    else if (sectors < max_sectors && (prev_kbps == 0 || (uint64_t)kbps * 100 >= (uint64_t)prev_kbps * 105))
+    {
+        // Throughput is still improving, try larger transfers
+        g_initiator_adapt.prev_sectors = sectors;
+        g_initiator_adapt.prev_kbps = kbps;
+        g_initiator_adapt.sectors = (sectors * 2 > max_sectors) ? max_sectors : sectors * 2;
+        dbgmsg("-- ", (int)sectors, " sectors per transfer gave ", (int)kbps, " kB/s, trying ",
+               (int)g_initiator_adapt.sectors, " sectors");
+    }
+    else
+    {
+        // Throughput has leveled off, probe again later in case the drive behaves differently
+        g_initiator_adapt.prev_kbps = 0;
+        g_initiator_adapt.hold = INITIATOR_ADAPT_HOLD;
+    }
+}
+
+// Reduce transfer size after a failed read command
+static void scsiInitiatorAdaptFailure()
+{
+    if (!g_initiator_state.adaptive_transfer)
+        return;
+
+    if (g_initiator_adapt.sectors > 1)
+        g_initiator_adapt.sectors /= 2;
+
+    g_initiator_adapt.prev_sectors = g_initiator_adapt.sectors;
+    g_initiator_adapt.prev_kbps = 0;
+    g_initiator_adapt.sample_bytes = g_initiator_adapt.sample_us = g_initiator_adapt.sample_count = 0;
+    g_initiator_adapt.hold = INITIATOR_ADAPT_HOLD;
+}
+
+static uint32_t kbps_from_us(uint64_t bytes, uint64_t us)
+{
+    if (us == 0) return 0;
+    return (uint32_t)(bytes * 1000 / us);
+}
+
+// Log summary of achieved transfer speeds in each phase of the READ commands
+static void scsiInitiatorLogTransferStats()
+{
+    uint32_t commands = g_initiator_stats.commands;
+    if (commands == 0)
+        return;
+
+    int target_id = g_initiator_state.target_id;
+    logmsg("Transfer statistics for SCSI ID ", target_id, ":");
+    logmsg("-- Bus mode: ", 8 << g_initiator_state.targetBusWidth[target_id], " bit asynchronous",
+           ", final transfer size ", (int)g_initiator_adapt.sectors, " sectors");
+    logmsg("-- Overall: ", (int)kbps_from_us(g_initiator_stats.bytes, (uint64_t)(millis() - g_initiator_stats.start_ms) * 1000), " kB/s",
+           ", READ commands: ", (int)kbps_from_us(g_initiator_stats.bytes, g_initiator_stats.us_total), " kB/s in ",
+           (int)commands, " commands, max latency ", (int)(g_initiator_stats.us_max_latency / 1000), " ms");
+    logmsg("-- Command phase: ", (int)(g_initiator_stats.us_command / commands), " us average");
+    logmsg("-- Data phase: ", (int)kbps_from_us(g_initiator_stats.bytes, g_initiator_stats.us_data), " kB/s",
+           ", SCSI bus reads: ", (int)kbps_from_us(g_initiator_stats.bytes, g_initiator_stats.us_scsi_read), " kB/s");
+    logmsg("-- Status phase: ", (int)(g_initiator_stats.us_status / commands), " us average");
+
+    if (g_initiator_stats.us_scsi_read * 10 >= g_initiator_stats.us_data * 9)
+    {
+        logmsg("-- Data phase was limited by the SCSI drive or bus speed");
+    }
+    else
+    {
+        logmsg("-- Data phase was limited by SD card write speed");
+    }
+}
+
 // High level logic of the initiator mode
 void scsiInitiatorMainLoop()
 {
@@ -448,6 +834,7 @@ void scsiInitiatorMainLoop()
                 }
 
 
+
                 logmsg("SCSI Version ", (int) g_initiator_state.ansi_version);
                 logmsg("[SCSI", g_initiator_state.target_id,"]");
                 logmsg("  Vendor = \"", vendor,"\"");
@@ -605,19 +992,41 @@ void scsiInitiatorMainLoop()
                     return;
                 }
 
-                if (SD.fatType() == FAT_TYPE_EXFAT)
+                uint64_t image_size = (uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize + vhd_overhead;
+                g_initiator_state.sparse_active = false;
+                if (g_initiator_state.use_sparse)
+                {
+                    // Sparse output erases the whole preallocated area before imaging,
+                    // so interrupted writes will not leave garbage data in the file.
+                    logmsg("Preallocating and erasing image file for sparse output");
+                    if (g_initiator_state.target_file.preAllocate(image_size))
+                    {
+                        g_initiator_state.sparse_active = scsiInitiatorPrepareSparse(g_initiator_state.target_file, image_size);
+                    }
+                    else
+                    {
+                        logmsg("-- Preallocation failed, sparse output disabled");
+                    }
+                }
+                else if (SD.fatType() == FAT_TYPE_EXFAT)
                 {
                     // Only preallocate on exFAT, on FAT32 preallocating can result in false garbage data in the
                     // file if write is interrupted.
                     logmsg("Preallocating image file");
-                    g_initiator_state.target_file.preAllocate(
-                        (uint64_t)g_initiator_state.sectorcount * g_initiator_state.sectorsize + vhd_overhead
-                    );
+                    g_initiator_state.target_file.preAllocate(image_size);
+                }
+
+                if (g_initiator_state.use_sha256)
+                {
+                    sha256_init(&g_initiator_hash.ctx);
                 }
+                strncpy(g_initiator_state.filename, filename, sizeof(g_initiator_state.filename) - 1);
+                g_initiator_state.filename[sizeof(g_initiator_state.filename) - 1] = '\0';
 
                 UIInitiatorTargetFilename(g_initiator_state.target_id, filename);
 
                 logmsg("Starting to copy drive data to ", filename);
+                scsiInitiatorAdaptReset();
                 g_initiator_state.imaging = true;
             }
         }
@@ -641,6 +1050,8 @@ void scsiInitiatorMainLoop()
                 logmsg("Please reformat the SD card with exFAT format to image this drive fully");
             }
 
+            scsiInitiatorLogTransferStats();
+
             if(g_initiator_state.bad_sector_count != 0)
             {
                 // GT TODO
@@ -671,6 +1082,23 @@ void scsiInitiatorMainLoop()
                 {
                     logmsg("WARNING: Failed to write VHD footer");
                 }
+
+                if (g_initiator_state.use_sha256)
+                {
+                    // Hash covers the file as stored, so that it can be checked with sha256sum
+                    scsiInitiatorHashWait();
+                    sha256_update(&g_initiator_hash.ctx, vhd_footer, VHD_FOOTER_SIZE);
+                }
+            }
+
+            if (g_initiator_state.sparse_active)
+            {
+                logmsg("Sparse output skipped writing ", (int)(g_initiator_state.sparse_skipped_bytes / (1024 * 1024)), " MiB of blank sectors");
+            }
+
+            if (g_initiator_state.use_sha256)
+            {
+                scsiInitiatorWriteHashFile();
             }
 
 
@@ -683,14 +1111,14 @@ void scsiInitiatorMainLoop()
 
         // How many sectors to read in one batch?
         int numtoread = g_initiator_state.sectorcount - g_initiator_state.sectors_done;
-        if (numtoread > g_initiator_state.max_sector_per_transfer)
-            numtoread = g_initiator_state.max_sector_per_transfer;
+        if (numtoread > (int)g_initiator_adapt.sectors)
+            numtoread = g_initiator_adapt.sectors;
 
         // Retry sector-by-sector after failure
         if (g_initiator_state.sectors_done < g_initiator_state.failposition)
             numtoread = 1;
 
-        uint32_t time_start = millis();
+        uint32_t time_start = micros();
         bool status = scsiInitiatorReadDataToFile(g_initiator_state.target_id,
             g_initiator_state.sectors_done, numtoread, g_initiator_state.sectorsize,
             g_initiator_state.target_file);
@@ -698,6 +1126,14 @@ void scsiInitiatorMainLoop()
         if (!status)
         {
             logmsg("Failed to transfer ", numtoread, " sectors starting at ", (int)g_initiator_state.sectors_done);
+            scsiInitiatorAdaptFailure();
+
+            if (g_initiator_state.use_sha256)
+            {
+                // Data from the failed command will be read again
+                scsiInitiatorHashWait();
+                g_initiator_hash.ctx = g_initiator_hash.ctx_saved;
+            }
 
             UIInitiatorFailedToTransfer(g_initiator_state.target_id);          
 
@@ -724,6 +1160,18 @@ void scsiInitiatorMainLoop()
             else
             {
                 logmsg("Retry limit exceeded, skipping one sector");
+
+                if (g_initiator_state.use_sha256)
+                {
+                    // Fill the unreadable sector so that the image content is known
+                    uint32_t sectorsize = g_initiator_state.sectorsize;
+                    uint8_t fill = g_initiator_state.sparse_active ? g_initiator_state.sparse_fill : 0;
+                    memset(scsiDev.data, fill, sectorsize);
+                    g_initiator_state.target_file.seek((uint64_t)g_initiator_state.sectors_done * sectorsize);
+                    g_initiator_state.target_file.write(scsiDev.data, sectorsize);
+                    sha256_update(&g_initiator_hash.ctx, scsiDev.data, sectorsize);
+                }
+
                 g_initiator_state.retrycount = 0;
                 g_initiator_state.sectors_done++;
                 g_initiator_state.bad_sector_count++;
@@ -738,13 +1186,28 @@ void scsiInitiatorMainLoop()
             g_initiator_state.sectors_done += numtoread;
             g_initiator_state.target_file.flush();
 
-            int speed_kbps = numtoread * g_initiator_state.sectorsize / (millis() - time_start);
+            uint32_t elapsed_us = micros() - time_start;
+            uint32_t bytes = numtoread * g_initiator_state.sectorsize;
+            scsiInitiatorAdaptSuccess(numtoread, elapsed_us);
+
+            g_initiator_stats.bytes += bytes;
+            g_initiator_stats.us_total += elapsed_us;
+            g_initiator_stats.us_command += g_initiator_transfer.us_command;
+            g_initiator_stats.us_data += g_initiator_transfer.us_data;
+            g_initiator_stats.us_scsi_read += g_initiator_transfer.us_scsi_read;
+            g_initiator_stats.us_status += g_initiator_transfer.us_status;
+            g_initiator_stats.commands++;
+            if (elapsed_us > g_initiator_stats.us_max_latency)
+                g_initiator_stats.us_max_latency = elapsed_us;
+
+            int speed_kbps = kbps_from_us(bytes, elapsed_us);
+            int bus_kbps = kbps_from_us(bytes, g_initiator_transfer.us_scsi_read);
             logmsg("SCSI read succeeded, sectors done: ",
                   (int)g_initiator_state.sectors_done, " / ", (int)g_initiator_state.sectorcount,
-                  " speed ", speed_kbps, " kB/s - ", 
+                  " speed ", speed_kbps, " kB/s (bus ", bus_kbps, " kB/s) - ",
                   (int)(100 * (int64_t)g_initiator_state.sectors_done / g_initiator_state.sectorcount), "%");
 
-            UIInitiatorProgress(g_initiator_state.target_id, millis() - time_start, g_initiator_state.sectors_done, numtoread);
+            UIInitiatorProgress(g_initiator_state.target_id, elapsed_us / 1000, g_initiator_state.sectors_done, numtoread);
         }
     }
 }
@@ -1220,17 +1683,6 @@ bool scsiInitiatorSetBusWidth(int target_id, int busWidth)
 }
 #endif
 
-// This uses callbacks to run SD and SCSI transfers in parallel
-static struct {
-    uint32_t bytes_sd; // Number of bytes that have been transferred on SD card side
-    uint32_t bytes_sd_scheduled; // Number of bytes scheduled for transfer on SD card side
-    uint32_t bytes_scsi; // Number of bytes that have been scheduled for transfer on SCSI side
-    uint32_t bytes_scsi_done; // Number of bytes that have been transferred on SCSI side
-
-    uint32_t bytes_per_sector;
-    bool all_ok;
-} g_initiator_transfer;
-
 static void initiatorReadSDCallback(uint32_t bytes_complete)
 {
     if (g_initiator_transfer.bytes_scsi_done < g_initiator_transfer.bytes_scsi)
@@ -1261,10 +1713,13 @@ static void initiatorReadSDCallback(uint32_t bytes_complete)
         if (start + len > bufsize)
             len = bufsize - start;
 
-        // Don't overwrite data that has not yet been written to SD card
+        // Don't overwrite data that has not yet been written to SD card or hashed
         uint32_t sd_ready_cnt = g_initiator_transfer.bytes_sd + bytes_complete;
-        if (g_initiator_transfer.bytes_scsi_done + len > sd_ready_cnt + bufsize)
-            len = sd_ready_cnt + bufsize - g_initiator_transfer.bytes_scsi_done;
+        uint32_t free_cnt = sd_ready_cnt;
+        if (g_initiator_state.use_sha256 && g_initiator_hash.done < free_cnt)
+            free_cnt = g_initiator_hash.done;
+        if (g_initiator_transfer.bytes_scsi_done + len > free_cnt + bufsize)
+            len = free_cnt + bufsize - g_initiator_transfer.bytes_scsi_done;
 
         if (sd_ready_cnt == g_initiator_transfer.bytes_sd_scheduled &&
             g_initiator_transfer.bytes_sd_scheduled + bytesPerSector <= g_initiator_transfer.bytes_scsi_done)
@@ -1284,9 +1739,11 @@ static void initiatorReadSDCallback(uint32_t bytes_complete)
             return;
 
         // dbgmsg("SCSI read ", (int)start, " + ", (int)len, ", sd ready cnt ", (int)sd_ready_cnt, " ", (int)bytes_complete, ", scsi done ", (int)g_initiator_transfer.bytes_scsi_done);
+        uint32_t read_start = micros();
         scsiHostSetBusWidth(g_initiator_state.targetBusWidth[g_initiator_state.target_id]);
         uint32_t rxcount = scsiHostRead(&scsiDev.data[start], len);
         scsiHostSetBusWidth(0);
+        g_initiator_transfer.us_scsi_read += micros() - read_start;
         if (rxcount != len)
         {
             logmsg("Read failed at byte ", (int)g_initiator_transfer.bytes_scsi_done);
@@ -1330,25 +1787,69 @@ static void scsiInitiatorWriteDataToSd(FsFile &file, bool use_callback)
     uint8_t *buf = &scsiDev.data[start];
     // dbgmsg("SD write ", (int)start, " + ", (int)len);
 
-    if (use_callback)
-    {
-        platform_set_sd_callback(&initiatorReadSDCallback, buf);
-    }
+    scsiInitiatorHashStart(buf, len, g_initiator_transfer.bytes_sd);
 
-    g_initiator_transfer.bytes_sd_scheduled = g_initiator_transfer.bytes_sd + len;
-    if (file.write(buf, len) != len)
+    bool sparse = g_initiator_state.sparse_active && (file.curPosition() % SD_SECTOR_SIZE) == 0;
+    uint32_t pos = 0;
+    while (pos < len)
     {
-        logmsg("scsiInitiatorReadDataToFile: SD card write failed");
-        g_initiator_transfer.all_ok = false;
+        uint32_t piece = len - pos;
+        bool erased = false;
+        if (sparse)
+        {
+            piece = scsiInitiatorSparseRun(buf + pos, piece, &erased);
+        }
+
+        g_initiator_transfer.bytes_sd_scheduled = g_initiator_transfer.bytes_sd + piece;
+        if (erased && file.seek(file.curPosition() + piece))
+        {
+            // Area is already erased, skip the write
+            g_initiator_state.sparse_skipped_bytes += piece;
+        }
+        else
+        {
+            if (erased)
+            {
+                logmsg("-- Seeking past written data failed, sparse output disabled");
+                g_initiator_state.sparse_active = sparse = false;
+            }
+
+            if (use_callback)
+            {
+                platform_set_sd_callback(&initiatorReadSDCallback, buf + pos);
+            }
+
+            if (file.write(buf + pos, piece) != piece)
+            {
+                logmsg("scsiInitiatorReadDataToFile: SD card write failed");
+                g_initiator_transfer.all_ok = false;
+            }
+            platform_set_sd_callback(NULL, NULL);
+        }
+
+        g_initiator_transfer.bytes_sd += piece;
+        pos += piece;
     }
-    platform_set_sd_callback(NULL, NULL);
-    g_initiator_transfer.bytes_sd += len;
 }
 
 bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize,
                                  FsFile &file)
 {
     int status = -1;
+    uint32_t time_start = micros();
+
+    if (g_initiator_state.use_sha256)
+    {
+        // Previous data must be hashed before buffer is reused
+        scsiInitiatorHashWait();
+        g_initiator_hash.ctx_saved = g_initiator_hash.ctx;
+        g_initiator_hash.done = 0;
+    }
+
+    g_initiator_transfer.us_command = 0;
+    g_initiator_transfer.us_data = 0;
+    g_initiator_transfer.us_scsi_read = 0;
+    g_initiator_transfer.us_status = 0;
 
     // Read6 command supports 21 bit LBA - max of 0x1FFFFF
     // ref: https://www.seagate.com/files/staticfiles/support/docs/manual/Interface%20manuals/100293068j.pdf pg 134
@@ -1397,6 +1898,8 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
 
     SCSI_PHASE phase;
 
+    uint32_t time_data = micros();
+    g_initiator_transfer.us_command = time_data - time_start;
     g_initiator_transfer.bytes_scsi = sectorcount * sectorsize;
     g_initiator_transfer.bytes_per_sector = sectorsize;
     g_initiator_transfer.bytes_sd = 0;
@@ -1427,6 +1930,9 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
         }
     }
 
+    uint32_t time_status = micros();
+    g_initiator_transfer.us_data = time_status - time_data;
+
     // Write any remaining buffered data
     while (g_initiator_transfer.bytes_sd < g_initiator_transfer.bytes_scsi_done)
     {
@@ -1470,6 +1976,7 @@ bool scsiInitiatorReadDataToFile(int target_id, uint32_t start_sector, uint32_t
     }
 
     scsiHostWaitBusFree();
+    g_initiator_transfer.us_status = micros() - time_status;
 
     if (!g_initiator_transfer.all_ok)
     {
@@ -23,7 +23,10 @@
 // SCSI trace logging
 
 #include "ZuluSCSI_log_trace.h"
+#include "ZuluSCSI_stats.h"
 #include "ZuluSCSI_log.h"
+#include "ZuluSCSI_config.h"
+#include <ZuluSCSI_platform.h>
 #include <scsi2sd.h>
 extern "C" {
 #include <scsi.h>
@@ -36,6 +39,18 @@ static int g_InByteCount = 0;
 static int g_OutByteCount = 0;
 static uint16_t g_DataChecksum = 0;
 
+static struct {
+    bool enabled;
+    bool active; // Command is being recorded
+    int phase;
+    uint32_t phase_start;
+    uint32_t dropped;
+    uint32_t rdpos;
+    uint32_t wrpos;
+    scsi_trace_record_t current;
+    scsi_trace_record_t ring[SCSI_TRACE_RECORDS];
+} g_scsi_trace;
+
 static const char *getCommandName(uint8_t cmd)
 {
     switch (cmd)
@@ -225,6 +240,151 @@ static void printNewPhase(int phase, bool initiator = false)
     }
 }
 
+void scsiTraceEnable(bool enable)
+{
+    g_scsi_trace.enabled = enable;
+    g_scsi_trace.active = false;
+}
+
+bool scsiTraceEnabled()
+{
+    return g_scsi_trace.enabled;
+}
+
+uint32_t scsiTraceGetPending(const scsi_trace_record_t **records)
+{
+    uint32_t rdpos = g_scsi_trace.rdpos;
+    uint32_t count = g_scsi_trace.wrpos - rdpos;
+    uint32_t idx = rdpos % SCSI_TRACE_RECORDS;
+
+    // Return only the contiguous part, rest will be returned on next call
+    if (count > SCSI_TRACE_RECORDS - idx)
+    {
+        count = SCSI_TRACE_RECORDS - idx;
+    }
+
+    *records = &g_scsi_trace.ring[idx];
+    return count;
+}
+
+void scsiTraceConsume(uint32_t count)
+{
+    g_scsi_trace.rdpos += count;
+}
+
+uint32_t scsiTraceGetDropped()
+{
+    uint32_t dropped = g_scsi_trace.dropped;
+    g_scsi_trace.dropped = 0;
+    return dropped;
+}
+
+uint32_t scsiTraceSDStart()
+{
+    return g_scsi_trace.active ? micros() : 0;
+}
+
+void scsiTraceSDEnd(uint32_t start)
+{
+    if (g_scsi_trace.active)
+    {
+        g_scsi_trace.current.sd_us += micros() - start;
+    }
+}
+
+static void scsiTraceDecodeCDB(scsi_trace_record_t *rec, const uint8_t *cdb)
+{
+    rec->opcode = cdb[0];
+    switch (cdb[0] >> 5)
+    {
+        case 0: // 6-byte commands
+            rec->lba = ((uint32_t)(cdb[1] & 0x1F) << 16) | ((uint32_t)cdb[2] << 8) | cdb[3];
+            rec->blocks = cdb[4];
+            break;
+
+        case 1: case 2: // 10-byte commands
+            rec->lba = ((uint32_t)cdb[2] << 24) | ((uint32_t)cdb[3] << 16) | ((uint32_t)cdb[4] << 8) | cdb[5];
+            rec->blocks = ((uint32_t)cdb[7] << 8) | cdb[8];
+            break;
+
+        case 4: // 16-byte commands
+            rec->lba = ((uint32_t)cdb[6] << 24) | ((uint32_t)cdb[7] << 16) | ((uint32_t)cdb[8] << 8) | cdb[9];
+            rec->blocks = ((uint32_t)cdb[10] << 24) | ((uint32_t)cdb[11] << 16) | ((uint32_t)cdb[12] << 8) | cdb[13];
+            break;
+
+        case 5: // 12-byte commands
+            rec->lba = ((uint32_t)cdb[2] << 24) | ((uint32_t)cdb[3] << 16) | ((uint32_t)cdb[4] << 8) | cdb[5];
+            rec->blocks = ((uint32_t)cdb[6] << 24) | ((uint32_t)cdb[7] << 16) | ((uint32_t)cdb[8] << 8) | cdb[9];
+            break;
+
+        default:
+            rec->lba = 0;
+            rec->blocks = 0;
+            break;
+    }
+}
+
+static void scsiTraceFinish(uint32_t now)
+{
+    scsi_trace_record_t *rec = &g_scsi_trace.current;
+    rec->total_us = now - rec->timestamp_us;
+    g_scsi_trace.active = false;
+
+    if (g_scsi_trace.wrpos - g_scsi_trace.rdpos >= SCSI_TRACE_RECORDS)
+    {
+        g_scsi_trace.dropped++;
+        return;
+    }
+
+    g_scsi_trace.ring[g_scsi_trace.wrpos % SCSI_TRACE_RECORDS] = *rec;
+    g_scsi_trace.wrpos++;
+}
+
+// Update the command record on SCSI phase change
+static void scsiTracePhaseChange(int old_phase, int new_phase)
+{
+    uint32_t now = micros();
+    scsi_trace_record_t *rec = &g_scsi_trace.current;
+
+    if (old_phase == DATA_IN || old_phase == DATA_OUT)
+    {
+        rec->data_us += now - g_scsi_trace.phase_start;
+    }
+
+    if (new_phase == COMMAND)
+    {
+        if (g_scsi_trace.active)
+        {
+            scsiTraceFinish(now);
+        }
+
+        memset(rec, 0, sizeof(*rec));
+        rec->timestamp_us = now;
+        rec->target_id = scsiDev.target ? scsiDev.target->targetId : 0xFF;
+        g_scsi_trace.active = true;
+    }
+    else if (g_scsi_trace.active)
+    {
+        if (old_phase == COMMAND)
+        {
+            rec->command_us = now - rec->timestamp_us;
+            scsiTraceDecodeCDB(rec, scsiDev.cdb);
+        }
+
+        if (new_phase == STATUS)
+        {
+            rec->status = scsiDev.status;
+        }
+        else if (new_phase == BUS_FREE)
+        {
+            scsiTraceFinish(now);
+        }
+    }
+
+    g_scsi_trace.phase = new_phase;
+    g_scsi_trace.phase_start = now;
+}
+
 void scsiLogPhaseChange(int new_phase)
 {
     static int old_scsi_id = 0;
@@ -234,6 +394,13 @@ void scsiLogPhaseChange(int new_phase)
 
     if (new_phase != old_phase)
     {
+        if (g_scsi_trace.enabled)
+        {
+            scsiTracePhaseChange(old_phase, new_phase);
+        }
+
+        scsiStatsPhaseChange(old_phase, new_phase);
+
         if (old_phase == DATA_IN || old_phase == DATA_OUT)
         {
             dbgmsg("---- Total IN: ", g_InByteCount, " OUT: ", g_OutByteCount, " CHECKSUM: ", (int)g_DataChecksum);
@@ -288,9 +455,13 @@ void scsiLogPhaseChange(int new_phase)
 
         printNewPhase(new_phase);
         old_phase = new_phase;
-        old_sync_period = scsiDev.target->syncPeriod;
-        old_buswidth = scsiDev.target->busWidth;
-        old_scsi_id = scsiDev.target->targetId;
+
+        if (scsiDev.target != NULL)
+        {
+            old_sync_period = scsiDev.target->syncPeriod;
+            old_buswidth = scsiDev.target->busWidth;
+            old_scsi_id = scsiDev.target->targetId;
+        }
     }
 }
 
@@ -330,6 +501,11 @@ void scsiLogDataIn(const uint8_t *buf, uint32_t length)
     }
 
     g_InByteCount += length;
+
+    if (g_scsi_trace.active && g_scsi_trace.phase == DATA_IN)
+    {
+        g_scsi_trace.current.bytes += length;
+    }
 }
 
 void scsiLogDataOut(const uint8_t *buf, uint32_t length)
@@ -355,6 +531,11 @@ void scsiLogDataOut(const uint8_t *buf, uint32_t length)
     }
 
     g_OutByteCount += length;
+
+    if (g_scsi_trace.active && g_scsi_trace.phase == DATA_OUT)
+    {
+        g_scsi_trace.current.bytes += length;
+    }
 }
 
 static const char *get_sense_key_name(uint8_t sense_key)
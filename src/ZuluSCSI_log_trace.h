@@ -32,3 +32,54 @@ void scsiLogInitiatorPhaseChange(int new_phase);
 void scsiLogDataIn(const uint8_t *buf, uint32_t length);
 void scsiLogDataOut(const uint8_t *buf, uint32_t length);
 void scsiLogInitiatorCommandFailure(const char *command_text, int target_id, int status, uint8_t sense_key);
+
+// Binary command trace.
+// When enabled, one record per SCSI command is stored in a RAM ring buffer
+// and written to TRACEFILE by the log saving code. Recording has low overhead
+// compared to debug log, so it can be used for measuring command latencies.
+// Use utils/decode_scsi_trace.py to decode the file.
+#define SCSI_TRACE_MAGIC 0x4352545A // "ZTRC"
+#define SCSI_TRACE_VERSION 1
+
+// File starts with this header, followed by records (little-endian)
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+} scsi_trace_header_t;
+
+typedef struct {
+    uint32_t timestamp_us; // Time at start of COMMAND phase
+    uint8_t target_id;
+    uint8_t opcode;
+    uint8_t status;
+    uint8_t reserved;
+    uint32_t lba; // Decoded from CDB, lowest 32 bits
+    uint32_t blocks; // Transfer length from CDB
+    uint32_t bytes; // Bytes transferred in data phases
+    uint32_t command_us; // From COMMAND phase start to first data or status phase
+    uint32_t data_us; // Total time in data phases
+    uint32_t sd_us; // Total time in SD card accesses
+    uint32_t total_us; // From COMMAND phase start to bus free
+} scsi_trace_record_t;
+
+void scsiTraceEnable(bool enable);
+bool scsiTraceEnabled();
+
+// Get pending records from ring buffer, returns number of records.
+// Call scsiTraceConsume() after they have been saved.
+uint32_t scsiTraceGetPending(const scsi_trace_record_t **records);
+void scsiTraceConsume(uint32_t count);
+
+// Get and reset number of records lost due to ring buffer overflow
+uint32_t scsiTraceGetDropped();
+
+// Accumulate SD card access time for the current command
+uint32_t scsiTraceSDStart();
+void scsiTraceSDEnd(uint32_t start);
+
+struct scsiTraceSDTimer {
+    uint32_t start;
+    scsiTraceSDTimer(): start(scsiTraceSDStart()) {}
+    ~scsiTraceSDTimer() { scsiTraceSDEnd(start); }
+};
@@ -0,0 +1,235 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+#include "ZuluSCSI_lz.h"
+#include <string.h>
+
+// Format limits from LZ4 block specification
+#define LZ_MINMATCH 4
+#define LZ_LASTLITERALS 5
+#define LZ_MFLIMIT 12
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+// Write a length extension after the token
+static inline uint8_t *write_length(uint8_t *op, uint8_t *oend, size_t len)
+{
+    while (len >= 255)
+    {
+        if (op >= oend) return NULL;
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= oend) return NULL;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t *write_sequence(uint8_t *op, uint8_t *oend,
+                               const uint8_t *literals, size_t litlen,
+                               uint32_t offset, size_t matchlen)
+{
+    if (op >= oend) return NULL;
+    uint8_t *token = op++;
+    *token = (litlen >= 15 ? 15 : litlen) << 4;
+    if (litlen >= 15 && !(op = write_length(op, oend, litlen - 15))) return NULL;
+
+    if ((size_t)(oend - op) < litlen) return NULL;
+    memcpy(op, literals, litlen);
+    op += litlen;
+
+    if (matchlen > 0)
+    {
+        if (oend - op < 2) return NULL;
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+
+        size_t ml = matchlen - LZ_MINMATCH;
+        *token |= (ml >= 15 ? 15 : ml);
+        if (ml >= 15 && !(op = write_length(op, oend, ml - 15))) return NULL;
+    }
+
+    return op;
+}
+
+size_t lz_compress_block(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstcap, void *workmem)
+{
+    uint16_t *table = (uint16_t*)workmem;
+    memset(table, 0, LZ_COMPRESS_WORKMEM_SIZE);
+
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *iend = src + srclen;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstcap;
+
+    if (srclen > LZ_MAX_OFFSET + 1) return 0;
+
+    if (srclen >= LZ_MFLIMIT)
+    {
+        const uint8_t *mflimit = iend - LZ_MFLIMIT;
+        const uint8_t *matchlimit = iend - LZ_LASTLITERALS;
+
+        // Position 0 is used as "empty" marker, so start at 1
+        ip++;
+        while (ip < mflimit)
+        {
+            uint32_t seq = read32(ip);
+            uint32_t h = lz_hash(seq);
+            const uint8_t *ref = src + table[h];
+            table[h] = (uint16_t)(ip - src);
+
+            if (ref == src || read32(ref) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            // Extend match backwards and forwards
+            while (ip > anchor && ref > src && ip[-1] == ref[-1])
+            {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t *mp = ip + LZ_MINMATCH;
+            const uint8_t *rp = ref + LZ_MINMATCH;
+            while (mp < matchlimit && *mp == *rp)
+            {
+                mp++;
+                rp++;
+            }
+
+            op = write_sequence(op, oend, anchor, ip - anchor, ip - ref, mp - ip);
+            if (!op) return 0;
+
+            ip = mp;
+            anchor = ip;
+        }
+    }
+
+    // Last literals
+    op = write_sequence(op, oend, anchor, iend - anchor, 0, 0);
+    if (!op) return 0;
+
+    return op - dst;
+}
+
+// With partial set, decoding stops without error when dst is full
+static size_t lz_decompress(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstcap, bool partial)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + srclen;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstcap;
+
+    while (ip < iend)
+    {
+        if (partial && op == oend) break;
+
+        uint8_t token = *ip++;
+
+        size_t litlen = token >> 4;
+        if (litlen == 15)
+        {
+            uint8_t b;
+            do {
+                if (ip >= iend) return 0;
+                b = *ip++;
+                litlen += b;
+            } while (b == 255);
+        }
+
+        if ((size_t)(iend - ip) < litlen) return 0;
+        if ((size_t)(oend - op) < litlen)
+        {
+            if (!partial) return 0;
+            memcpy(op, ip, oend - op);
+            return dstcap;
+        }
+        memcpy(op, ip, litlen);
+        ip += litlen;
+        op += litlen;
+
+        // Last sequence has no match part.
+        // Partial decompression ignores any data after the requested length.
+        if (ip >= iend || (partial && op == oend)) break;
+
+        if (iend - ip < 2) return 0;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return 0;
+
+        size_t matchlen = token & 15;
+        if (matchlen == 15)
+        {
+            uint8_t b;
+            do {
+                if (ip >= iend) return 0;
+                b = *ip++;
+                matchlen += b;
+            } while (b == 255);
+        }
+        matchlen += LZ_MINMATCH;
+
+        if ((size_t)(oend - op) < matchlen)
+        {
+            if (!partial) return 0;
+            matchlen = oend - op;
+        }
+
+        // Match may overlap the output, copy forwards
+        const uint8_t *match = op - offset;
+        if (offset >= matchlen)
+        {
+            memcpy(op, match, matchlen);
+            op += matchlen;
+        }
+        else
+        {
+            while (matchlen--) *op++ = *match++;
+        }
+    }
+
+    return op - dst;
+}
+
+size_t lz_decompress_block(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstcap)
+{
+    return lz_decompress(src, srclen, dst, dstcap, false);
+}
+
+size_t lz_decompress_partial(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen)
+{
+    return lz_decompress(src, srclen, dst, dstlen, true);
+}
@@ -0,0 +1,47 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+// Small LZ77 block codec using the LZ4 block format.
+// Blocks are compressed independently, maximum block size is 64 kB.
+// Decompression is a simple byte copy loop that runs many times faster
+// than the SCSI bus, compression is only used when writing images.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Size of the work area needed by lz_compress_block()
+#define LZ_COMPRESS_WORKMEM_SIZE (4096 * sizeof(uint16_t))
+
+// Compress srclen bytes from src to dst.
+// workmem must be LZ_COMPRESS_WORKMEM_SIZE bytes, 2-byte aligned.
+// Returns compressed size, or 0 if the result would not fit in dstcap bytes.
+size_t lz_compress_block(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstcap, void *workmem);
+
+// Decompress a block to dst.
+// Returns number of bytes written to dst, or 0 if the input is corrupt
+// or would overflow dstcap bytes.
+size_t lz_decompress_block(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstcap);
+
+// Decompress only the first dstlen bytes of a block.
+// Returns dstlen, or less if the block is shorter or corrupt.
+size_t lz_decompress_partial(const uint8_t *src, size_t srclen, uint8_t *dst, size_t dstlen);
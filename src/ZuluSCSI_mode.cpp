@@ -97,6 +97,20 @@ static const uint8_t CDROMCapabilitiesPage[] =
 0x05, 0x62, // current read speed, matching max speed
 };
 
+// 0x0F Data Compression Page for tape drives.
+// Compression is only available for .TAP images, where compressed records
+// can be marked in the record metadata.
+static const uint8_t TapeDataCompressionPage[] =
+{
+0x0F, // page code
+0x0E, // page length
+0x00, // DCE and DCC bits, filled in at runtime
+0x80, // DDE: decompression enabled, RED: no reporting of boundaries
+0x00, 0x00, 0x00, 0x01, // compression algorithm: default
+0x00, 0x00, 0x00, 0x01, // decompression algorithm: default
+0x00, 0x00, 0x00, 0x00  // reserved
+};
+
 static void pageIn(int pc, int dataIdx, const uint8_t* pageData, int pageLen)
 {
     memcpy(&scsiDev.data[dataIdx], pageData, pageLen);
@@ -198,6 +212,61 @@ int modeSenseCDCapabilitiesPage(int pc, int idx, int pageCode, int* pageFound)
     }
 }
 
+extern "C"
+int modeSenseTapeCompressionPage(int pc, int idx, int pageCode, int* pageFound)
+{
+    if ((scsiDev.target->cfg->deviceType == S2S_CFG_SEQUENTIAL)
+        && (pageCode == 0x0F || pageCode == 0x3F))
+    {
+        *pageFound = 1;
+        pageIn(
+            pc,
+            idx,
+            TapeDataCompressionPage,
+            sizeof(TapeDataCompressionPage));
+
+        if (tapeIsTap())
+        {
+            if (pc == 0x00)
+            {
+                scsiDev.data[idx+2] = (scsiDev.target->liveCfg.tapeCompression ? 0x80 : 0x00) | 0x40;
+            }
+            else if (pc == 0x01)
+            {
+                // DCE can be changed
+                scsiDev.data[idx+2] = 0x80;
+            }
+            else
+            {
+                scsiDev.data[idx+2] = (scsiDev.target->cfg->tapeCompression ? 0x80 : 0x00) | 0x40;
+            }
+        }
+        return sizeof(TapeDataCompressionPage);
+    }
+    else
+    {
+        return 0;
+    }
+}
+
+extern "C"
+int modeSelectTapeCompressionPage(int pageLen, int idx)
+{
+    if (scsiDev.target->cfg->deviceType == S2S_CFG_SEQUENTIAL)
+    {
+        if (pageLen != 0x0E) return 0;
+        bool dce = (scsiDev.data[idx+2] & 0x80) != 0;
+        if (dce && !tapeIsTap()) return 0;
+        dbgmsg("------ Tape data compression ", dce ? "enabled" : "disabled");
+        scsiDev.target->liveCfg.tapeCompression = dce;
+        return 1;
+    }
+    else
+    {
+        return 0;
+    }
+}
+
 extern "C"
 int modeSelectCDAudioControlPage(int pageLen, int idx)
 {
@@ -24,8 +24,10 @@
 int modeSenseCDDevicePage(int pc, int idx, int pageCode, int* pageFound);
 int modeSenseCDAudioControlPage(int pc, int idx, int pageCode, int* pageFound);
 int modeSenseCDCapabilitiesPage(int pc, int idx, int pageCode, int* pageFound);
+int modeSenseTapeCompressionPage(int pc, int idx, int pageCode, int* pageFound);
 
 int modeSelectCDAudioControlPage(int pageLen, int idx);
+int modeSelectTapeCompressionPage(int pageLen, int idx);
 
 int modeMaxSectorSize();
 int modeMinSectorSize();
@@ -38,6 +38,14 @@ extern ZuluSCSISettings g_scsi_settings;
 // public globals
 volatile MSC_LEDState MSC_LEDMode;
 
+// delay while letting platform perform background tasks such as read-ahead
+static void msc_delay(uint32_t ms) {
+  uint32_t start = millis();
+  do {
+    platform_poll_msc();
+  } while ((uint32_t)(millis() - start) < ms);
+}
+
 // card reader operation loop
 // assumption that SD card was enumerated and is working
 void zuluscsi_msc_loop() {
@@ -80,12 +88,12 @@ void zuluscsi_msc_loop() {
     switch (MSC_LEDMode) {
       case LED_BLINK_FAST:
         LED_OFF();
-        delay(30);
+        msc_delay(30);
         break;
       case LED_BLINK_SLOW:
-        delay(30);
+        msc_delay(30);
         LED_OFF();
-        delay(100);
+        msc_delay(100);
         syncCounter = 1;
         break;
       default:
@@ -99,7 +107,7 @@ void zuluscsi_msc_loop() {
     // LED always on in card reader mode
     MSC_LEDMode = LED_SOLIDON;
 	  LED_ON(); 
-    delay(30);
+    msc_delay(30);
 
     if (g_controlBoardEnabled)
     {
@@ -64,16 +64,34 @@ static struct {
 } g_msc_initiator_targets[S2S_MAX_TARGETS];
 static int g_msc_initiator_target_count;
 
-// Prefetch next sector in main loop while USB is transferring previous one.
+// Prefetch following sectors in main loop while USB is transferring previous ones.
+// The prefetch buffer is used as a ring of sectors, which is filled in chunks of
+// the size the host has been requesting. The number of chunks kept ahead grows
+// while the host keeps reading sequentially.
+// When host writes, the same buffer holds data that is written to the drive
+// from the main loop while USB receives the next block (write-behind).
 static struct {
     uint8_t *prefetch_buffer; // Buffer to use for storing the data
     uint32_t prefetch_bufsize;
-    uint32_t prefetch_lba; // First sector to fetch
+    int prefetch_lun; // LUN that the ring data belongs to, -1 if none
     int prefetch_target_id; // Target to read from
-    size_t prefetch_sectorcount; // Number of sectors to fetch
-    size_t prefetch_sectorsize;
+    uint32_t prefetch_sectorsize;
+    uint32_t prefetch_capacity; // Number of sectors that fit in the ring
     bool prefetch_use_read10;
-    bool prefetch_done; // True after prefetch is complete
+    uint32_t prefetch_lba; // First sector stored in the ring
+    uint32_t prefetch_start; // Index of prefetch_lba in the ring
+    uint32_t prefetch_count; // Number of sectors ready in the ring
+    uint32_t prefetch_chunk; // Number of sectors to read per prefetch command
+    uint32_t prefetch_depth; // Number of sectors to keep ready ahead of host
+    uint32_t prefetch_end; // Sector count of the drive
+    uint32_t prefetch_seq_lba; // Sector following the latest host read
+    uint32_t prefetch_seq_count; // Number of consecutive sequential reads
+
+    bool write_behind; // Allow write-behind of host writes
+    int write_lun; // LUN with pending write data, -1 if none
+    uint32_t write_lba;
+    uint32_t write_sectorcount;
+    bool write_failed; // Write-behind failed, reported on next host write
 
     bool readonly; // Disable writing to any drives
 
@@ -82,12 +100,15 @@ static struct {
     uint32_t status_interval;
     uint32_t status_reqcount;
     uint32_t status_bytecount;
+    uint32_t status_prefetch_bytecount; // Bytes served from prefetch
 
     // Scan new targets if none found
     uint32_t last_scan_time;
 } g_msc_initiator_state;
 
 static int do_read6_or_10(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize, void *buffer, bool use_read10);
+static int do_write6_or_10(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize, const uint8_t *buffer, bool use_read10);
+static bool check_write_status(int target_id, uint32_t start_sector, int status);
 
 static void scan_targets()
 {
@@ -159,8 +180,14 @@ bool setup_msc_initiator()
         // We can use the device mode buffer for prefetching data in initiator mode
         g_msc_initiator_state.prefetch_buffer = scsiDev.data;
         g_msc_initiator_state.prefetch_bufsize = sizeof(scsiDev.data);
+        // Write-behind returns status to host before the drive has accepted the data,
+        // so a failed write can only be reported on a later command.
+        g_msc_initiator_state.write_behind = ini_getbool("SCSI", "InitiatorMSCWriteBehind", false, CONFIGFILE);
     }
 
+    g_msc_initiator_state.prefetch_lun = -1;
+    g_msc_initiator_state.write_lun = -1;
+
     g_msc_initiator_state.status_interval = ini_getl("SCSI", "InitiatorMSCStatusInterval", 5000, CONFIGFILE);
     g_msc_initiator_state.readonly = ini_getbool("SCSI", "InitiatorMSCReadOnly", false, CONFIGFILE);
 
@@ -178,6 +205,183 @@ bool setup_msc_initiator()
     return g_msc_initiator_target_count > 0;
 }
 
+static void prefetch_invalidate()
+{
+    g_msc_initiator_state.prefetch_lun = -1;
+    g_msc_initiator_state.prefetch_count = 0;
+    g_msc_initiator_state.prefetch_depth = 0;
+}
+
+// Read next chunk into the prefetch ring, if it is below the requested depth
+static void prefetch_next_chunk()
+{
+    if (g_msc_initiator_state.prefetch_lun < 0 ||
+        g_msc_initiator_state.prefetch_count >= g_msc_initiator_state.prefetch_depth)
+    {
+        return;
+    }
+
+    uint32_t capacity = g_msc_initiator_state.prefetch_capacity;
+    uint32_t lba = g_msc_initiator_state.prefetch_lba + g_msc_initiator_state.prefetch_count;
+    uint32_t pos = (g_msc_initiator_state.prefetch_start + g_msc_initiator_state.prefetch_count) % capacity;
+
+    // Single SCSI command cannot wrap around the end of the buffer
+    uint32_t sectorcount = g_msc_initiator_state.prefetch_chunk;
+    if (sectorcount > g_msc_initiator_state.prefetch_depth - g_msc_initiator_state.prefetch_count)
+        sectorcount = g_msc_initiator_state.prefetch_depth - g_msc_initiator_state.prefetch_count;
+    if (sectorcount > capacity - pos)
+        sectorcount = capacity - pos;
+    if (lba >= g_msc_initiator_state.prefetch_end)
+        sectorcount = 0;
+    else if (sectorcount > g_msc_initiator_state.prefetch_end - lba)
+        sectorcount = g_msc_initiator_state.prefetch_end - lba;
+
+    if (sectorcount == 0)
+    {
+        return;
+    }
+
+    LED_ON();
+
+    uint32_t sectorsize = g_msc_initiator_state.prefetch_sectorsize;
+    dbgmsg("Prefetch ", (int)lba, " + ", (int)sectorcount, "x", (int)sectorsize);
+    int status = do_read6_or_10(g_msc_initiator_state.prefetch_target_id,
+                                lba, sectorcount, sectorsize,
+                                g_msc_initiator_state.prefetch_buffer + pos * sectorsize,
+                                g_msc_initiator_state.prefetch_use_read10);
+    if (status == 0)
+    {
+        g_msc_initiator_state.prefetch_count += sectorcount;
+    }
+    else
+    {
+        logmsg("Prefetch of sector ", lba, " failed: status ", status);
+        prefetch_invalidate();
+    }
+
+    LED_OFF();
+}
+
+// Copy sectors from prefetch ring to host buffer.
+// Returns number of sectors copied from start of the request.
+static uint32_t prefetch_take(int lun, uint32_t lba, uint32_t sectorcount, uint8_t *dest)
+{
+    if (g_msc_initiator_state.prefetch_lun != lun || g_msc_initiator_state.prefetch_count == 0 ||
+        lba < g_msc_initiator_state.prefetch_lba ||
+        lba >= g_msc_initiator_state.prefetch_lba + g_msc_initiator_state.prefetch_count)
+    {
+        return 0;
+    }
+
+    // Drop any sectors that host skipped over
+    uint32_t capacity = g_msc_initiator_state.prefetch_capacity;
+    uint32_t skip = lba - g_msc_initiator_state.prefetch_lba;
+    g_msc_initiator_state.prefetch_start = (g_msc_initiator_state.prefetch_start + skip) % capacity;
+    g_msc_initiator_state.prefetch_count -= skip;
+    g_msc_initiator_state.prefetch_lba = lba;
+
+    uint32_t sectorsize = g_msc_initiator_state.prefetch_sectorsize;
+    uint32_t total = 0;
+    while (total < sectorcount && g_msc_initiator_state.prefetch_count > 0)
+    {
+        // Copy contiguous run at once, ring wraps at most once
+        uint32_t start = g_msc_initiator_state.prefetch_start;
+        uint32_t count = sectorcount - total;
+        if (count > g_msc_initiator_state.prefetch_count) count = g_msc_initiator_state.prefetch_count;
+        if (count > capacity - start) count = capacity - start;
+
+        memcpy(dest + total * sectorsize,
+               g_msc_initiator_state.prefetch_buffer + start * sectorsize,
+               count * sectorsize);
+
+        total += count;
+        g_msc_initiator_state.prefetch_start = (start + count) % capacity;
+        g_msc_initiator_state.prefetch_count -= count;
+        g_msc_initiator_state.prefetch_lba += count;
+    }
+
+    return total;
+}
+
+// Update prefetch ring after a host read, based on observed request pattern
+static void prefetch_schedule(int lun, int target_id, uint32_t lba, uint32_t sectorcount, uint32_t sectorsize, bool use_read10)
+{
+    if (g_msc_initiator_state.prefetch_buffer == NULL)
+    {
+        return;
+    }
+
+    uint32_t capacity = g_msc_initiator_state.prefetch_bufsize / sectorsize;
+    uint32_t next_lba = lba + sectorcount;
+    if (sectorcount == 0 || sectorcount > capacity)
+    {
+        prefetch_invalidate();
+        return;
+    }
+
+    if (lba == g_msc_initiator_state.prefetch_seq_lba)
+    {
+        g_msc_initiator_state.prefetch_seq_count++;
+    }
+    else
+    {
+        g_msc_initiator_state.prefetch_seq_count = 0;
+    }
+    g_msc_initiator_state.prefetch_seq_lba = next_lba;
+
+    if (g_msc_initiator_state.prefetch_lun != lun ||
+        g_msc_initiator_state.prefetch_sectorsize != sectorsize ||
+        g_msc_initiator_state.prefetch_lba != next_lba)
+    {
+        // Start a new ring after the current request
+        g_msc_initiator_state.prefetch_lun = lun;
+        g_msc_initiator_state.prefetch_target_id = target_id;
+        g_msc_initiator_state.prefetch_sectorsize = sectorsize;
+        g_msc_initiator_state.prefetch_capacity = capacity;
+        g_msc_initiator_state.prefetch_use_read10 = use_read10;
+        g_msc_initiator_state.prefetch_end = g_msc_initiator_targets[lun].sectorcount;
+        g_msc_initiator_state.prefetch_lba = next_lba;
+        g_msc_initiator_state.prefetch_start = 0;
+        g_msc_initiator_state.prefetch_count = 0;
+    }
+
+    // Prefetch one request ahead, and more the longer the host keeps reading sequentially
+    uint32_t depth = sectorcount * (1 + g_msc_initiator_state.prefetch_seq_count);
+    if (depth > capacity) depth = capacity;
+    g_msc_initiator_state.prefetch_chunk = sectorcount;
+    g_msc_initiator_state.prefetch_depth = depth;
+}
+
+// Write data that was accepted from host earlier
+static bool flush_write_behind()
+{
+    int lun = g_msc_initiator_state.write_lun;
+    if (lun < 0)
+    {
+        return true;
+    }
+
+    g_msc_initiator_state.write_lun = -1;
+
+    LED_ON();
+    int target_id = g_msc_initiator_targets[lun].target_id;
+    uint32_t lba = g_msc_initiator_state.write_lba;
+    int status = do_write6_or_10(target_id, lba,
+                                 g_msc_initiator_state.write_sectorcount,
+                                 g_msc_initiator_targets[lun].sectorsize,
+                                 g_msc_initiator_state.prefetch_buffer,
+                                 g_msc_initiator_targets[lun].use_read10);
+    LED_OFF();
+
+    if (!check_write_status(target_id, lba, status))
+    {
+        g_msc_initiator_state.write_failed = true;
+        return false;
+    }
+
+    return true;
+}
+
 void poll_msc_initiator()
 {
     uint32_t time_now = millis();
@@ -197,44 +401,31 @@ void poll_msc_initiator()
     {
         if (g_msc_initiator_state.status_reqcount > 0)
         {
+            uint32_t bytecount = g_msc_initiator_state.status_bytecount;
+            uint32_t prefetch_pct = (bytecount > 0) ? (uint32_t)((uint64_t)g_msc_initiator_state.status_prefetch_bytecount * 100 / bytecount) : 0;
             logmsg("USB MSC: ", (int)g_msc_initiator_state.status_reqcount, " commands, ",
-                   (int)(g_msc_initiator_state.status_bytecount / delta), " kB/s");
+                   (int)(bytecount / delta), " kB/s, ",
+                   (int)prefetch_pct, "% from prefetch");
         }
 
         g_msc_initiator_state.status_reqcount = 0;
         g_msc_initiator_state.status_bytecount = 0;
+        g_msc_initiator_state.status_prefetch_bytecount = 0;
         g_msc_initiator_state.status_prev_time = time_now;
     }
 
 
     platform_poll();
     platform_msc_lock_set(true); // Cannot handle new MSC commands while running prefetch
-    if (g_msc_initiator_state.prefetch_sectorcount > 0
-        && !g_msc_initiator_state.prefetch_done)
-    {
-        LED_ON();
-
-        dbgmsg("Prefetch ", (int)g_msc_initiator_state.prefetch_lba, " + ",
-                (int)g_msc_initiator_state.prefetch_sectorcount, "x",
-                (int)g_msc_initiator_state.prefetch_sectorsize);
-        // Read next block while USB is transferring
-        int status = do_read6_or_10(g_msc_initiator_state.prefetch_target_id,
-                                    g_msc_initiator_state.prefetch_lba,
-                                    g_msc_initiator_state.prefetch_sectorcount,
-                                    g_msc_initiator_state.prefetch_sectorsize,
-                                    g_msc_initiator_state.prefetch_buffer,
-                                    g_msc_initiator_state.prefetch_use_read10);
-        if (status == 0)
-        {
-            g_msc_initiator_state.prefetch_done = true;
-        }
-        else
-        {
-            logmsg("Prefetch of sector ", g_msc_initiator_state.prefetch_lba, " failed: status ", status);
-            g_msc_initiator_state.prefetch_sectorcount = 0;
-        }
-
-        LED_OFF();
+    if (g_msc_initiator_state.write_lun >= 0)
+    {
+        // Write data received from host while USB receives the next block
+        flush_write_behind();
+    }
+    else
+    {
+        // Read one chunk per poll so that USB requests get handled in between
+        prefetch_next_chunk();
     }
     platform_msc_lock_set(false);
 }
@@ -320,6 +511,9 @@ bool init_msc_start_stop_cb(uint8_t lun, uint8_t power_condition, bool start, bo
         return false;
     }
 
+    flush_write_behind();
+    prefetch_invalidate();
+
     LED_ON();
     g_msc_initiator_state.status_reqcount++;
 
@@ -397,6 +591,11 @@ int32_t init_msc_scsi_cb(uint8_t lun, const uint8_t scsi_cmd[16], void *buffer,
     }
 
     dbgmsg("-- MSC Raw SCSI command ", bytearray(scsi_cmd, 16));
+
+    // Raw command could access the medium
+    flush_write_behind();
+    prefetch_invalidate();
+
     LED_ON();
     g_msc_initiator_state.status_reqcount++;
 
@@ -481,26 +680,22 @@ int32_t init_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buf
         return 0;
     }
 
-    if (g_msc_initiator_state.prefetch_done)
+    if (!flush_write_behind())
     {
-        int32_t offset = (int32_t)lba - (int32_t)g_msc_initiator_state.prefetch_lba;
-        uint8_t *dest = (uint8_t*)buffer;
-        while (offset >= 0 && offset < g_msc_initiator_state.prefetch_sectorcount && sectorcount > 0)
-        {
-            // Copy sectors from prefetch
-            memcpy(dest, g_msc_initiator_state.prefetch_buffer + sectorsize * offset, sectorsize);
-            dest += sectorsize;
-            offset += 1;
-            lba += 1;
-            sectorcount -= 1;
-        }
+        LED_OFF();
+        return -1;
     }
 
+    uint32_t prefetched = prefetch_take(lun, lba, sectorcount, (uint8_t*)buffer);
+    lba += prefetched;
+    sectorcount -= prefetched;
+    g_msc_initiator_state.status_prefetch_bytecount += prefetched * sectorsize;
+
     if (sectorcount > 0)
     {
         dbgmsg("USB Read command ", (int)orig_lba, " + ", (int)total_sectorcount, "x", (int)sectorsize,
-               " got ", (int)(total_sectorcount - sectorcount), " sectors from prefetch");
-        status = do_read6_or_10(target_id, lba, sectorcount, sectorsize, buffer, use_read10);
+               " got ", (int)prefetched, " sectors from prefetch");
+        status = do_read6_or_10(target_id, lba, sectorcount, sectorsize, (uint8_t*)buffer + prefetched * sectorsize, use_read10);
         lba += sectorcount;
     }
     else
@@ -532,54 +727,15 @@ int32_t init_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset, void* buf
         }
     }
 
-    if (lba + total_sectorcount <= g_msc_initiator_targets[lun].sectorcount)
-    {
-        int prefetch_sectorcount = total_sectorcount;
-        if (prefetch_sectorcount * sectorsize > g_msc_initiator_state.prefetch_bufsize)
-        {
-            prefetch_sectorcount = g_msc_initiator_state.prefetch_bufsize / sectorsize;
-        }
-
-        // Request prefetch of the next block while USB transfers the previous one
-        g_msc_initiator_state.prefetch_lba = lba;
-        g_msc_initiator_state.prefetch_target_id = target_id;
-        g_msc_initiator_state.prefetch_sectorcount = total_sectorcount;
-        g_msc_initiator_state.prefetch_sectorsize = sectorsize;
-        g_msc_initiator_state.prefetch_use_read10 = use_read10;
-        g_msc_initiator_state.prefetch_done = false;
-    }
+    // Request prefetch of the following sectors while USB transfers this block
+    prefetch_schedule(lun, target_id, orig_lba, total_sectorcount, sectorsize, use_read10);
 
     return total_sectorcount * sectorsize;
 }
 
-int32_t init_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize)
+static int do_write6_or_10(int target_id, uint32_t start_sector, uint32_t sectorcount, uint32_t sectorsize, const uint8_t *buffer, bool use_read10)
 {
-    if (g_msc_initiator_target_count == 0)
-    {
-        return -1;
-    }
-
-    if (g_msc_initiator_state.readonly)
-    {
-        logmsg("--- Refusing host write request, InitiatorMSCReadOnly is set.");
-        return -1;
-    }
-
-    int status = -1;
-
-    int target_id = get_target(lun);
-    int sectorsize = g_msc_initiator_targets[lun].sectorsize;
-    bool use_read10 = g_msc_initiator_targets[lun].use_read10;
-    uint32_t start_sector = lba;
-    uint32_t sectorcount = bufsize / sectorsize;
-
-    if (sectorcount == 0)
-    {
-        // Not a complete sector
-        return 0;
-    }
-
-    LED_ON();
+    int status;
 
     // Write6 command supports 21 bit LBA - max of 0x1FFFFF
     bool fits_write6 = (start_sector < 0x1FFFFF && sectorcount <= 256);
@@ -594,7 +750,7 @@ int32_t init_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t
             0x00
         };
 
-        status = scsiInitiatorRunCommand(target_id, command, sizeof(command), NULL, 0, buffer, bufsize);
+        status = scsiInitiatorRunCommand(target_id, command, sizeof(command), NULL, 0, buffer, sectorcount * sectorsize);
     }
     else
     {
@@ -607,15 +763,14 @@ int32_t init_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t
             0x00
         };
 
-        status = scsiInitiatorRunCommand(target_id, command, sizeof(command), NULL, 0, buffer, bufsize);
+        status = scsiInitiatorRunCommand(target_id, command, sizeof(command), NULL, 0, buffer, sectorcount * sectorsize);
     }
 
-    g_msc_initiator_state.prefetch_sectorcount = 0; // Invalidate prefetch cache
-
-    g_msc_initiator_state.status_reqcount++;
-    g_msc_initiator_state.status_bytecount += sectorcount * sectorsize;
-    LED_OFF();
+    return status;
+}
 
+static bool check_write_status(int target_id, uint32_t start_sector, int status)
+{
     if (status != 0)
     {
         uint8_t sense_key;
@@ -632,10 +787,88 @@ int32_t init_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t
         else
         {
             scsiLogInitiatorCommandFailure("SCSI Initiator write", target_id, status, sense_key);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int32_t init_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset, uint8_t *buffer, uint32_t bufsize)
+{
+    if (g_msc_initiator_target_count == 0)
+    {
+        return -1;
+    }
+
+    if (g_msc_initiator_state.readonly)
+    {
+        logmsg("--- Refusing host write request, InitiatorMSCReadOnly is set.");
+        return -1;
+    }
+
+    int target_id = get_target(lun);
+    int sectorsize = g_msc_initiator_targets[lun].sectorsize;
+    bool use_read10 = g_msc_initiator_targets[lun].use_read10;
+    uint32_t start_sector = lba;
+    uint32_t sectorcount = bufsize / sectorsize;
+
+    if (sectorcount == 0)
+    {
+        // Not a complete sector
+        return 0;
+    }
+
+    prefetch_invalidate(); // Prefetch buffer is reused for write data
+    g_msc_initiator_state.status_reqcount++;
+    g_msc_initiator_state.status_bytecount += sectorcount * sectorsize;
+
+    if (g_msc_initiator_state.write_failed)
+    {
+        // Report failure of earlier write-behind to host
+        g_msc_initiator_state.write_failed = false;
+        return -1;
+    }
+
+    if (g_msc_initiator_state.write_lun >= 0 &&
+        (g_msc_initiator_state.write_lun != lun ||
+         g_msc_initiator_state.write_lba + g_msc_initiator_state.write_sectorcount != start_sector ||
+         (g_msc_initiator_state.write_sectorcount + sectorcount) * sectorsize > g_msc_initiator_state.prefetch_bufsize ||
+         g_msc_initiator_state.write_sectorcount + sectorcount > 0xFFFF))
+    {
+        // Cannot append to pending write
+        if (!flush_write_behind())
+        {
+            g_msc_initiator_state.write_failed = false;
             return -1;
         }
     }
 
+    if (g_msc_initiator_state.write_behind && sectorcount * sectorsize <= g_msc_initiator_state.prefetch_bufsize)
+    {
+        // Accept data now and write it to the drive from the main loop
+        if (g_msc_initiator_state.write_lun < 0)
+        {
+            g_msc_initiator_state.write_lun = lun;
+            g_msc_initiator_state.write_lba = start_sector;
+            g_msc_initiator_state.write_sectorcount = 0;
+        }
+
+        memcpy(g_msc_initiator_state.prefetch_buffer + g_msc_initiator_state.write_sectorcount * sectorsize,
+               buffer, sectorcount * sectorsize);
+        g_msc_initiator_state.write_sectorcount += sectorcount;
+        return sectorcount * sectorsize;
+    }
+
+    LED_ON();
+    int status = do_write6_or_10(target_id, start_sector, sectorcount, sectorsize, buffer, use_read10);
+    LED_OFF();
+
+    if (!check_write_status(target_id, start_sector, status))
+    {
+        return -1;
+    }
+
     return sectorcount * sectorsize;
 }
 
@@ -540,6 +540,7 @@ static void readIniSCSIDeviceSetting(scsi_device_settings_t &cfg, const char *se
     cfg.tapeLengthMB = log_ini_getl(section, "TapeLengthMB", cfg.tapeLengthMB, CONFIGFILE, log_settings);
     cfg.tapeDensity = log_ini_getl(section, "TapeDensity", cfg.tapeDensity, CONFIGFILE, log_settings, &log_getl_8bit_hex);
     cfg.tapeBufferedMode = log_ini_getl(section, "TapeBufferedMode", cfg.tapeBufferedMode, CONFIGFILE, log_settings, &log_getl_8bit_hex);
+    cfg.tapeCompression = log_ini_getbool(section, "TapeCompression", cfg.tapeCompression, CONFIGFILE, log_settings);
 
 
 #if ENABLE_COW
@@ -631,8 +632,12 @@ scsi_system_settings_t *ZuluSCSISettings::initSystem(const char *presetName, boo
 
     cfgSys.logToSDCard = true;
 
+    cfgSys.traceToSDCard = false;
+
     cfgSys.logRotate = 1;
 
+    cfgSys.defragImages = 0;
+
     cfgSys.initiatorParity = true;
 
     cfgSys.wifi_keep_alive_s = WIFI_KEEPALIVE_INTERVAL;
@@ -681,6 +686,7 @@ scsi_system_settings_t *ZuluSCSISettings::initSystem(const char *presetName, boo
     cfgDev.tapeLengthMB = 0; // Default tape length in MB is unlimited
     cfgDev.tapeDensity = 0x10; // Default density: QIC-150
     cfgDev.tapeBufferedMode = 0x00; // Write Good status only after all data has been written to tape
+    cfgDev.tapeCompression = false; // Data compression disabled until host enables it
 
 
     // System-specific defaults
@@ -846,7 +852,9 @@ scsi_system_settings_t *ZuluSCSISettings::initSystem(const char *presetName, boo
 
     cfgSys.maxBusWidth = log_ini_getl("SCSI", "MaxBusWidth", cfgSys.maxBusWidth, CONFIGFILE, log_settings, log_getl_bus_width);
     cfgSys.logToSDCard = log_ini_getbool("SCSI", "LogToSDCard", cfgSys.logToSDCard, CONFIGFILE, log_settings);
+    cfgSys.traceToSDCard = log_ini_getbool("SCSI", "TraceToSDCard", cfgSys.traceToSDCard, CONFIGFILE, log_settings);
     cfgSys.logRotate = log_ini_getl("SCSI", "LogRotate", cfgSys.logRotate, CONFIGFILE, log_settings, log_getl_log_rotate);
+    cfgSys.defragImages = log_ini_getl("SCSI", "DefragImages", cfgSys.defragImages, CONFIGFILE, log_settings);
     
     cfgSys.wifi_keep_alive_s = log_ini_getl("SCSI", "WiFiKeepAliveSecs", cfgSys.wifi_keep_alive_s, CONFIGFILE, log_settings);
 
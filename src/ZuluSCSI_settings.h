@@ -135,8 +135,12 @@ typedef struct __attribute__((__packed__)) scsi_system_settings_t
 
     bool logToSDCard;
 
+    bool traceToSDCard;
+
     int logRotate;
 
+    uint8_t defragImages;
+
     uint32_t wifi_keep_alive_s;
 
 #if ENABLE_COW
@@ -191,6 +195,7 @@ typedef struct __attribute__((__packed__)) scsi_device_settings_t
     int16_t mediumType;
     uint8_t tapeDensity;
     uint8_t tapeBufferedMode;
+    bool tapeCompression;
 } scsi_device_settings_t;
 
 
@@ -0,0 +1,236 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+
+// Per-target performance counters and LOG SENSE pages
+
+#include "ZuluSCSI_stats.h"
+#include <ZuluSCSI_platform.h>
+#include <scsi2sd.h>
+#include <string.h>
+extern "C" {
+#include <scsi.h>
+#include <scsiPhy.h>
+}
+
+static scsi_target_stats_t g_scsi_stats[S2S_MAX_TARGETS];
+
+// Latency measurement of the command in progress
+static struct {
+    bool active;
+    uint8_t target_idx;
+    uint32_t start_us;
+    uint32_t start_stall_us;
+} g_scsi_stats_cmd;
+
+static uint32_t scsiStatsWriteStallUs()
+{
+#ifdef PLATFORM_HAS_SD_WRITE_STALL_COUNTER
+    return platform_sd_write_stall_us();
+#else
+    return 0;
+#endif
+}
+
+scsi_target_stats_t *scsiStatsCurrent()
+{
+    return &g_scsi_stats[scsiDev.target->targetId & S2S_CFG_TARGET_ID_BITS];
+}
+
+void scsiStatsReset(int target_id)
+{
+    memset(&g_scsi_stats[target_id & S2S_CFG_TARGET_ID_BITS], 0, sizeof(scsi_target_stats_t));
+}
+
+void scsiStatsPhaseChange(int old_phase, int new_phase)
+{
+    if (new_phase == COMMAND && scsiDev.target)
+    {
+        g_scsi_stats_cmd.active = true;
+        g_scsi_stats_cmd.target_idx = scsiDev.target->targetId & S2S_CFG_TARGET_ID_BITS;
+        g_scsi_stats_cmd.start_us = micros();
+        g_scsi_stats_cmd.start_stall_us = scsiStatsWriteStallUs();
+    }
+    else if (new_phase == BUS_FREE && g_scsi_stats_cmd.active)
+    {
+        scsi_target_stats_t *stats = &g_scsi_stats[g_scsi_stats_cmd.target_idx];
+        uint32_t elapsed = micros() - g_scsi_stats_cmd.start_us;
+        if (elapsed > stats->max_command_us)
+        {
+            stats->max_command_us = elapsed;
+        }
+
+        stats->sd_write_stall_us += scsiStatsWriteStallUs() - g_scsi_stats_cmd.start_stall_us;
+        g_scsi_stats_cmd.active = false;
+    }
+}
+
+// Builds log page parameters into scsiDev.data.
+// Parameters with code below the parameter pointer field are skipped.
+class LogPageBuilder
+{
+public:
+    LogPageBuilder(uint8_t page_code, uint16_t param_ptr, bool current):
+        m_pos(4), m_param_ptr(param_ptr), m_current(current)
+    {
+        scsiDev.data[0] = page_code;
+        scsiDev.data[1] = 0;
+    }
+
+    void add(uint16_t param_code, uint64_t value, uint8_t length)
+    {
+        if (param_code < m_param_ptr) return;
+
+        // Only cumulative values are kept, thresholds and defaults read as zero
+        if (!m_current) value = 0;
+
+        uint8_t *p = &scsiDev.data[m_pos];
+        p[0] = param_code >> 8;
+        p[1] = param_code & 0xFF;
+        p[2] = 0x00; // Parameter control byte: saving not supported
+        p[3] = length;
+        for (int i = 0; i < length; i++)
+        {
+            p[4 + i] = (uint8_t)(value >> (8 * (length - 1 - i)));
+        }
+        m_pos += 4 + length;
+    }
+
+    // Add page code to supported pages list
+    void addPage(uint8_t page_code)
+    {
+        scsiDev.data[m_pos++] = page_code;
+    }
+
+    uint32_t finish()
+    {
+        uint16_t page_length = m_pos - 4;
+        scsiDev.data[2] = page_length >> 8;
+        scsiDev.data[3] = page_length & 0xFF;
+        return m_pos;
+    }
+
+private:
+    uint32_t m_pos;
+    uint16_t m_param_ptr;
+    bool m_current;
+};
+
+// Read and write error counter pages, parameter codes from SPC
+static void addErrorCounters(LogPageBuilder &page, uint64_t bytes, uint32_t errors)
+{
+    page.add(0x0000, 0, 4); // Errors corrected without substantial delay
+    page.add(0x0001, 0, 4); // Errors corrected with possible delays
+    page.add(0x0002, 0, 4); // Total rewrites or rereads
+    page.add(0x0003, 0, 4); // Total errors corrected
+    page.add(0x0004, 0, 4); // Total times correction algorithm processed
+    page.add(0x0005, bytes, 8); // Total bytes processed
+    page.add(0x0006, errors, 4); // Total uncorrected errors
+}
+
+void scsiStatsLogSense()
+{
+    bool ppc = scsiDev.cdb[1] & 0x02;
+    bool sp = scsiDev.cdb[1] & 0x01;
+    uint8_t pc = scsiDev.cdb[2] >> 6;
+    uint8_t page_code = scsiDev.cdb[2] & 0x3F;
+    uint16_t param_ptr = ((uint16_t)scsiDev.cdb[5] << 8) | scsiDev.cdb[6];
+    uint16_t alloc_len = ((uint16_t)scsiDev.cdb[7] << 8) | scsiDev.cdb[8];
+    const scsi_target_stats_t *stats = scsiStatsCurrent();
+
+    // Cumulative values are reported for current cumulative page control,
+    // all other page control values read as zero.
+    LogPageBuilder page(page_code, param_ptr, pc == 1);
+    bool valid = !ppc && !sp;
+
+    if (!valid)
+    {
+        // Parameter saving and changed parameter lists are not supported
+    }
+    else if (page_code == 0x00)
+    {
+        page.addPage(0x00);
+        page.addPage(0x02);
+        page.addPage(0x03);
+        page.addPage(SCSI_STATS_VENDOR_LOG_PAGE);
+    }
+    else if (page_code == 0x02)
+    {
+        addErrorCounters(page, stats->bytes_written, stats->write_errors);
+    }
+    else if (page_code == 0x03)
+    {
+        addErrorCounters(page, stats->bytes_read, stats->read_errors);
+    }
+    else if (page_code == SCSI_STATS_VENDOR_LOG_PAGE)
+    {
+        page.add(0x0000, stats->read_commands, 4);
+        page.add(0x0001, stats->write_commands, 4);
+        page.add(0x0002, stats->bytes_read, 8);
+        page.add(0x0003, stats->bytes_written, 8);
+        page.add(0x0004, stats->prefetch_hits, 4);
+        page.add(0x0005, stats->prefetch_misses, 4);
+        page.add(0x0006, stats->sd_write_stall_us, 8);
+        page.add(0x0007, stats->max_command_us, 4);
+    }
+    else
+    {
+        valid = false;
+    }
+
+    if (!valid)
+    {
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    scsiDev.dataLen = page.finish();
+    if (scsiDev.dataLen > alloc_len)
+    {
+        scsiDev.dataLen = alloc_len;
+    }
+    scsiDev.phase = DATA_IN;
+}
+
+void scsiStatsLogSelect()
+{
+    bool pcr = scsiDev.cdb[1] & 0x02;
+    uint16_t param_len = ((uint16_t)scsiDev.cdb[7] << 8) | scsiDev.cdb[8];
+
+    if (param_len != 0)
+    {
+        // Setting thresholds or individual parameters is not supported
+        scsiDev.status = CHECK_CONDITION;
+        scsiDev.target->sense.code = ILLEGAL_REQUEST;
+        scsiDev.target->sense.asc = INVALID_FIELD_IN_CDB;
+        scsiDev.phase = STATUS;
+        return;
+    }
+
+    if (pcr)
+    {
+        // Parameter code reset clears all counters
+        scsiStatsReset(scsiDev.target->targetId);
+    }
+}
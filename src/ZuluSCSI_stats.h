@@ -0,0 +1,58 @@
+/** 
+ * ZuluSCSI™ - Copyright (c) 2022-2025 Rabbit Hole Computing™
+ * 
+ * ZuluSCSI™ firmware is licensed under the GPL version 3 or any later version. 
+ * 
+ * https://www.gnu.org/licenses/gpl-3.0.html
+ * ----
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version. 
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details. 
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+**/
+
+
+// Per-target performance and error counters.
+// The counters are reported to the host with the LOG SENSE command
+// and can be reset with LOG SELECT.
+
+#pragma once
+
+#include <stdint.h>
+
+// Vendor-specific LOG SENSE page with performance counters
+#define SCSI_STATS_VENDOR_LOG_PAGE 0x3C
+
+typedef struct {
+    uint32_t read_commands;
+    uint32_t write_commands;
+    uint64_t bytes_read; // Bytes read from image for host
+    uint64_t bytes_written; // Bytes written to image by host
+    uint32_t read_errors; // Image reads that failed
+    uint32_t write_errors; // Image writes that failed
+    uint32_t prefetch_hits; // Sectors served from prefetch buffer
+    uint32_t prefetch_misses; // Sectors read from SD card
+    uint64_t sd_write_stall_us; // Time spent waiting for SD card to program writes
+    uint32_t max_command_us; // Longest time from COMMAND phase to bus free
+} scsi_target_stats_t;
+
+// Get counters for the currently selected target
+scsi_target_stats_t *scsiStatsCurrent();
+
+// Reset counters of one target
+void scsiStatsReset(int target_id);
+
+// Called from scsiLogPhaseChange() to measure command latency
+void scsiStatsPhaseChange(int old_phase, int new_phase);
+
+// LOG SENSE and LOG SELECT command handlers for current target
+void scsiStatsLogSense();
+void scsiStatsLogSelect();
@@ -30,6 +30,7 @@
 #include "ZuluSCSI_log.h"
 #include "ZuluSCSI_config.h"
 #include "ZuluSCSI_tape.h"
+#include "ZuluSCSI_lz.h"
 #include <ZuluSCSI_platform.h>
 #include <ZuluSCSI_platform_config.h>
 #include <scsiPhy.h>
@@ -43,6 +44,25 @@ extern "C" {
 
 tape_drive_t  **g_tape_drive = nullptr;
 
+#if TAPE_WRITE_BUFFER_SIZE > 0
+// Staging buffer for .TAP record headers and unaligned data
+static uint32_t g_tap_stage[TAPE_WRITE_BUFFER_SIZE / 4];
+#endif
+
+// Compressed record data, allocated when compressed records are first used
+static uint8_t *g_tap_lz_buffer = nullptr;
+
+static uint8_t *tapLzBuffer()
+{
+    if (g_tap_lz_buffer == nullptr)
+    {
+        g_tap_lz_buffer = new uint8_t[TAP_COMPRESSED_DATA_MAX];
+        if (g_tap_lz_buffer == nullptr)
+            logmsg("Ran out of memory allocating tape compression buffer");
+    }
+    return g_tap_lz_buffer;
+}
+
 // scsiStartRead is defined in ZuluSCSI_disk.cpp for platforms without non-blocking read
 extern void scsiStartRead(uint8_t* data, uint32_t count, int *parityError);
 
@@ -152,7 +172,43 @@ void tapeSetIsTap(uint8_t scsi_id, bool is_tap)
 
 bool tapeIsTap()
 {
-    return g_tape_drive[scsiDev.target->targetId]->tape_is_tap_format;
+    tape_drive_t *tape_info = g_tape_drive ? g_tape_drive[scsiDev.target->targetId] : nullptr;
+    return tape_info && tape_info->tape_is_tap_format;
+}
+
+// Read first count bytes of record data.
+// Compressed records are read to a separate buffer and decompressed from there.
+static bool tapReadRecordData(image_config_t &img, uint64_t record_pos, const tap_record_t &record, uint8_t *buffer, uint32_t count)
+{
+    if (record.record_class != TAP_CLASS_COMPRESSED)
+    {
+        return img.file.seek(record_pos + 4) && img.file.read(buffer, count) == (ssize_t)count;
+    }
+
+    uint8_t *compdata = tapLzBuffer();
+    uint32_t complen = record.stored_length - TAP_COMPRESSED_HEADER_SIZE;
+    if (!compdata || !img.file.seek(record_pos + 4 + TAP_COMPRESSED_HEADER_SIZE) || img.file.read(compdata, complen) != (ssize_t)complen)
+    {
+        return false;
+    }
+
+    return lz_decompress_partial(compdata, complen, buffer, count) == count;
+}
+
+// Get the uncompressed length of a compressed record
+static bool tapReadCompressedLength(image_config_t &img, uint64_t record_pos, tap_record_t &record)
+{
+    uint8_t header[TAP_COMPRESSED_HEADER_SIZE];
+    if (record.stored_length <= TAP_COMPRESSED_HEADER_SIZE ||
+        record.stored_length - TAP_COMPRESSED_HEADER_SIZE > TAP_COMPRESSED_DATA_MAX ||
+        !img.file.seek(record_pos + 4) || img.file.read(header, sizeof(header)) != sizeof(header))
+    {
+        logmsg("------ TAP invalid compressed record at file_pos=", (int)record_pos);
+        return false;
+    }
+
+    record.length = readLE32(header);
+    return true;
 }
 
 // Read a .TAP record moving forward
@@ -180,6 +236,7 @@ tap_result_t tapReadRecordForward(image_config_t &img, tap_record_t &record, uin
     
     record.record_class = (length_with_class >> 28) & 0xF;
     record.length = length_with_class & 0x0FFFFFFF;
+    record.stored_length = record.length;
 
     // Check for special markers
     if (length_with_class == TAP_MARKER_TAPEMARK) {
@@ -196,6 +253,12 @@ tap_result_t tapReadRecordForward(image_config_t &img, tap_record_t &record, uin
         scsiDev.target->tapeBOM = 0;
         return TAP_END_OF_TAPE;
     }
+
+    if (record.record_class == TAP_CLASS_COMPRESSED && !tapReadCompressedLength(img, tape_info->file_pos, record)) {
+        record.is_error = true;
+        return TAP_ERROR;
+    }
+
     tap_result_t tap_result_status = TAP_OK;
     // Data records
     // If the data record is variable length, check the buffer size is the same as the length
@@ -216,10 +279,10 @@ tap_result_t tapReadRecordForward(image_config_t &img, tap_record_t &record, uin
     // Read the data if buffer provided
     if (record.length > 0) {
         uint32_t data_length = record.length;
-        uint32_t padded_length = (data_length + 1) & ~1;  // Round up to even
+        uint32_t padded_length = (record.stored_length + 1) & ~1;  // Round up to even
 
         if (TAP_OVERLENGTH == tap_result_status) {
-            if (!img.file.seek(tape_info->file_pos + 4) || img.file.read(buffer, buffer_size) != (ssize_t)buffer_size) {
+            if (!tapReadRecordData(img, tape_info->file_pos, record, buffer, buffer_size)) {
                 logmsg("------ TAP overlength record data read or seek error");
                 record.is_error = true;
                 return TAP_ERROR;
@@ -227,7 +290,7 @@ tap_result_t tapReadRecordForward(image_config_t &img, tap_record_t &record, uin
         }
         else if (TAP_UNDERLENGTH == tap_result_status) {
             // For underlength, read the available data and zero-fill the rest of the buffer
-            if (!img.file.seek(tape_info->file_pos + 4) || img.file.read(buffer, data_length) != (ssize_t)data_length) {
+            if (!tapReadRecordData(img, tape_info->file_pos, record, buffer, data_length)) {
                 logmsg("------ TAP underlength record data read or seek error");
                 record.is_error = true;
                 return TAP_ERROR;
@@ -236,7 +299,7 @@ tap_result_t tapReadRecordForward(image_config_t &img, tap_record_t &record, uin
         else if (buffer && buffer_size >= data_length) {
         // buffer is nullptr when data does not need to read
 
-            if (!img.file.seek(tape_info->file_pos + 4) || img.file.read(buffer, data_length) != (ssize_t)data_length) {
+            if (!tapReadRecordData(img, tape_info->file_pos, record, buffer, data_length)) {
                 logmsg("------ TAP failed to seek and/or read data");
                 record.is_error = true;
                 return TAP_ERROR;
@@ -252,8 +315,8 @@ tap_result_t tapReadRecordForward(image_config_t &img, tap_record_t &record, uin
         }
 
         uint32_t trailing_length = readLE32(trailer) & 0x0FFFFFFF;
-        if (trailing_length != record.length) {
-            logmsg("------ TAP record length mismatch: header=", (int)record.length, " trailer=", (int)trailing_length);
+        if (trailing_length != record.stored_length) {
+            logmsg("------ TAP record length mismatch: header=", (int)record.stored_length, " trailer=", (int)trailing_length);
             record.is_error = true;
             return TAP_ERROR;
         }
@@ -314,9 +377,10 @@ tap_result_t tapReadRecordBackward(image_config_t &img, tap_record_t &record, ui
 
     record.record_class = (length_with_class >> 28) & 0xF;
     record.length = length_with_class & 0x0FFFFFFF;
+    record.stored_length = record.length;
 
     if (record.length > 0) {
-        uint32_t padded_length = (record.length + 1) & ~1;
+        uint32_t padded_length = (record.stored_length + 1) & ~1;
         uint32_t total_length = 8 + padded_length;
 
         if (tape_info->file_pos < total_length) {
@@ -325,31 +389,38 @@ tap_result_t tapReadRecordBackward(image_config_t &img, tap_record_t &record, ui
         }
 
         // Move to start of record
-        tape_info->file_pos -= total_length;
-        tape_info->data_pos -= record.length;
-
-        // we are at the begining of the tape, beginning of media
-        if (tape_info->file_pos == 0)
-            scsiDev.target->tapeBOM = 1;
+        uint64_t record_pos = tape_info->file_pos - total_length;
 
         // Verify header length matches
         uint8_t header[4];
-        if (!img.file.seek(tape_info->file_pos) || img.file.read(header, 4) != 4) {
+        if (!img.file.seek(record_pos) || img.file.read(header, 4) != 4) {
             logmsg("------ TAP backward record header read or seek error");
             record.is_error = true;
             return TAP_ERROR;
         }
 
         uint32_t header_length = readLE32(header) & 0x0FFFFFFF;
-        if (header_length != record.length) {
-            logmsg("------ TAP backward record length mismatch: header=", (int)header_length, " trailer=", (int)record.length);
+        if (header_length != record.stored_length) {
+            logmsg("------ TAP backward record length mismatch: header=", (int)header_length, " trailer=", (int)record.stored_length);
             record.is_error = true;
             return TAP_ERROR;
         }
 
+        if (record.record_class == TAP_CLASS_COMPRESSED && !tapReadCompressedLength(img, record_pos, record)) {
+            record.is_error = true;
+            return TAP_ERROR;
+        }
+
+        tape_info->file_pos = record_pos;
+        tape_info->data_pos -= record.length;
+
+        // we are at the begining of the tape, beginning of media
+        if (tape_info->file_pos == 0)
+            scsiDev.target->tapeBOM = 1;
+
         // Read data if buffer provided
         if (buffer && buffer_size >= record.length) {
-            if (!img.file.seek(tape_info->file_pos + 4) || img.file.read(buffer, record.length) != (ssize_t)record.length) {
+            if (!tapReadRecordData(img, tape_info->file_pos, record, buffer, record.length)) {
                 logmsg("------ TAP backward record data read or seek error");
                 record.is_error = true;
                 return TAP_ERROR;
@@ -598,8 +669,19 @@ struct tap_transfer_t {
     uint32_t sd_transfer_start; // Start position for SD transfer
     uint32_t current_block;     // Current block being written in fixed block
     int parityError;            // Parity error flag
+
+    // Record headers and unaligned data are collected to the staging buffer,
+    // sector-aligned data is written directly from the SCSI buffer.
+    uint32_t stage_fill;        // Bytes in staging buffer
+    uint64_t stage_pos;         // File position of the first byte in staging buffer
+    uint32_t direct_offset;     // Offset of direct write from the start of unwritten SCSI data
+
+    bool compress;              // Data compression enabled for this write
 };
 
+// Work area for record compression, allocated when compression is first used
+static void *g_tap_lz_workmem = nullptr;
+
 static tap_transfer_t g_tap_transfer;
 
 
@@ -851,6 +933,18 @@ void tapMediumStartWrite(uint32_t length, bool fixed) {
     g_tap_transfer.is_fixed_mode = fixed;
     g_tap_transfer.file_pos_start = tape_info->file_pos;
     g_tap_transfer.data_written = 0;
+    g_tap_transfer.compress = false;
+
+    if (scsiDev.target->liveCfg.tapeCompression)
+    {
+        if (g_tap_lz_workmem == nullptr)
+        {
+            g_tap_lz_workmem = new uint16_t[LZ_COMPRESS_WORKMEM_SIZE / sizeof(uint16_t)];
+            if (g_tap_lz_workmem == nullptr)
+                logmsg("Ran out of memory allocating tape compression work area, writing uncompressed");
+        }
+        g_tap_transfer.compress = (g_tap_lz_workmem != nullptr && tapLzBuffer() != nullptr);
+    }
 
     // Set up SCSI transfer similar to scsiDiskStartWrite
     transfer.blocks = fixed ? length : 1;
@@ -894,9 +988,10 @@ void tapDataOut_callback(uint32_t bytes_complete)
 
         // Keep transfers a multiple of sector size.
         // Macintosh SCSI driver seems to get confused if we have a delay
-        // in middle of a sector.
+        // in middle of a sector. Records larger than the SCSI read block
+        // size have to be received in parts.
         uint32_t bytesPerSector = g_tap_transfer.record_length;
-        if (remain >= bytesPerSector && len % bytesPerSector != 0)
+        if (remain >= bytesPerSector && len > bytesPerSector && len % bytesPerSector != 0)
         {
             len -= len % bytesPerSector;
         }
@@ -911,6 +1006,156 @@ void tapDataOut_callback(uint32_t bytes_complete)
 
 }
 
+// Data before the SD write has already been copied to staging buffer or
+// written, so the whole SCSI buffer up to bytes_sd is free for new data.
+static void tapStageWrite_callback(uint32_t bytes_complete)
+{
+    tapDataOut_callback(0);
+}
+
+// Direct write from the SCSI buffer, bytes_complete counts from the start
+// of the write instead of the start of unwritten SCSI data.
+static void tapDirectWrite_callback(uint32_t bytes_complete)
+{
+    tapDataOut_callback(g_tap_transfer.direct_offset + bytes_complete);
+}
+
+// Write data to SD card without staging.
+// SCSI reception continues into the buffer space that has been written.
+static bool tapWriteDirect(image_config_t &img, const uint8_t *data, uint32_t len)
+{
+    uint32_t bufsize = sizeof(scsiDev.data);
+    if (data >= scsiDev.data && data < scsiDev.data + bufsize)
+    {
+        g_tap_transfer.direct_offset = (data - scsiDev.data) - (g_tap_transfer.bytes_sd % bufsize);
+        platform_set_sd_callback(tapDirectWrite_callback, data);
+    }
+    else
+    {
+        platform_set_sd_callback(tapStageWrite_callback, data);
+    }
+
+    bool ok = (img.file.write(data, len) == len);
+    platform_set_sd_callback(NULL, NULL);
+
+    if (ok)
+    {
+        g_tap_transfer.stage_pos += len;
+    }
+    return ok;
+}
+
+#if TAPE_WRITE_BUFFER_SIZE > 0
+// Write staged data to SD card.
+// Unless this is the last write of the transfer, the write is cut to end at
+// a sector boundary, so that the next write starts sector-aligned and SdFat
+// can write it directly to the card without read-modify-write of its cache.
+static bool tapStageFlush(image_config_t &img, bool last)
+{
+    uint8_t *stage = (uint8_t*)g_tap_stage;
+    uint64_t end = g_tap_transfer.stage_pos + g_tap_transfer.stage_fill;
+    if (!last)
+    {
+        end -= end % SD_SECTOR_SIZE;
+    }
+
+    if (end <= g_tap_transfer.stage_pos)
+    {
+        return true;
+    }
+    uint32_t count = end - g_tap_transfer.stage_pos;
+
+    platform_set_sd_callback(tapStageWrite_callback, stage);
+    bool ok = (img.file.write(stage, count) == count);
+    platform_set_sd_callback(NULL, NULL);
+
+    if (!ok)
+    {
+        return false;
+    }
+
+    g_tap_transfer.stage_fill -= count;
+    g_tap_transfer.stage_pos += count;
+    memmove(stage, stage + count, g_tap_transfer.stage_fill);
+    return true;
+}
+
+// Append bytes to the .TAP record stream.
+// Whole sectors starting at a sector boundary are written directly,
+// everything else goes through the staging buffer.
+static bool tapStage(image_config_t &img, const uint8_t *data, uint32_t len)
+{
+    tape_drive_t *tape_info = g_tape_drive[img.scsiId & S2S_CFG_TARGET_ID_BITS];
+    tape_info->file_pos += len;
+
+    while (len > 0)
+    {
+        uint64_t pos = g_tap_transfer.stage_pos + g_tap_transfer.stage_fill;
+        uint32_t to_boundary = (SD_SECTOR_SIZE - pos % SD_SECTOR_SIZE) % SD_SECTOR_SIZE;
+
+        if (to_boundary == 0 && len >= SD_SECTOR_SIZE)
+        {
+            // Staged data ends at the sector boundary, so it is written out completely
+            uint32_t n = len - len % SD_SECTOR_SIZE;
+            if (!tapStageFlush(img, false) || !tapWriteDirect(img, data, n))
+            {
+                return false;
+            }
+            data += n;
+            len -= n;
+            continue;
+        }
+
+        // Stop at the sector boundary if whole sectors follow
+        uint32_t n = std::min<uint32_t>(len, sizeof(g_tap_stage) - g_tap_transfer.stage_fill);
+        if (len > to_boundary && len - to_boundary >= SD_SECTOR_SIZE)
+        {
+            n = std::min(n, to_boundary);
+        }
+
+        memcpy((uint8_t*)g_tap_stage + g_tap_transfer.stage_fill, data, n);
+        g_tap_transfer.stage_fill += n;
+        data += n;
+        len -= n;
+
+        if (g_tap_transfer.stage_fill == sizeof(g_tap_stage) && !tapStageFlush(img, false))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+#else
+static bool tapStageFlush(image_config_t &img, bool last)
+{
+    return true;
+}
+
+// Append bytes to the .TAP record stream
+static bool tapStage(image_config_t &img, const uint8_t *data, uint32_t len)
+{
+    tape_drive_t *tape_info = g_tape_drive[img.scsiId & S2S_CFG_TARGET_ID_BITS];
+    tape_info->file_pos += len;
+    return tapWriteDirect(img, data, len);
+}
+#endif
+
+// Compress a complete record to the compression buffer.
+// Returns the compressed data length, or 0 if the record does not shrink
+// enough to fit, in which case it must be written uncompressed.
+static uint32_t tapCompressRecord(const uint8_t *data, uint32_t len)
+{
+    if (len <= TAP_COMPRESSED_HEADER_SIZE + 1)
+    {
+        return 0;
+    }
+
+    // Compressed record must be smaller than the original
+    uint32_t dstcap = std::min<uint32_t>(len - TAP_COMPRESSED_HEADER_SIZE - 1, TAP_COMPRESSED_DATA_MAX);
+    return lz_compress_block(data, len, g_tap_lz_buffer, dstcap, g_tap_lz_workmem);
+}
+
 void tapeTapDataOut()
 {
     image_config_t &img = *(image_config_t*)scsiDev.target->cfg;
@@ -934,6 +1179,8 @@ void tapeTapDataOut()
     g_tap_transfer.bytes_scsi_started = 0;
     g_tap_transfer.sd_transfer_start = 0;
     g_tap_transfer.parityError = 0;
+    g_tap_transfer.stage_fill = 0;
+    g_tap_transfer.stage_pos = tape_info->file_pos;
 
     if (!img.file.seek(tape_info->file_pos))
     {
@@ -945,14 +1192,19 @@ void tapeTapDataOut()
         return;
     }
 
+    uint32_t record_length = g_tap_transfer.record_length;
+    uint8_t record_length_metadata[4];
+    writeLE32(record_length_metadata, record_length);
+    uint8_t compressed_metadata[4 + TAP_COMPRESSED_HEADER_SIZE];
+
     while (g_tap_transfer.bytes_sd < g_tap_transfer.bytes_scsi
         && scsiDev.phase == DATA_OUT
         && !scsiDev.resetFlag)
     {
         platform_poll();
         diskEjectButtonUpdate(false);
-        
-        // Figure out how many contiguous bytes are available for writing to SD card.
+
+        // Figure out how many contiguous bytes have been received from SCSI bus.
         uint32_t bufsize = sizeof(scsiDev.data);
         uint32_t start = g_tap_transfer.bytes_sd % bufsize;
         uint32_t len = 0;
@@ -963,7 +1215,7 @@ void tapeTapDataOut()
             available = bufsize - start;
         }
         // Count number of finished sectors
-        if (scsiIsReadFinished(&scsiDev.data[start + available - 1]))
+        if (available > 0 && scsiIsReadFinished(&scsiDev.data[start + available - 1]))
         {
             len = available;
         }
@@ -980,114 +1232,105 @@ void tapeTapDataOut()
         {
             len = available;
         }
-        // Apply platform-specific write size blocks for optimization
-        if (len > PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE)
-        {
-            len = PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE;
-        }
 
-        uint32_t remain_in_transfer = g_tap_transfer.bytes_scsi - g_tap_transfer.bytes_sd;
-        if (len < bufsize - start && len < remain_in_transfer)
+        // Compression needs the complete record, wait for the rest of it
+        // if it fits in the buffer without wrapping around.
+        if (g_tap_transfer.compress && len < record_length &&
+            g_tap_transfer.data_written % record_length == 0 &&
+            start + record_length <= bufsize)
         {
-            // Use large write blocks in middle of transfer and smaller at the end of transfer.
-            // This improves performance for large writes and reduces latency at end of request.
-            uint32_t min_write_size = PLATFORM_OPTIMAL_MIN_SD_WRITE_SIZE;
-            if (remain_in_transfer <= PLATFORM_OPTIMAL_MAX_SD_WRITE_SIZE)
-            {
-                min_write_size = PLATFORM_OPTIMAL_LAST_SD_WRITE_SIZE;
-            }
-
-            if (len < min_write_size)
-            {
-                len = 0;
-            }
+            len = 0;
         }
-        
+
         if (len == 0)
         {
             // Nothing ready to transfer, check if we can read more from SCSI bus
             tapDataOut_callback(0);
+            continue;
         }
-        else
+
+        // Copy received data into the staging buffer, adding record headers and trailers.
+        // The staging buffer is written to SD card in large sector-aligned blocks
+        // whenever it fills up, so there is no need to wait for more data here.
+        uint8_t *buf = &scsiDev.data[start];
+        g_tap_transfer.sd_transfer_start = start;
+
+        while (len > 0)
         {
-            
-            // Start writing to SD card and simultaneously start new SCSI transfers
-            // when buffer space is freed.
-            
-            uint8_t *buf = &scsiDev.data[start];
-            g_tap_transfer.sd_transfer_start = start;
-            
-            uint32_t end_of_data_to_write =  len;
-            uint32_t record_length = g_tap_transfer.record_length;
-            uint64_t data_written_start = g_tap_transfer.data_written;
+            uint32_t record_offset = g_tap_transfer.data_written % record_length;
+            uint32_t data_to_write_len = std::min(record_length - record_offset, len);
 
-            uint8_t record_length_metadata[4];
-            writeLE32(record_length_metadata, record_length);
+            // Finalize transfer on SCSI side
+            scsiFinishRead(buf, data_to_write_len, &g_tap_transfer.parityError);
 
-            while (g_tap_transfer.data_written - data_written_start < end_of_data_to_write)
+            // Check parity error status before writing to SD card
+            if (g_tap_transfer.parityError)
             {
-                uint32_t end_of_next_data_record =  record_length - (g_tap_transfer.data_written % record_length);
-                // write header
-                if ((g_tap_transfer.data_written % record_length) == 0)
-                {                        if (img.file.write(record_length_metadata, sizeof(record_length_metadata)) != sizeof(record_length_metadata))
-                    {
-                        goto write_error;
-                    }
-                    tape_info->file_pos += sizeof(record_length_metadata);
-                }
-
+                scsiDev.status = CHECK_CONDITION;
+                scsiDev.target->sense.code = ABORTED_COMMAND;
+                scsiDev.target->sense.asc = SCSI_PARITY_ERROR;
+                scsiDev.phase = STATUS;
+                break;
+            }
 
-                uint32_t data_to_write_len = std::min(end_of_next_data_record, len);
+            // Records are compressed when they have been received completely
+            const uint8_t *trailer = record_length_metadata;
+            uint32_t complen = 0;
+            if (record_offset == 0 && data_to_write_len == record_length && g_tap_transfer.compress)
+            {
+                complen = tapCompressRecord(buf, record_length);
+            }
 
-                // Finalize transfer on SCSI side
-                scsiFinishRead(buf, data_to_write_len, &g_tap_transfer.parityError);
+            if (complen > 0)
+            {
+                writeLE32(compressed_metadata, ((uint32_t)TAP_CLASS_COMPRESSED << 28) | (TAP_COMPRESSED_HEADER_SIZE + complen));
+                writeLE32(compressed_metadata + 4, record_length);
+                trailer = compressed_metadata;
 
-                // Check parity error status before writing to SD card
-                if (g_tap_transfer.parityError)
+                if (!tapStage(img, compressed_metadata, sizeof(compressed_metadata)) ||
+                    !tapStage(img, g_tap_lz_buffer, complen))
                 {
-                    scsiDev.status = CHECK_CONDITION;
-                    scsiDev.target->sense.code = ABORTED_COMMAND;
-                    scsiDev.target->sense.asc = SCSI_PARITY_ERROR;
-                    scsiDev.phase = STATUS;
-                    break;
+                    goto write_error;
+                }
+            }
+            else
+            {
+                if (record_offset == 0 && !tapStage(img, record_length_metadata, sizeof(record_length_metadata)))
+                {
+                    goto write_error;
                 }
 
-                // write data
-                platform_set_sd_callback(tapDataOut_callback, buf);
-                if (img.file.write(buf, data_to_write_len) != data_to_write_len)
+                if (!tapStage(img, buf, data_to_write_len))
                 {
                     goto write_error;
                 }
-                g_tap_transfer.data_written += data_to_write_len;
-                tape_info->file_pos +=  data_to_write_len;
-                tape_info->data_pos += data_to_write_len;
-                platform_set_sd_callback(NULL, NULL);
-                g_tap_transfer.bytes_sd += data_to_write_len;
-                buf += data_to_write_len;
-
-                // write trailer
-                if (data_to_write_len == end_of_next_data_record)
+            }
+            g_tap_transfer.data_written += data_to_write_len;
+            tape_info->data_pos += data_to_write_len;
+            g_tap_transfer.bytes_sd += data_to_write_len;
+            buf += data_to_write_len;
+            len -= data_to_write_len;
+
+            // write trailer
+            if (record_offset + data_to_write_len == record_length)
+            {
+                // round to even position
+                if (tape_info->file_pos & 1)
                 {
-                    // round to even position
-                    if (tape_info->file_pos & 1)
-                    { 
-                        uint8_t write_zero = 0;
-                        if (img.file.write(&write_zero, 1) == 1)
-                            tape_info->file_pos += 1;
-                        else
-                            goto write_error;
-                    }
-                    if (img.file.write(record_length_metadata, sizeof(record_length_metadata)) != sizeof(record_length_metadata))
+                    uint8_t write_zero = 0;
+                    if (!tapStage(img, &write_zero, 1))
                     {
                         goto write_error;
                     }
-                    tape_info->file_pos += sizeof(record_length_metadata);
-                    transfer.currentBlock += 1;
-                    tape_info->logical_object_number++;
-                    // After a record has been written, invalidate tape at beginning of media
-                    scsiDev.target->tapeBOM = 0;
                 }
-
+                if (!tapStage(img, trailer, 4))
+                {
+                    goto write_error;
+                }
+                transfer.currentBlock += 1;
+                tape_info->logical_object_number++;
+                // After a record has been written, invalidate tape at beginning of media
+                scsiDev.target->tapeBOM = 0;
             }
         }
     }
@@ -1097,12 +1340,19 @@ void tapeTapDataOut()
 
     scsiDev.dataPtr = scsiDev.dataLen = 0;
 
+    if (!tapStageFlush(img, true))
+    {
+        goto write_error;
+    }
+
     // Verify that all data has been flushed to disk from SdFat cache.
     img.file.flush();
     return;
 
 write_error:
     logmsg("SD card write failed: ", SD.sdErrorCode());
+    // Tape position ends after the last data that made it to SD card
+    tape_info->file_pos = g_tap_transfer.stage_pos;
     scsiDev.status = CHECK_CONDITION;
     scsiDev.target->sense.code = MEDIUM_ERROR;
     scsiDev.target->sense.asc = NO_ADDITIONAL_SENSE_INFORMATION;
@@ -14,6 +14,13 @@ struct image_config_t;
 #define TAP_MARKER_ERASE_GAP   0xFFFFFFFE  // Erase gap marker
 #define TAP_MARKER_END_MEDIUM  0xFFFFFFFF  // End of medium marker
 
+// Record class for records written with data compression enabled.
+// SIMH reserves classes 1-6 for private data records. The record data is
+// the 32-bit little-endian uncompressed length followed by an LZ4 block.
+#define TAP_CLASS_COMPRESSED   0x1
+#define TAP_COMPRESSED_HEADER_SIZE 4
+#define TAP_COMPRESSED_DATA_MAX 8192 // Largest compressed data length that is written or read
+
 // \todo fix me - 2097152 is for the Hercules tapecopy program. we only support (SCSI2SD_BUFFER_SIZE / 2) max currently
 #define TAPE_TAP_BLOCK_SIZE_MAX 2097152// (SCSI2SD_BUFFER_SIZE / 2) // max value 0xFFFFFF
 #define TAPE_TAP_BLOCK_SIZE_MIN  1 // max value 0xFFFF
@@ -27,6 +34,7 @@ struct tap_record_t {
     uint64_t leading_length_file_pos;
     uint64_t trailing_length_file_pos;
     uint32_t length;        // Record length (0 = filemark)
+    uint32_t stored_length; // Record length in file, differs from length for compressed records
     uint8_t record_class;   // SIMH record class (bits 31-28)
     bool is_filemark;       // True if this is a filemark
     bool is_error;         // True if read/parse error occurred
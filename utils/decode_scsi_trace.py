@@ -0,0 +1,150 @@
+#!/usr/bin/python3
+
+'''
+  ZuluSCSI™ - Copyright (c) 2025 Rabbit Hole Computing™
+
+  ZuluSCSI™ file is licensed under the GPL version 3 or any later version.
+
+  https://www.gnu.org/licenses/gpl-3.0.html
+  ----
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+'''
+
+'''This script decodes the binary command trace 'zulutrace.bin' that is written
+to the SD card when TraceToSDCard = 1 is set in zuluscsi.ini.
+It prints latency statistics and histograms per target and opcode.
+With --replay it outputs the read and write commands as a workload file for
+the host native build in lib/ZuluSCSI_platform_native.
+
+Usage: decode_scsi_trace.py zulutrace.bin [--csv | --replay]
+'''
+
+import sys
+import struct
+import collections
+
+TRACE_MAGIC = 0x4352545A
+HEADER = struct.Struct('<IHH')
+RECORD = struct.Struct('<IBBBBIIIIIII')
+
+COMMAND_NAMES = {
+    0x00: 'TestUnitReady', 0x03: 'RequestSense', 0x04: 'FormatUnit',
+    0x08: 'Read6', 0x0A: 'Write6', 0x0B: 'Seek6', 0x12: 'Inquiry',
+    0x15: 'ModeSelect6', 0x1A: 'ModeSense6', 0x1B: 'StartStopUnit',
+    0x1E: 'PreventAllowMediumRemoval', 0x25: 'ReadCapacity',
+    0x28: 'Read10', 0x2A: 'Write10', 0x2B: 'Seek10', 0x2E: 'WriteVerify',
+    0x2F: 'Verify10', 0x35: 'SynchronizeCache', 0x43: 'ReadTOC',
+    0x55: 'ModeSelect10', 0x5A: 'ModeSense10', 0x88: 'Read16',
+    0x8A: 'Write16', 0xA8: 'Read12', 0xAA: 'Write12', 0xBE: 'ReadCD',
+}
+
+FIELDS = ('timestamp_us', 'target_id', 'opcode', 'status', 'reserved',
+          'lba', 'blocks', 'bytes', 'command_us', 'data_us', 'sd_us', 'total_us')
+
+def read_records(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    magic, version, record_size = HEADER.unpack_from(data, 0)
+    if magic != TRACE_MAGIC:
+        raise ValueError("Not a ZuluSCSI trace file")
+    if record_size < RECORD.size:
+        raise ValueError("Unsupported record size %d (version %d)" % (record_size, version))
+
+    records = []
+    pos = HEADER.size
+    while pos + record_size <= len(data):
+        records.append(dict(zip(FIELDS, RECORD.unpack_from(data, pos))))
+        pos += record_size
+
+    # Timestamps are 32-bit microseconds, unwrap them
+    offset = 0
+    prev = 0
+    for rec in records:
+        if rec['timestamp_us'] < prev:
+            offset += 1 << 32
+        prev = rec['timestamp_us']
+        rec['timestamp_us'] += offset
+
+    return records
+
+def percentile(values, pct):
+    idx = min(len(values) - 1, int(len(values) * pct / 100))
+    return values[idx]
+
+def print_histogram(values):
+    # Power-of-two latency buckets
+    buckets = collections.Counter()
+    for v in values:
+        buckets[max(0, v.bit_length() - 1)] += 1
+
+    maxcount = max(buckets.values())
+    for b in range(min(buckets), max(buckets) + 1):
+        count = buckets.get(b, 0)
+        bar = '#' * ((count * 50 + maxcount - 1) // maxcount)
+        print("    %8d - %8d us: %7d %s" % (1 << b if b > 0 else 0, (2 << b) - 1, count, bar))
+
+def print_statistics(records):
+    groups = collections.defaultdict(list)
+    for rec in records:
+        groups[(rec['target_id'], rec['opcode'])].append(rec)
+
+    for (target_id, opcode), recs in sorted(groups.items()):
+        total = sorted(r['total_us'] for r in recs)
+        nbytes = sum(r['bytes'] for r in recs)
+        data_us = sum(r['data_us'] for r in recs)
+        sd_us = sum(r['sd_us'] for r in recs)
+        cmd_us = sum(r['command_us'] for r in recs)
+        errors = sum(1 for r in recs if r['status'] != 0)
+
+        print("ID %d opcode 0x%02X %s: %d commands, %d errors" %
+              (target_id, opcode, COMMAND_NAMES.get(opcode, ''), len(recs), errors))
+        print("    total us: min %d, median %d, p90 %d, p99 %d, max %d" %
+              (total[0], percentile(total, 50), percentile(total, 90), percentile(total, 99), total[-1]))
+        print("    average us: command %d, data %d, SD %d" %
+              (cmd_us // len(recs), data_us // len(recs), sd_us // len(recs)))
+        if nbytes > 0 and sum(total) > 0:
+            print("    %d kB transferred, %d kB/s" % (nbytes // 1024, nbytes * 1000 // sum(total)))
+        print_histogram(total)
+        print()
+
+def print_csv(records):
+    print(','.join(FIELDS))
+    for rec in records:
+        print(','.join(str(rec[f]) for f in FIELDS))
+
+def print_replay(records):
+    print("# Workload converted from ZuluSCSI command trace")
+    for rec in records:
+        if rec['opcode'] in (0x08, 0x28, 0x88, 0xA8):
+            print("read %d %d %d" % (rec['target_id'], rec['lba'], rec['blocks']))
+        elif rec['opcode'] in (0x0A, 0x2A, 0x8A, 0xAA):
+            print("write %d %d %d" % (rec['target_id'], rec['lba'], rec['blocks']))
+        elif rec['opcode'] == 0x00:
+            print("%d 00 00 00 00 00 00" % rec['target_id'])
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+
+    records = read_records(sys.argv[1])
+    if '--csv' in sys.argv:
+        print_csv(records)
+    elif '--replay' in sys.argv:
+        print_replay(records)
+    elif not records:
+        print("No commands in trace")
+    else:
+        print_statistics(records)